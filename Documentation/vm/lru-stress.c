@@ -0,0 +1,267 @@
+/*
+ * Page cache churn benchmark for the LRU lists.
+ *
+ * Every worker process reads its own file in a loop and drops the file
+ * from the page cache after each pass with POSIX_FADV_DONTNEED, so that
+ * pages keep being added to and removed from the LRU lists.  With -r each
+ * chunk is read twice, which exercises page activation as well.
+ *
+ * The program reports the pages read per second and, when the kernel
+ * was built with CONFIG_LOCK_STAT, the contentions and acquisitions of
+ * the lru_lock of all lruvecs, per zone and per memcg, taken from
+ * /proc/lock_stat over the run:
+ *
+ *	echo 1 > /proc/sys/kernel/lock_stat
+ *	./lru-stress -p 64 -s 128 -t 30 -d /mnt/scratch
+ *
+ * Run it on a filesystem that is backed by a real device.  tmpfs pages
+ * are not dropped by fadvise.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+
+#define CHUNK		(64 * 1024)
+
+static int nr_procs = 4;
+static unsigned long file_mb = 64;
+static int run_secs = 10;
+static int reread;
+static const char *dir = ".";
+
+static volatile sig_atomic_t stop;
+
+struct lru_lock_stat {
+	unsigned long long contentions;
+	unsigned long long acquisitions;
+};
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-p procs] [-s file_mb] [-t secs] [-r] [-d dir]\n"
+		"  -p  number of worker processes (default %d)\n"
+		"  -s  size of each worker's file in MB (default %lu)\n"
+		"  -t  run time in seconds (default %d)\n"
+		"  -r  read every chunk twice to trigger page activation\n"
+		"  -d  directory for the worker files (default %s)\n",
+		prog, nr_procs, file_mb, run_secs, dir);
+	exit(1);
+}
+
+/*
+ * Sum up all lru_lock classes in /proc/lock_stat.  Returns -1 if lock
+ * statistics are not available.
+ */
+static int read_lru_lock_stat(struct lru_lock_stat *st)
+{
+	char line[512];
+	FILE *f;
+
+	memset(st, 0, sizeof(*st));
+	f = fopen("/proc/lock_stat", "r");
+	if (!f)
+		return -1;
+
+	while (fgets(line, sizeof(line), f)) {
+		unsigned long long con_bounces, contentions, acq_bounces, acq;
+		double wmin, wmax, wtotal;
+		char *p;
+
+		if (!strstr(line, "lru_lock") || strstr(line, "-----"))
+			continue;
+		p = strrchr(line, ':');
+		if (!p)
+			continue;
+		/* the class line: name: con-bounces contentions ... */
+		if (sscanf(p + 1, "%llu %llu %lf %lf %lf %llu %llu",
+			   &con_bounces, &contentions, &wmin, &wmax, &wtotal,
+			   &acq_bounces, &acq) != 7)
+			continue;
+		st->contentions += contentions;
+		st->acquisitions += acq;
+	}
+	fclose(f);
+	return 0;
+}
+
+static void create_file(const char *path)
+{
+	char *buf = malloc(CHUNK);
+	unsigned long i;
+	int fd;
+
+	if (!buf) {
+		perror("malloc");
+		exit(1);
+	}
+	memset(buf, 0x5a, CHUNK);
+
+	fd = open(path, O_CREAT | O_TRUNC | O_WRONLY, 0600);
+	if (fd < 0) {
+		perror(path);
+		exit(1);
+	}
+	for (i = 0; i < file_mb * 1024 * 1024 / CHUNK; i++) {
+		if (write(fd, buf, CHUNK) != CHUNK) {
+			perror("write");
+			exit(1);
+		}
+	}
+	fsync(fd);
+	close(fd);
+	free(buf);
+}
+
+static void sigalrm(int sig)
+{
+	stop = 1;
+}
+
+/* Read the file over and over, returning the number of pages read */
+static unsigned long long worker(const char *path)
+{
+	unsigned long long pages = 0;
+	off_t size = (off_t)file_mb * 1024 * 1024;
+	char *buf = malloc(CHUNK);
+	long pagesize = sysconf(_SC_PAGESIZE);
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0 || !buf) {
+		perror(path);
+		exit(1);
+	}
+
+	while (!stop) {
+		off_t off;
+
+		for (off = 0; off < size && !stop; off += CHUNK) {
+			if (pread(fd, buf, CHUNK, off) != CHUNK) {
+				perror("pread");
+				exit(1);
+			}
+			if (reread && pread(fd, buf, CHUNK, off) != CHUNK) {
+				perror("pread");
+				exit(1);
+			}
+			pages += CHUNK / pagesize;
+		}
+		posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+	}
+
+	close(fd);
+	free(buf);
+	return pages;
+}
+
+int main(int argc, char **argv)
+{
+	struct lru_lock_stat before, after;
+	unsigned long long total = 0;
+	struct timeval start, end;
+	int pipefd[2];
+	int have_stat;
+	double secs;
+	char path[4096];
+	int c, i;
+
+	while ((c = getopt(argc, argv, "p:s:t:rd:h")) != -1) {
+		switch (c) {
+		case 'p':
+			nr_procs = atoi(optarg);
+			break;
+		case 's':
+			file_mb = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			run_secs = atoi(optarg);
+			break;
+		case 'r':
+			reread = 1;
+			break;
+		case 'd':
+			dir = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (nr_procs <= 0 || !file_mb || run_secs <= 0)
+		usage(argv[0]);
+
+	for (i = 0; i < nr_procs; i++) {
+		snprintf(path, sizeof(path), "%s/lru-stress.%d", dir, i);
+		create_file(path);
+	}
+
+	if (pipe(pipefd)) {
+		perror("pipe");
+		return 1;
+	}
+
+	have_stat = !read_lru_lock_stat(&before);
+	gettimeofday(&start, NULL);
+
+	for (i = 0; i < nr_procs; i++) {
+		pid_t pid = fork();
+
+		if (pid < 0) {
+			perror("fork");
+			return 1;
+		}
+		if (!pid) {
+			unsigned long long pages;
+
+			signal(SIGALRM, sigalrm);
+			alarm(run_secs);
+			snprintf(path, sizeof(path), "%s/lru-stress.%d", dir, i);
+			pages = worker(path);
+			if (write(pipefd[1], &pages, sizeof(pages)) !=
+			    sizeof(pages))
+				exit(1);
+			exit(0);
+		}
+	}
+	close(pipefd[1]);
+
+	for (i = 0; i < nr_procs; i++) {
+		unsigned long long pages;
+
+		if (read(pipefd[0], &pages, sizeof(pages)) == sizeof(pages))
+			total += pages;
+	}
+	while (wait(NULL) > 0 || errno == EINTR)
+		;
+
+	gettimeofday(&end, NULL);
+	if (have_stat)
+		read_lru_lock_stat(&after);
+
+	secs = (end.tv_sec - start.tv_sec) +
+		(end.tv_usec - start.tv_usec) / 1000000.0;
+	printf("procs %d, file %lu MB, %s: %.0f pages/s\n",
+	       nr_procs, file_mb, reread ? "reread" : "read once",
+	       total / secs);
+
+	if (have_stat)
+		printf("lru_lock: %llu contentions, %llu acquisitions\n",
+		       after.contentions - before.contentions,
+		       after.acquisitions - before.acquisitions);
+	else
+		printf("lru_lock: /proc/lock_stat not available\n");
+
+	for (i = 0; i < nr_procs; i++) {
+		snprintf(path, sizeof(path), "%s/lru-stress.%d", dir, i);
+		unlink(path);
+	}
+	return 0;
+}
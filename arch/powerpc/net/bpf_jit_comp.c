@@ -13,6 +13,7 @@
 #include <asm/cacheflush.h>
 #include <linux/netdevice.h>
 #include <linux/filter.h>
+#include <linux/reciprocal_div.h>
 #include "bpf_jit.h"
 
 #ifndef __BIG_ENDIAN
@@ -203,7 +204,7 @@ static int bpf_jit_build_body(struct sk_filter *fp, u32 *image,
 			PPC_DIVWU(r_A, r_A, r_X);
 			break;
 		case BPF_S_ALU_DIV_K: /* A = reciprocal_divide(A, K); */
-			PPC_LI32(r_scratch1, K);
+			PPC_LI32(r_scratch1, reciprocal_value(K));
 			/* Top 32 bits of 64bit result -> A */
 			PPC_MULHWU(r_A, r_A, r_scratch1);
 			break;
@@ -669,6 +670,7 @@ void bpf_jit_compile(struct sk_filter *fp)
 		((u64 *)image)[0] = (u64)code_base;
 		((u64 *)image)[1] = local_paca->kernel_toc;
 		fp->bpf_func = (void *)image;
+		fp->jited = 1;
 	}
 out:
 	kfree(addrs);
@@ -685,7 +687,7 @@ static void jit_free_defer(struct work_struct *arg)
  */
 void bpf_jit_free(struct sk_filter *fp)
 {
-	if (fp->bpf_func != sk_run_filter) {
+	if (fp->jited) {
 		struct work_struct *work = (struct work_struct *)fp->bpf_func;
 
 		INIT_WORK(work, jit_free_defer);
@@ -683,6 +683,10 @@ __SYSCALL(__NR_sendmmsg, sys_sendmmsg)
 __SYSCALL(__NR_setns, sys_setns)
 #define __NR_getcpu				309
 __SYSCALL(__NR_getcpu, sys_getcpu)
+#define __NR_io_ring_setup			310
+__SYSCALL(__NR_io_ring_setup, sys_io_ring_setup)
+#define __NR_io_ring_enter			311
+__SYSCALL(__NR_io_ring_enter, sys_io_ring_enter)
 
 #ifndef __NO_STUBS
 #define __ARCH_WANT_OLD_READDIR
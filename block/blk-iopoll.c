@@ -11,6 +11,7 @@
 #include <linux/cpu.h>
 #include <linux/blk-iopoll.h>
 #include <linux/delay.h>
+#include <linux/hrtimer.h>
 
 #include "blk.h"
 
@@ -189,6 +190,160 @@ void blk_iopoll_init(struct blk_iopoll *iop, int weight, blk_iopoll_fn *poll_fn)
 }
 EXPORT_SYMBOL(blk_iopoll_init);
 
+/**
+ * blk_queue_iopoll - let synchronous IO poll for completions on @q
+ * @q:        The request queue
+ * @iop:      The iopoll structure that reaps completions for @q
+ *
+ * Description:
+ *     Drivers call this to tell the block layer that @iop can be used to
+ *     find completions for requests on @q without waiting for an
+ *     interrupt. Polling itself stays off until it is enabled through
+ *     the io_poll queue attribute. @iop may be shared between queues.
+ **/
+void blk_queue_iopoll(struct request_queue *q, struct blk_iopoll *iop)
+{
+	q->iopoll = iop;
+}
+EXPORT_SYMBOL(blk_queue_iopoll);
+
+/*
+ * Spin budget when we have no latency estimate for the queue yet, and
+ * the upper bound on what we will ever spin for.
+ */
+#define BLK_POLL_DEFAULT_NSEC	(50 * NSEC_PER_USEC)
+#define BLK_POLL_MAX_NSEC	(1000 * NSEC_PER_USEC)
+
+/*
+ * Run the poll handler once from process context. We only get to do that
+ * if we can grab IOPOLL_F_SCHED, otherwise the softirq or another poller
+ * owns @iop and will reap the completions for us.
+ */
+static int blk_iopoll_poll_once(struct blk_iopoll *iop)
+{
+	int work;
+
+	if (blk_iopoll_sched_prep(iop))
+		return 0;
+
+	/*
+	 * We are not on the per-cpu list, but the handler will
+	 * blk_iopoll_complete() us if it runs out of work.
+	 */
+	INIT_LIST_HEAD(&iop->list);
+
+	work = iop->poll(iop, iop->weight);
+
+	/*
+	 * Used the whole weight, so the handler still owns @iop and expects
+	 * to be called again. Leave the rest to the softirq.
+	 */
+	if (work >= iop->weight)
+		blk_iopoll_sched(iop);
+
+	return work;
+}
+
+static u64 blk_poll_sleep_nsec(struct request_queue *q)
+{
+	if (q->poll_nsec > 0)
+		return q->poll_nsec;
+
+	/*
+	 * Hybrid mode: sleep for half of the mean completion time, which
+	 * tends to wake us just before the IO is done.
+	 */
+	if (!q->poll_nsec)
+		return q->poll_stat.mean_nsec / 2;
+
+	return 0;
+}
+
+static u64 blk_poll_spin_nsec(struct request_queue *q)
+{
+	u64 mean = q->poll_stat.mean_nsec;
+
+	if (!mean)
+		return BLK_POLL_DEFAULT_NSEC;
+
+	return min_t(u64, 2 * mean, BLK_POLL_MAX_NSEC);
+}
+
+/**
+ * blk_poll - reap completions for a synchronous waiter
+ * @q:        The request queue the IO was issued to
+ * @issued:   When the IO being waited for was issued
+ *
+ * Description:
+ *     Called by a task that would otherwise sleep waiting for IO on @q.
+ *     Depending on io_poll_delay we may first sleep for part of the
+ *     expected completion time, then spin on the driver's poll handler
+ *     until it reaps something or the spin budget, which is derived from
+ *     the observed completion times, runs out.
+ *
+ *     Returns true if completions were found, in which case the caller
+ *     should recheck its wait condition. On false it should go to sleep
+ *     and wait for the interrupt as usual.
+ **/
+bool blk_poll(struct request_queue *q, ktime_t issued)
+{
+	struct blk_iopoll *iop = q->iopoll;
+	u64 sleep_nsec, elapsed;
+	ktime_t deadline;
+
+	if (!iop || !blk_queue_poll(q))
+		return false;
+
+	q->poll_stat.invoked++;
+
+	sleep_nsec = blk_poll_sleep_nsec(q);
+	elapsed = ktime_to_ns(ktime_sub(ktime_get(), issued));
+	if (sleep_nsec > elapsed) {
+		ktime_t expires = ktime_add_ns(issued, sleep_nsec);
+
+		q->poll_stat.hybrid_sleep++;
+		set_current_state(TASK_UNINTERRUPTIBLE);
+		schedule_hrtimeout(&expires, HRTIMER_MODE_ABS);
+	}
+
+	deadline = ktime_add_ns(issued, sleep_nsec + blk_poll_spin_nsec(q));
+
+	while (!need_resched()) {
+		if (blk_iopoll_poll_once(iop) > 0) {
+			q->poll_stat.success++;
+			return true;
+		}
+		if (ktime_to_ns(ktime_sub(ktime_get(), deadline)) >= 0)
+			break;
+		cpu_relax();
+	}
+
+	q->poll_stat.timeout++;
+	return false;
+}
+EXPORT_SYMBOL_GPL(blk_poll);
+
+/**
+ * blk_poll_account - feed a completion time into the poll statistics
+ * @q:        The request queue the IO was issued to
+ * @issued:   When the IO was issued
+ *
+ * Description:
+ *     Keeps a moving average of the completion time on @q, which sizes
+ *     both the hybrid sleep and the spin budget of blk_poll().
+ **/
+void blk_poll_account(struct request_queue *q, ktime_t issued)
+{
+	u64 nsec = ktime_to_ns(ktime_sub(ktime_get(), issued));
+	u64 mean = q->poll_stat.mean_nsec;
+
+	if (!mean)
+		q->poll_stat.mean_nsec = nsec;
+	else
+		q->poll_stat.mean_nsec = mean - (mean >> 3) + (nsec >> 3);
+}
+EXPORT_SYMBOL_GPL(blk_poll_account);
+
 static int __cpuinit blk_iopoll_cpu_notify(struct notifier_block *self,
 					  unsigned long action, void *hcpu)
 {
@@ -0,0 +1,78 @@
+/*
+ * Tag allocation for the multi-queue block layer
+ *
+ * Every hardware queue owns one of these maps. Tags double as the index
+ * of the preallocated request in hctx->rqs[], so the allocator never
+ * hands out a tag that is >= nr_tags. Allocation is done by percpu_ida,
+ * so submitters on different CPUs don't fight over a shared bitmap.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/percpu_ida.h>
+
+#include "blk-mq.h"
+
+struct blk_mq_tags {
+	unsigned int nr_tags;
+	struct percpu_ida free_tags;
+};
+
+/**
+ * blk_mq_get_tag - allocate a tag from a hardware queue tag map
+ * @tags:	tag map
+ * @gfp:	if __GFP_WAIT is set, sleep until a tag becomes free
+ *
+ * Returns BLK_MQ_TAG_FAIL if no tag is available and the caller
+ * cannot sleep.
+ */
+unsigned int blk_mq_get_tag(struct blk_mq_tags *tags, gfp_t gfp)
+{
+	int tag;
+
+	tag = percpu_ida_alloc(&tags->free_tags, gfp);
+	if (tag < 0)
+		return BLK_MQ_TAG_FAIL;
+	return tag;
+}
+
+void blk_mq_put_tag(struct blk_mq_tags *tags, unsigned int tag)
+{
+	BUG_ON(tag >= tags->nr_tags);
+
+	percpu_ida_free(&tags->free_tags, tag);
+}
+
+bool blk_mq_has_free_tags(struct blk_mq_tags *tags)
+{
+	return percpu_ida_free_tags(&tags->free_tags) != 0;
+}
+
+ssize_t blk_mq_tag_sysfs_show(struct blk_mq_tags *tags, char *page)
+{
+	return sprintf(page, "nr_tags=%u, free=%u\n", tags->nr_tags,
+		       percpu_ida_free_tags(&tags->free_tags));
+}
+
+struct blk_mq_tags *blk_mq_init_tags(unsigned int nr_tags, int node)
+{
+	struct blk_mq_tags *tags;
+
+	tags = kzalloc_node(sizeof(*tags), GFP_KERNEL, node);
+	if (!tags)
+		return NULL;
+
+	tags->nr_tags = nr_tags;
+	if (percpu_ida_init(&tags->free_tags, nr_tags)) {
+		kfree(tags);
+		return NULL;
+	}
+	return tags;
+}
+
+void blk_mq_free_tags(struct blk_mq_tags *tags)
+{
+	WARN_ON(percpu_ida_free_tags(&tags->free_tags) != tags->nr_tags);
+	percpu_ida_destroy(&tags->free_tags);
+	kfree(tags);
+}
@@ -0,0 +1,933 @@
+/*
+ * Multi-queue block layer
+ *
+ * Bios are turned into requests on a per-cpu software queue and then
+ * handed to the driver through one of its hardware dispatch queues.
+ * Requests and tags are preallocated per hardware queue, so the
+ * submission path never takes q->queue_lock and there is no IO
+ * scheduler in the way.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/bio.h>
+#include <linux/blkdev.h>
+#include <linux/blk-mq.h>
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/workqueue.h>
+#include <linux/smp.h>
+#include <linux/cpu.h>
+#include <linux/completion.h>
+
+#include <trace/events/block.h>
+
+#include "blk.h"
+#include "blk-mq.h"
+
+/*
+ * How many queued requests of a software queue we look at when trying
+ * to merge a new bio.
+ */
+#define BLK_MQ_MERGE_DEPTH	8
+
+struct blk_mq_hw_ctx *blk_mq_map_queue(struct request_queue *q, const int cpu)
+{
+	return q->queue_hw_ctx[q->mq_map[cpu]];
+}
+EXPORT_SYMBOL(blk_mq_map_queue);
+
+static inline struct blk_mq_hw_ctx *rq_to_hctx(struct request *rq)
+{
+	struct request_queue *q = rq->q;
+
+	return q->mq_ops->map_queue(q, rq->mq_ctx->cpu);
+}
+
+/*
+ * Check if any of the ctx's have pending work in this hardware queue
+ */
+static bool blk_mq_hctx_has_pending(struct blk_mq_hw_ctx *hctx)
+{
+	unsigned int i;
+
+	for (i = 0; i < BITS_TO_LONGS(hctx->nr_ctx); i++)
+		if (hctx->ctx_map[i])
+			return true;
+
+	return !list_empty_careful(&hctx->dispatch);
+}
+
+/*
+ * Mark this ctx as having pending work in this hardware queue
+ */
+static void blk_mq_hctx_mark_pending(struct blk_mq_hw_ctx *hctx,
+				     struct blk_mq_ctx *ctx)
+{
+	if (!test_bit(ctx->index_hw, hctx->ctx_map))
+		set_bit(ctx->index_hw, hctx->ctx_map);
+}
+
+static void blk_mq_rq_ctx_init(struct request_queue *q, struct blk_mq_ctx *ctx,
+			       struct request *rq, unsigned int tag,
+			       unsigned int rw_flags)
+{
+	blk_rq_init(q, rq);
+
+	rq->mq_ctx = ctx;
+	rq->tag = tag;
+	rq->cmd_flags = rw_flags;
+	if (blk_queue_io_stat(q))
+		rq->cmd_flags |= REQ_IO_STAT;
+}
+
+static struct request *__blk_mq_alloc_request(struct request_queue *q,
+					      unsigned int rw_flags, gfp_t gfp)
+{
+	struct blk_mq_hw_ctx *hctx;
+	struct blk_mq_ctx *ctx;
+	struct request *rq;
+	unsigned int tag;
+	int cpu;
+
+	/*
+	 * We may sleep for a tag and wake up elsewhere. That is fine, the
+	 * request stays with the software queue it was allocated from and
+	 * that queue maps to the hardware queue that owns the tag.
+	 */
+	cpu = raw_smp_processor_id();
+	ctx = per_cpu_ptr(q->queue_ctx, cpu);
+	hctx = q->mq_ops->map_queue(q, cpu);
+
+	tag = blk_mq_get_tag(hctx->tags, gfp);
+	if (tag == BLK_MQ_TAG_FAIL)
+		return NULL;
+
+	rq = hctx->rqs[tag];
+	blk_mq_rq_ctx_init(q, ctx, rq, tag, rw_flags);
+	return rq;
+}
+
+/**
+ * blk_mq_alloc_request - allocate a request from a multi-queue device
+ * @q:		request queue
+ * @rw:		READ or WRITE
+ * @gfp:	allocation flags, with __GFP_WAIT this cannot fail
+ *
+ * Description:
+ *    The request comes out of the tag map of the hardware queue the
+ *    current CPU maps to. Normally reached through blk_get_request().
+ */
+struct request *blk_mq_alloc_request(struct request_queue *q, int rw,
+				     gfp_t gfp)
+{
+	if (unlikely(test_bit(QUEUE_FLAG_DEAD, &q->queue_flags)))
+		return NULL;
+
+	return __blk_mq_alloc_request(q, rw, gfp);
+}
+EXPORT_SYMBOL(blk_mq_alloc_request);
+
+/**
+ * blk_mq_free_request - return a request to its hardware queue
+ * @rq:		request to free
+ */
+void blk_mq_free_request(struct request *rq)
+{
+	struct blk_mq_hw_ctx *hctx = rq_to_hctx(rq);
+	unsigned int tag = rq->tag;
+
+	WARN_ON(rq->bio != NULL);
+
+	blk_clear_rq_complete(rq);
+	rq->cmd_flags = 0;
+	rq->tag = -1;
+	blk_mq_put_tag(hctx->tags, tag);
+}
+EXPORT_SYMBOL(blk_mq_free_request);
+
+/**
+ * blk_mq_end_io - end I/O on a multi-queue request
+ * @rq:		the request to complete
+ * @error:	%0 for success, < %0 for error
+ *
+ * Description:
+ *    Ends all I/O on @rq and frees it, unless the submitter installed
+ *    an ->end_io handler, in which case that handler owns the request.
+ *    May be called from interrupt context.
+ */
+void blk_mq_end_io(struct request *rq, int error)
+{
+	if (blk_update_request(rq, error, blk_rq_bytes(rq)))
+		WARN(1, "blk-mq: request %p not fully completed\n", rq);
+
+	blk_account_io_done(rq);
+
+	if (rq->end_io)
+		rq->end_io(rq, error);
+	else
+		blk_mq_free_request(rq);
+}
+EXPORT_SYMBOL(blk_mq_end_io);
+
+static void __blk_mq_complete_request(struct request *rq)
+{
+	struct request_queue *q = rq->q;
+
+	if (q->mq_ops->complete)
+		q->mq_ops->complete(rq);
+	else
+		blk_mq_end_io(rq, rq->errors);
+}
+
+#if defined(CONFIG_SMP) && defined(CONFIG_USE_GENERIC_SMP_HELPERS)
+static void __blk_mq_complete_request_remote(void *data)
+{
+	__blk_mq_complete_request(data);
+}
+
+/*
+ * Complete on the CPU that submitted the request if it is not the one we
+ * are running on, so the completion runs cache hot.
+ */
+static bool blk_mq_complete_remote(struct request *rq)
+{
+	struct blk_mq_ctx *ctx = rq->mq_ctx;
+	bool remote = false;
+	int cpu;
+
+	if (!test_bit(QUEUE_FLAG_SAME_COMP, &rq->q->queue_flags))
+		return false;
+
+	cpu = get_cpu();
+	if (cpu != ctx->cpu && cpu_online(ctx->cpu)) {
+		rq->csd.func = __blk_mq_complete_request_remote;
+		rq->csd.info = rq;
+		rq->csd.flags = 0;
+		__smp_call_function_single(ctx->cpu, &rq->csd, 0);
+		remote = true;
+	}
+	put_cpu();
+
+	return remote;
+}
+#else
+static bool blk_mq_complete_remote(struct request *rq)
+{
+	return false;
+}
+#endif
+
+/**
+ * blk_mq_complete_request - end I/O on a request from the driver
+ * @rq:		the request being processed
+ *
+ * Description:
+ *    Like blk_complete_request(), but for multi-queue devices. The
+ *    driver's ->complete() callback (or blk_mq_end_io() if there is
+ *    none) runs on the CPU that submitted @rq.
+ */
+void blk_mq_complete_request(struct request *rq)
+{
+	if (blk_mark_rq_complete(rq))
+		return;
+
+	if (!blk_mq_complete_remote(rq))
+		__blk_mq_complete_request(rq);
+}
+EXPORT_SYMBOL(blk_mq_complete_request);
+
+static void blk_mq_start_request(struct request *rq)
+{
+	struct request_queue *q = rq->q;
+
+	trace_block_rq_issue(q, rq);
+
+	rq->resid_len = blk_rq_bytes(rq);
+	set_io_start_time_ns(rq);
+	rq->mq_ctx->rq_dispatched[rq_is_sync(rq) != 0]++;
+}
+
+static void blk_mq_requeue_request(struct request *rq)
+{
+	trace_block_rq_requeue(rq->q, rq);
+	blk_clear_rq_complete(rq);
+}
+
+/*
+ * Pull all pending requests off the software queues mapped to this hardware
+ * queue and feed them to the driver. Requests the driver can't take right
+ * now are parked on hctx->dispatch and go first on the next run.
+ */
+static void __blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx)
+{
+	struct request_queue *q = hctx->queue;
+	struct blk_mq_ctx *ctx;
+	struct request *rq;
+	LIST_HEAD(rq_list);
+	int bit;
+
+	if (unlikely(test_bit(BLK_MQ_S_STOPPED, &hctx->state)))
+		return;
+
+	hctx->run++;
+
+	if (!list_empty_careful(&hctx->dispatch)) {
+		spin_lock(&hctx->lock);
+		list_splice_init(&hctx->dispatch, &rq_list);
+		spin_unlock(&hctx->lock);
+	}
+
+	for_each_set_bit(bit, hctx->ctx_map, hctx->nr_ctx) {
+		clear_bit(bit, hctx->ctx_map);
+		ctx = hctx->ctxs[bit];
+
+		spin_lock(&ctx->lock);
+		list_splice_tail_init(&ctx->rq_list, &rq_list);
+		spin_unlock(&ctx->lock);
+	}
+
+	while (!list_empty(&rq_list)) {
+		int ret;
+
+		rq = list_first_entry(&rq_list, struct request, queuelist);
+		list_del_init(&rq->queuelist);
+
+		blk_mq_start_request(rq);
+
+		ret = q->mq_ops->queue_rq(hctx, rq);
+		switch (ret) {
+		case BLK_MQ_RQ_QUEUE_OK:
+			continue;
+		case BLK_MQ_RQ_QUEUE_BUSY:
+			list_add(&rq->queuelist, &rq_list);
+			blk_mq_requeue_request(rq);
+			break;
+		default:
+			pr_err("blk-mq: bad return on queue: %d\n", ret);
+			/* fall through */
+		case BLK_MQ_RQ_QUEUE_ERROR:
+			rq->errors = -EIO;
+			blk_mq_end_io(rq, rq->errors);
+			break;
+		}
+
+		if (ret == BLK_MQ_RQ_QUEUE_BUSY)
+			break;
+	}
+
+	if (!list_empty(&rq_list)) {
+		spin_lock(&hctx->lock);
+		list_splice(&rq_list, &hctx->dispatch);
+		spin_unlock(&hctx->lock);
+
+		/*
+		 * The driver may have restarted the queue between stopping
+		 * it and us parking the leftovers. Make sure they get run.
+		 */
+		smp_mb();
+		if (!test_bit(BLK_MQ_S_STOPPED, &hctx->state))
+			blk_mq_run_hw_queue(hctx, true);
+	}
+}
+
+/**
+ * blk_mq_run_hw_queue - dispatch pending requests of a hardware queue
+ * @hctx:	hardware queue
+ * @async:	defer the run to kblockd
+ *
+ * Description:
+ *    Runs from interrupt context are always deferred.
+ */
+void blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx, bool async)
+{
+	if (unlikely(test_bit(BLK_MQ_S_STOPPED, &hctx->state)))
+		return;
+
+	if (!async && !in_interrupt() && !irqs_disabled())
+		__blk_mq_run_hw_queue(hctx);
+	else
+		kblockd_schedule_delayed_work(hctx->queue, &hctx->run_work, 0);
+}
+EXPORT_SYMBOL(blk_mq_run_hw_queue);
+
+void blk_mq_run_queues(struct request_queue *q, bool async)
+{
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		if (!blk_mq_hctx_has_pending(hctx))
+			continue;
+		blk_mq_run_hw_queue(hctx, async);
+	}
+}
+EXPORT_SYMBOL(blk_mq_run_queues);
+
+void blk_mq_stop_hw_queue(struct blk_mq_hw_ctx *hctx)
+{
+	cancel_delayed_work(&hctx->run_work);
+	set_bit(BLK_MQ_S_STOPPED, &hctx->state);
+}
+EXPORT_SYMBOL(blk_mq_stop_hw_queue);
+
+void blk_mq_start_hw_queue(struct blk_mq_hw_ctx *hctx)
+{
+	clear_bit(BLK_MQ_S_STOPPED, &hctx->state);
+	blk_mq_run_hw_queue(hctx, false);
+}
+EXPORT_SYMBOL(blk_mq_start_hw_queue);
+
+void blk_mq_stop_hw_queues(struct request_queue *q)
+{
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	queue_for_each_hw_ctx(q, hctx, i)
+		blk_mq_stop_hw_queue(hctx);
+}
+EXPORT_SYMBOL(blk_mq_stop_hw_queues);
+
+/**
+ * blk_mq_start_stopped_hw_queues - restart stopped hardware queues
+ * @q:		request queue
+ *
+ * Description:
+ *    Meant to be called from the driver's completion handler once it
+ *    can accept more work again. The queues are run from kblockd.
+ */
+void blk_mq_start_stopped_hw_queues(struct request_queue *q)
+{
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		if (!test_bit(BLK_MQ_S_STOPPED, &hctx->state))
+			continue;
+
+		clear_bit(BLK_MQ_S_STOPPED, &hctx->state);
+		blk_mq_run_hw_queue(hctx, true);
+	}
+}
+EXPORT_SYMBOL(blk_mq_start_stopped_hw_queues);
+
+/*
+ * Called from blk_sync_queue(), so no hardware queue runs behind our back
+ * once the queue is being torn down.
+ */
+void blk_mq_sync_queue(struct request_queue *q)
+{
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	if (!q->queue_hw_ctx)
+		return;
+
+	queue_for_each_hw_ctx(q, hctx, i)
+		if (hctx)
+			cancel_delayed_work_sync(&hctx->run_work);
+}
+
+static void blk_mq_work_fn(struct work_struct *work)
+{
+	struct blk_mq_hw_ctx *hctx;
+
+	hctx = container_of(work, struct blk_mq_hw_ctx, run_work.work);
+	__blk_mq_run_hw_queue(hctx);
+}
+
+static void __blk_mq_insert_request(struct blk_mq_hw_ctx *hctx,
+				    struct request *rq, bool at_head)
+{
+	struct blk_mq_ctx *ctx = rq->mq_ctx;
+
+	trace_block_rq_insert(hctx->queue, rq);
+
+	spin_lock(&ctx->lock);
+	if (at_head)
+		list_add(&rq->queuelist, &ctx->rq_list);
+	else
+		list_add_tail(&rq->queuelist, &ctx->rq_list);
+	blk_mq_hctx_mark_pending(hctx, ctx);
+	spin_unlock(&ctx->lock);
+
+	hctx->queued++;
+}
+
+/**
+ * blk_mq_insert_request - queue a prepared request on a multi-queue device
+ * @rq:		request to insert
+ * @at_head:	insert at the head of the software queue
+ * @run_queue:	run the hardware queue afterwards
+ * @async:	run the hardware queue from kblockd
+ *
+ * Description:
+ *    The multi-queue counterpart of __elv_add_request(), used by
+ *    blk_execute_rq_nowait() for passthrough and driver private requests.
+ */
+void blk_mq_insert_request(struct request *rq, bool at_head, bool run_queue,
+			   bool async)
+{
+	struct blk_mq_hw_ctx *hctx = rq_to_hctx(rq);
+
+	__blk_mq_insert_request(hctx, rq, at_head);
+
+	if (run_queue)
+		blk_mq_run_hw_queue(hctx, async);
+}
+EXPORT_SYMBOL(blk_mq_insert_request);
+
+static bool blk_mq_rq_merge_ok(struct request *rq, struct bio *bio)
+{
+	if (!rq_mergeable(rq) || rq->end_io)
+		return false;
+
+	return elv_rq_merge_ok(rq, bio);
+}
+
+/*
+ * Try to merge @bio into one of the last few requests still sitting on
+ * the software queue. The ctx lock keeps them from being dispatched
+ * while we work on them.
+ */
+static bool blk_mq_attempt_merge(struct request_queue *q,
+				 struct blk_mq_ctx *ctx, struct bio *bio)
+{
+	struct request *rq;
+	int checked = BLK_MQ_MERGE_DEPTH;
+
+	list_for_each_entry_reverse(rq, &ctx->rq_list, queuelist) {
+		if (!checked--)
+			break;
+
+		if (!blk_mq_rq_merge_ok(rq, bio))
+			continue;
+
+		if (blk_rq_pos(rq) + blk_rq_sectors(rq) == bio->bi_sector) {
+			if (bio_attempt_back_merge(q, rq, bio)) {
+				ctx->rq_merged++;
+				return true;
+			}
+			break;
+		} else if (blk_rq_pos(rq) - bio_sectors(bio) == bio->bi_sector) {
+			if (bio_attempt_front_merge(q, rq, bio)) {
+				ctx->rq_merged++;
+				return true;
+			}
+			break;
+		}
+	}
+
+	return false;
+}
+
+static void blk_mq_bio_to_request(struct request *rq, struct bio *bio)
+{
+	init_request_from_bio(rq, bio);
+
+	if (bio_flagged(bio, BIO_CPU_AFFINE))
+		rq->cpu = raw_smp_processor_id();
+
+	drive_stat_acct(rq, 1);
+}
+
+/*
+ * Issue @bio (or an empty flush if @bio is NULL) and wait for it. Used to
+ * sequence data carrying flush and FUA bios, see blk_mq_flush_bio().
+ */
+static int blk_mq_issue_sync(struct request_queue *q, struct bio *bio)
+{
+	struct gendisk *disk = NULL;
+	struct request *rq;
+	int err;
+
+	rq = __blk_mq_alloc_request(q, WRITE_SYNC, GFP_NOIO);
+	if (bio) {
+		blk_mq_bio_to_request(rq, bio);
+		disk = rq->rq_disk;
+	} else {
+		rq->cmd_type = REQ_TYPE_FS;
+		rq->cmd_flags |= REQ_FLUSH;
+	}
+
+	err = blk_execute_rq(q, disk, rq, 0);
+	blk_put_request(rq);
+	return err;
+}
+
+struct blk_mq_sync_bio {
+	struct completion	done;
+	int			error;
+};
+
+static void blk_mq_sync_bio_endio(struct bio *bio, int error)
+{
+	struct blk_mq_sync_bio *sb = bio->bi_private;
+
+	sb->error = error;
+	complete(&sb->done);
+}
+
+/*
+ * Multi-queue devices have no flush state machine. A flush or FUA bio
+ * that carries data is rare, so sequence it synchronously here:
+ * preflush, write, and a postflush if the device can't do FUA itself.
+ */
+static void blk_mq_flush_bio(struct request_queue *q, struct bio *bio)
+{
+	const bool native_fua = q->flush_flags & REQ_FUA;
+	const unsigned long rw = bio->bi_rw;
+	bio_end_io_t *end_io = bio->bi_end_io;
+	void *private = bio->bi_private;
+	struct blk_mq_sync_bio sb;
+	int err = 0;
+
+	if (rw & REQ_FLUSH)
+		err = blk_mq_issue_sync(q, NULL);
+	if (err)
+		goto out;
+
+	bio->bi_rw &= ~(REQ_FLUSH | REQ_FUA);
+	if ((rw & REQ_FUA) && native_fua)
+		bio->bi_rw |= REQ_FUA;
+
+	/*
+	 * Hold on to the bio until the postflush is done: route its
+	 * completion to us and hand it back afterwards.
+	 */
+	init_completion(&sb.done);
+	bio->bi_end_io = blk_mq_sync_bio_endio;
+	bio->bi_private = &sb;
+
+	blk_mq_issue_sync(q, bio);
+	wait_for_completion(&sb.done);
+
+	bio->bi_end_io = end_io;
+	bio->bi_private = private;
+	err = sb.error;
+
+	if (!err && (rw & REQ_FUA) && !native_fua)
+		err = blk_mq_issue_sync(q, NULL);
+out:
+	if (err)
+		clear_bit(BIO_UPTODATE, &bio->bi_flags);
+	else
+		set_bit(BIO_UPTODATE, &bio->bi_flags);
+	bio_endio(bio, err);
+}
+
+static int blk_mq_make_request(struct request_queue *q, struct bio *bio)
+{
+	struct blk_mq_hw_ctx *hctx;
+	struct blk_mq_ctx *ctx;
+	const int is_sync = rw_is_sync(bio->bi_rw);
+	const int is_flush_fua = bio->bi_rw & (REQ_FLUSH | REQ_FUA);
+	unsigned int rw_flags;
+	struct request *rq;
+	int cpu;
+
+	blk_queue_bounce(q, &bio);
+
+	if (unlikely(is_flush_fua) && bio_has_data(bio)) {
+		blk_mq_flush_bio(q, bio);
+		return 0;
+	}
+
+	if ((q->mq_flags & BLK_MQ_F_SHOULD_MERGE) && !blk_queue_nomerges(q) &&
+	    !is_flush_fua) {
+		bool merged;
+
+		cpu = get_cpu();
+		ctx = per_cpu_ptr(q->queue_ctx, cpu);
+		spin_lock(&ctx->lock);
+		merged = blk_mq_attempt_merge(q, ctx, bio);
+		spin_unlock(&ctx->lock);
+		put_cpu();
+
+		if (merged)
+			return 0;
+	}
+
+	rw_flags = bio_data_dir(bio);
+	if (is_sync)
+		rw_flags |= REQ_SYNC;
+
+	trace_block_getrq(q, bio, rw_flags & 1);
+
+	/*
+	 * Grab a free request. This might sleep but can not fail.
+	 */
+	rq = __blk_mq_alloc_request(q, rw_flags, GFP_NOIO);
+
+	blk_mq_bio_to_request(rq, bio);
+
+	hctx = rq_to_hctx(rq);
+	__blk_mq_insert_request(hctx, rq, false);
+
+	/*
+	 * Async IO, including what's collected under a plug, is dispatched
+	 * from kblockd so that several requests go down in one run.
+	 */
+	blk_mq_run_hw_queue(hctx, !is_sync || is_flush_fua ||
+			    current->plug != NULL);
+	return 0;
+}
+
+/*
+ * Spread the possible CPUs evenly over the hardware queues, keeping CPUs
+ * with adjacent numbers (usually siblings and cores of one package) on
+ * the same queue.
+ */
+static void blk_mq_map_swqueues(unsigned int *map, unsigned int nr_queues)
+{
+	unsigned int i = 0, nr_cpus = num_possible_cpus();
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		map[cpu] = (i * nr_queues) / nr_cpus;
+		i++;
+	}
+}
+
+static void blk_mq_free_rq_map(struct blk_mq_hw_ctx *hctx)
+{
+	unsigned int i;
+
+	if (hctx->rqs) {
+		for (i = 0; i < hctx->queue_depth; i++)
+			kfree(hctx->rqs[i]);
+		kfree(hctx->rqs);
+	}
+
+	if (hctx->tags)
+		blk_mq_free_tags(hctx->tags);
+}
+
+static int blk_mq_init_rq_map(struct blk_mq_hw_ctx *hctx,
+			      struct blk_mq_reg *reg)
+{
+	const size_t rq_size = sizeof(struct request) + reg->cmd_size;
+	unsigned int i;
+
+	hctx->rqs = kzalloc_node(hctx->queue_depth * sizeof(struct request *),
+				 GFP_KERNEL, hctx->numa_node);
+	if (!hctx->rqs)
+		return -ENOMEM;
+
+	for (i = 0; i < hctx->queue_depth; i++) {
+		hctx->rqs[i] = kzalloc_node(rq_size, GFP_KERNEL,
+					    hctx->numa_node);
+		if (!hctx->rqs[i])
+			goto fail;
+	}
+
+	hctx->tags = blk_mq_init_tags(hctx->queue_depth, hctx->numa_node);
+	if (!hctx->tags)
+		goto fail;
+
+	return 0;
+fail:
+	blk_mq_free_rq_map(hctx);
+	return -ENOMEM;
+}
+
+static void blk_mq_free_hw_ctx(struct blk_mq_hw_ctx *hctx)
+{
+	blk_mq_free_rq_map(hctx);
+	kfree(hctx->ctx_map);
+	kfree(hctx->ctxs);
+	free_cpumask_var(hctx->cpumask);
+	kfree(hctx);
+}
+
+static void blk_mq_free_hw_queues(struct request_queue *q)
+{
+	struct blk_mq_hw_ctx *hctx;
+	unsigned int i;
+
+	for (i = 0; i < q->nr_hw_queues; i++) {
+		hctx = q->queue_hw_ctx[i];
+		if (!hctx)
+			continue;
+
+		if (q->mq_ops->exit_hctx)
+			q->mq_ops->exit_hctx(hctx, i);
+		blk_mq_free_hw_ctx(hctx);
+	}
+}
+
+static int blk_mq_init_hw_queues(struct request_queue *q,
+				 struct blk_mq_reg *reg, void *driver_data)
+{
+	struct blk_mq_hw_ctx *hctx;
+	unsigned int i, j;
+	int ret = -ENOMEM;
+
+	for (i = 0; i < reg->nr_hw_queues; i++) {
+		hctx = kzalloc_node(sizeof(*hctx), GFP_KERNEL, reg->numa_node);
+		if (!hctx)
+			goto err;
+		q->queue_hw_ctx[i] = hctx;
+
+		/*
+		 * Set up everything the teardown path looks at, the work
+		 * item in particular, before anything can fail.
+		 */
+		spin_lock_init(&hctx->lock);
+		INIT_LIST_HEAD(&hctx->dispatch);
+		INIT_DELAYED_WORK(&hctx->run_work, blk_mq_work_fn);
+		hctx->queue = q;
+		hctx->queue_num = i;
+		hctx->numa_node = reg->numa_node;
+		hctx->queue_depth = reg->queue_depth;
+		hctx->flags = reg->flags;
+		hctx->driver_data = driver_data;
+
+		if (!zalloc_cpumask_var(&hctx->cpumask, GFP_KERNEL))
+			goto err;
+
+		if (blk_mq_init_rq_map(hctx, reg))
+			goto err;
+
+		/*
+		 * Allocate space for all possible cpus to avoid allocation in
+		 * runtime
+		 */
+		hctx->ctxs = kmalloc_node(nr_cpu_ids * sizeof(void *),
+					  GFP_KERNEL, reg->numa_node);
+		if (!hctx->ctxs)
+			goto err;
+
+		hctx->ctx_map = kzalloc_node(BITS_TO_LONGS(nr_cpu_ids) *
+					     sizeof(unsigned long), GFP_KERNEL,
+					     reg->numa_node);
+		if (!hctx->ctx_map)
+			goto err;
+
+		if (reg->ops->init_hctx &&
+		    reg->ops->init_hctx(hctx, driver_data, i)) {
+			ret = -EIO;
+			goto err;
+		}
+	}
+
+	return 0;
+
+err:
+	/*
+	 * Only the hctxs before i made it through ->init_hctx(), so undo
+	 * the setup here rather than leave it to blk_mq_free_hw_queues().
+	 */
+	for (j = 0; j <= i; j++) {
+		hctx = q->queue_hw_ctx[j];
+		if (!hctx)
+			continue;
+
+		if (j < i && reg->ops->exit_hctx)
+			reg->ops->exit_hctx(hctx, j);
+		blk_mq_free_hw_ctx(hctx);
+		q->queue_hw_ctx[j] = NULL;
+	}
+	return ret;
+}
+
+static void blk_mq_init_cpu_queues(struct request_queue *q)
+{
+	struct blk_mq_hw_ctx *hctx;
+	struct blk_mq_ctx *ctx;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		ctx = per_cpu_ptr(q->queue_ctx, cpu);
+
+		memset(ctx, 0, sizeof(*ctx));
+		spin_lock_init(&ctx->lock);
+		INIT_LIST_HEAD(&ctx->rq_list);
+		ctx->cpu = cpu;
+		ctx->queue = q;
+
+		hctx = q->mq_ops->map_queue(q, cpu);
+		cpumask_set_cpu(cpu, hctx->cpumask);
+		ctx->index_hw = hctx->nr_ctx;
+		hctx->ctxs[hctx->nr_ctx++] = ctx;
+	}
+}
+
+/**
+ * blk_mq_init_queue - set up a multi-queue request queue
+ * @reg:	 hardware queue layout and driver operations
+ * @driver_data: handed to ->init_hctx() and stored in every hctx
+ *
+ * Description:
+ *    Returns an initialized queue that submits straight to the driver's
+ *    ->queue_rq() without an IO scheduler or q->queue_lock. Tear it down
+ *    with blk_cleanup_queue() as with any other queue.
+ */
+struct request_queue *blk_mq_init_queue(struct blk_mq_reg *reg,
+					void *driver_data)
+{
+	struct request_queue *q;
+
+	if (!reg->nr_hw_queues || !reg->ops->queue_rq ||
+	    !reg->ops->map_queue || !reg->queue_depth)
+		return ERR_PTR(-EINVAL);
+
+	if (reg->queue_depth > BLK_MQ_MAX_DEPTH) {
+		pr_info("blk-mq: reduced tag depth to %u\n", BLK_MQ_MAX_DEPTH);
+		reg->queue_depth = BLK_MQ_MAX_DEPTH;
+	}
+	if (reg->nr_hw_queues > nr_cpu_ids)
+		reg->nr_hw_queues = nr_cpu_ids;
+
+	q = blk_alloc_queue_node(GFP_KERNEL, reg->numa_node);
+	if (!q)
+		return ERR_PTR(-ENOMEM);
+
+	q->node = reg->numa_node;
+	q->mq_ops = reg->ops;
+	q->mq_flags = reg->flags;
+	q->nr_hw_queues = reg->nr_hw_queues;
+	q->queue_flags |= QUEUE_FLAG_MQ_DEFAULT;
+
+	q->queue_ctx = alloc_percpu(struct blk_mq_ctx);
+	q->mq_map = kzalloc_node(nr_cpu_ids * sizeof(unsigned int),
+				 GFP_KERNEL, reg->numa_node);
+	q->queue_hw_ctx = kzalloc_node(reg->nr_hw_queues * sizeof(void *),
+				       GFP_KERNEL, reg->numa_node);
+	if (!q->queue_ctx || !q->mq_map || !q->queue_hw_ctx)
+		goto err;
+
+	blk_mq_map_swqueues(q->mq_map, reg->nr_hw_queues);
+
+	if (blk_mq_init_hw_queues(q, reg, driver_data))
+		goto err;
+
+	blk_mq_init_cpu_queues(q);
+
+	blk_queue_make_request(q, blk_mq_make_request);
+	q->nr_requests = reg->queue_depth;
+	blk_queue_congestion_threshold(q);
+	q->sg_reserved_size = INT_MAX;
+
+	return q;
+err:
+	blk_cleanup_queue(q);
+	return ERR_PTR(-ENOMEM);
+}
+EXPORT_SYMBOL(blk_mq_init_queue);
+
+/*
+ * Called on the final put of the queue, from blk_release_queue()
+ */
+void blk_mq_free_queue(struct request_queue *q)
+{
+	if (q->queue_hw_ctx) {
+		blk_mq_free_hw_queues(q);
+		kfree(q->queue_hw_ctx);
+	}
+	kfree(q->mq_map);
+	free_percpu(q->queue_ctx);
+
+	q->queue_hw_ctx = NULL;
+	q->mq_map = NULL;
+	q->queue_ctx = NULL;
+}
@@ -0,0 +1,16 @@
+#ifndef INT_BLK_MQ_H
+#define INT_BLK_MQ_H
+
+/*
+ * Tag allocation, see blk-mq-tag.c
+ */
+struct blk_mq_tags *blk_mq_init_tags(unsigned int nr_tags, int node);
+void blk_mq_free_tags(struct blk_mq_tags *tags);
+unsigned int blk_mq_get_tag(struct blk_mq_tags *tags, gfp_t gfp);
+void blk_mq_put_tag(struct blk_mq_tags *tags, unsigned int tag);
+bool blk_mq_has_free_tags(struct blk_mq_tags *tags);
+ssize_t blk_mq_tag_sysfs_show(struct blk_mq_tags *tags, char *page);
+
+#define BLK_MQ_TAG_FAIL		((unsigned int) -1)
+
+#endif
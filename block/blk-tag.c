@@ -1,5 +1,10 @@
 /*
  * Functions related to tagged command queuing
+ *
+ * Free tags are kept in a percpu_ida pool sized for real_max_depth, so
+ * starting and ending a tag normally stays on the local CPU. Tags at or
+ * above the current max_depth are "parked": taken out of the pool and
+ * recorded in ->parked until the depth is raised again.
  */
 #include <linux/kernel.h>
 #include <linux/module.h>
@@ -39,14 +44,17 @@ static int __blk_free_tags(struct blk_queue_tag *bqt)
 
 	retval = atomic_dec_and_test(&bqt->refcnt);
 	if (retval) {
-		BUG_ON(find_first_bit(bqt->tag_map, bqt->max_depth) <
-							bqt->max_depth);
+		WARN_ON(percpu_ida_free_tags(&bqt->free_tags) +
+			bitmap_weight(bqt->parked, bqt->real_max_depth) <
+							bqt->real_max_depth);
+
+		percpu_ida_destroy(&bqt->free_tags);
 
 		kfree(bqt->tag_index);
 		bqt->tag_index = NULL;
 
-		kfree(bqt->tag_map);
-		bqt->tag_map = NULL;
+		kfree(bqt->parked);
+		bqt->parked = NULL;
 
 		kfree(bqt);
 	}
@@ -104,35 +112,59 @@ void blk_queue_free_tags(struct request_queue *q)
 }
 EXPORT_SYMBOL(blk_queue_free_tags);
 
+/*
+ * The percpu pool cannot be reallocated under the queue lock, which is
+ * where blk_queue_resize_tags() gets called. So for a queue-owned map we
+ * size the pool for the largest depth we would ever accept, which is
+ * twice the number of requests, and park everything above @depth.
+ */
 static int
 init_tag_map(struct request_queue *q, struct blk_queue_tag *tags, int depth)
 {
 	struct request **tag_index;
-	unsigned long *tag_map;
-	int nr_ulongs;
+	unsigned long *parked;
+	int real_depth, nr_ulongs, i;
 
 	if (q && depth > q->nr_requests * 2) {
 		depth = q->nr_requests * 2;
 		printk(KERN_ERR "%s: adjusted depth to %d\n",
 		       __func__, depth);
 	}
+	real_depth = q ? q->nr_requests * 2 : depth;
 
-	tag_index = kzalloc(depth * sizeof(struct request *), GFP_ATOMIC);
+	tag_index = kzalloc(real_depth * sizeof(struct request *), GFP_KERNEL);
 	if (!tag_index)
-		goto fail;
+		return -ENOMEM;
 
-	nr_ulongs = ALIGN(depth, BITS_PER_LONG) / BITS_PER_LONG;
-	tag_map = kzalloc(nr_ulongs * sizeof(unsigned long), GFP_ATOMIC);
-	if (!tag_map)
-		goto fail;
+	nr_ulongs = ALIGN(real_depth, BITS_PER_LONG) / BITS_PER_LONG;
+	parked = kzalloc(nr_ulongs * sizeof(unsigned long), GFP_KERNEL);
+	if (!parked)
+		goto fail_index;
+
+	if (percpu_ida_init(&tags->free_tags, real_depth))
+		goto fail_parked;
 
-	tags->real_max_depth = depth;
+	/*
+	 * Drain the fresh pool and give back only the tags below @depth.
+	 */
+	for (i = 0; i < real_depth; i++)
+		BUG_ON(percpu_ida_alloc(&tags->free_tags, 0) < 0);
+	for (i = 0; i < real_depth; i++) {
+		if (i < depth)
+			percpu_ida_free(&tags->free_tags, i);
+		else
+			__set_bit(i, parked);
+	}
+
+	tags->real_max_depth = real_depth;
 	tags->max_depth = depth;
 	tags->tag_index = tag_index;
-	tags->tag_map = tag_map;
+	tags->parked = parked;
 
 	return 0;
-fail:
+fail_parked:
+	kfree(parked);
+fail_index:
 	kfree(tag_index);
 	return -ENOMEM;
 }
@@ -142,7 +174,7 @@ static struct blk_queue_tag *__blk_queue_init_tags(struct request_queue *q,
 {
 	struct blk_queue_tag *tags;
 
-	tags = kmalloc(sizeof(struct blk_queue_tag), GFP_ATOMIC);
+	tags = kmalloc(sizeof(struct blk_queue_tag), GFP_KERNEL);
 	if (!tags)
 		goto fail;
 
@@ -220,47 +252,40 @@ EXPORT_SYMBOL(blk_queue_init_tags);
 int blk_queue_resize_tags(struct request_queue *q, int new_depth)
 {
 	struct blk_queue_tag *bqt = q->queue_tags;
-	struct request **tag_index;
-	unsigned long *tag_map;
-	int max_depth, nr_ulongs;
+	int tag;
 
 	if (!bqt)
 		return -ENXIO;
 
 	/*
-	 * if we already have large enough real_max_depth.  just
-	 * adjust max_depth.  *NOTE* as requests with tag value
-	 * between new_depth and real_max_depth can be in-flight, tag
-	 * map can not be shrunk blindly here.
+	 * The pool was sized for the largest depth we accept when the
+	 * map was created, see init_tag_map().
 	 */
-	if (new_depth <= bqt->real_max_depth) {
-		bqt->max_depth = new_depth;
-		return 0;
-	}
+	if (new_depth > bqt->real_max_depth) {
+		/*
+		 * Currently cannot replace a shared tag map with a new
+		 * one, so error out if this is the case
+		 */
+		if (atomic_read(&bqt->refcnt) != 1)
+			return -EBUSY;
 
-	/*
-	 * Currently cannot replace a shared tag map with a new
-	 * one, so error out if this is the case
-	 */
-	if (atomic_read(&bqt->refcnt) != 1)
-		return -EBUSY;
+		new_depth = bqt->real_max_depth;
+		printk(KERN_ERR "%s: adjusted depth to %d\n",
+		       __func__, new_depth);
+	}
 
 	/*
-	 * save the old state info, so we can copy it back
+	 * *NOTE* as requests with tag value between new_depth and
+	 * real_max_depth can be in-flight, we cannot pull those out of
+	 * the pool here. They get parked as they are freed or allocated.
 	 */
-	tag_index = bqt->tag_index;
-	tag_map = bqt->tag_map;
-	max_depth = bqt->real_max_depth;
-
-	if (init_tag_map(q, bqt, new_depth))
-		return -ENOMEM;
+	bqt->max_depth = new_depth;
 
-	memcpy(bqt->tag_index, tag_index, max_depth * sizeof(struct request *));
-	nr_ulongs = ALIGN(max_depth, BITS_PER_LONG) / BITS_PER_LONG;
-	memcpy(bqt->tag_map, tag_map, nr_ulongs * sizeof(unsigned long));
+	for_each_set_bit(tag, bqt->parked, new_depth) {
+		if (test_and_clear_bit(tag, bqt->parked))
+			percpu_ida_free(&bqt->free_tags, tag);
+	}
 
-	kfree(tag_index);
-	kfree(tag_map);
 	return 0;
 }
 EXPORT_SYMBOL(blk_queue_resize_tags);
@@ -297,22 +322,22 @@ void blk_queue_end_tag(struct request_queue *q, struct request *rq)
 	rq->cmd_flags &= ~REQ_QUEUED;
 	rq->tag = -1;
 
-	if (unlikely(bqt->tag_index[tag] == NULL))
-		printk(KERN_ERR "%s: tag %d is missing\n",
-		       __func__, tag);
-
-	bqt->tag_index[tag] = NULL;
-
-	if (unlikely(!test_bit(tag, bqt->tag_map))) {
+	if (unlikely(bqt->tag_index[tag] == NULL)) {
 		printk(KERN_ERR "%s: attempt to clear non-busy tag (%d)\n",
 		       __func__, tag);
 		return;
 	}
+
+	bqt->tag_index[tag] = NULL;
+
 	/*
-	 * The tag_map bit acts as a lock for tag_index[bit], so we need
-	 * unlock memory barrier semantics.
+	 * percpu_ida_free() orders the store above against the next
+	 * owner of the tag.
 	 */
-	clear_bit_unlock(tag, bqt->tag_map);
+	if (unlikely(tag >= bqt->max_depth))
+		set_bit(tag, bqt->parked);
+	else
+		percpu_ida_free(&bqt->free_tags, tag);
 }
 EXPORT_SYMBOL(blk_queue_end_tag);
 
@@ -349,9 +374,6 @@ int blk_queue_start_tag(struct request_queue *q, struct request *rq)
 	}
 
 	/*
-	 * Protect against shared tag maps, as we may not have exclusive
-	 * access to the tag map.
-	 *
 	 * We reserve a few tags just for sync IO, since we don't want
 	 * to starve sync IO on behalf of flooding async IO.
 	 */
@@ -360,20 +382,23 @@ int blk_queue_start_tag(struct request_queue *q, struct request *rq)
 		max_depth -= 2;
 		if (!max_depth)
 			max_depth = 1;
-		if (q->in_flight[BLK_RW_ASYNC] > max_depth)
+		if (q->in_flight[BLK_RW_ASYNC] >= max_depth)
 			return 1;
 	}
 
-	do {
-		tag = find_first_zero_bit(bqt->tag_map, max_depth);
-		if (tag >= max_depth)
-			return 1;
-
-	} while (test_and_set_bit_lock(tag, bqt->tag_map));
 	/*
-	 * We need lock ordering semantics given by test_and_set_bit_lock.
-	 * See blk_queue_end_tag for details.
+	 * The pool is shared with other queues for host wide maps, so
+	 * this must not sleep. Tags beyond the current depth get parked
+	 * until blk_queue_resize_tags() raises it again.
 	 */
+	for (;;) {
+		tag = percpu_ida_alloc(&bqt->free_tags, GFP_ATOMIC);
+		if (tag < 0)
+			return 1;
+		if (likely(tag < bqt->max_depth))
+			break;
+		set_bit(tag, bqt->parked);
+	}
 
 	rq->cmd_flags |= REQ_QUEUED;
 	rq->tag = tag;
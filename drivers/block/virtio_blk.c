@@ -2,6 +2,8 @@
 #include <linux/spinlock.h>
 #include <linux/slab.h>
 #include <linux/blkdev.h>
+#include <linux/blk-mq.h>
+#include <linux/blk-iopoll.h>
 #include <linux/hdreg.h>
 #include <linux/virtio.h>
 #include <linux/virtio_blk.h>
@@ -14,6 +16,10 @@
 static int major, index;
 struct workqueue_struct *virtblk_wq;
 
+static unsigned int virtblk_queue_depth = 64;
+module_param_named(queue_depth, virtblk_queue_depth, uint, 0444);
+MODULE_PARM_DESC(queue_depth, "Number of requests in flight per device");
+
 struct virtio_blk
 {
 	spinlock_t lock;
@@ -24,14 +30,12 @@ struct virtio_blk
 	/* The disk structure for the kernel. */
 	struct gendisk *disk;
 
-	/* Request tracking. */
-	struct list_head reqs;
-
-	mempool_t *pool;
-
 	/* Process context for config space updates */
 	struct work_struct config_work;
 
+	/* Lets synchronous IO reap completions without the interrupt */
+	struct blk_iopoll iopoll;
+
 	/* What host tells us, plus 2 for header & tailer. */
 	unsigned int sg_elems;
 
@@ -41,22 +45,24 @@ struct virtio_blk
 
 struct virtblk_req
 {
-	struct list_head list;
 	struct request *req;
 	struct virtio_blk_outhdr out_hdr;
 	struct virtio_scsi_inhdr in_hdr;
 	u8 status;
 };
 
-static void blk_done(struct virtqueue *vq)
+/*
+ * Complete up to @budget finished requests, returns how many were found.
+ * Called with vblk->lock held.
+ */
+static int virtblk_reap(struct virtio_blk *vblk, int budget)
 {
-	struct virtio_blk *vblk = vq->vdev->priv;
 	struct virtblk_req *vbr;
 	unsigned int len;
-	unsigned long flags;
+	int done = 0;
 
-	spin_lock_irqsave(&vblk->lock, flags);
-	while ((vbr = virtqueue_get_buf(vblk->vq, &len)) != NULL) {
+	while (done < budget &&
+	       (vbr = virtqueue_get_buf(vblk->vq, &len)) != NULL) {
 		int error;
 
 		switch (vbr->status) {
@@ -84,25 +90,53 @@ static void blk_done(struct virtqueue *vq)
 			break;
 		}
 
-		__blk_end_request_all(vbr->req, error);
-		list_del(&vbr->list);
-		mempool_free(vbr, vblk->pool);
+		blk_mq_end_io(vbr->req, error);
+		done++;
 	}
+
+	return done;
+}
+
+static void blk_done(struct virtqueue *vq)
+{
+	struct virtio_blk *vblk = vq->vdev->priv;
+	unsigned long flags;
+
+	spin_lock_irqsave(&vblk->lock, flags);
+	virtblk_reap(vblk, INT_MAX);
+	spin_unlock_irqrestore(&vblk->lock, flags);
+
 	/* In case queue is stopped waiting for more buffers. */
-	blk_start_queue(vblk->disk->queue);
+	blk_mq_start_stopped_hw_queues(vblk->disk->queue);
+}
+
+/*
+ * Only called through blk_poll(). The interrupt stays armed, so there is
+ * nothing to re-enable once we run out of work.
+ */
+static int virtblk_iopoll(struct blk_iopoll *iop, int budget)
+{
+	struct virtio_blk *vblk = container_of(iop, struct virtio_blk, iopoll);
+	unsigned long flags;
+	int done;
+
+	spin_lock_irqsave(&vblk->lock, flags);
+	done = virtblk_reap(vblk, budget);
 	spin_unlock_irqrestore(&vblk->lock, flags);
+
+	if (done)
+		blk_mq_start_stopped_hw_queues(vblk->disk->queue);
+	if (done < budget)
+		blk_iopoll_complete(iop);
+
+	return done;
 }
 
 static bool do_req(struct request_queue *q, struct virtio_blk *vblk,
 		   struct request *req)
 {
+	struct virtblk_req *vbr = blk_mq_rq_to_pdu(req);
 	unsigned long num, out = 0, in = 0;
-	struct virtblk_req *vbr;
-
-	vbr = mempool_alloc(vblk->pool, GFP_ATOMIC);
-	if (!vbr)
-		/* When another request finishes we'll try again. */
-		return false;
 
 	vbr->req = req;
 
@@ -165,38 +199,46 @@ static bool do_req(struct request_queue *q, struct virtio_blk *vblk,
 		}
 	}
 
-	if (virtqueue_add_buf(vblk->vq, vblk->sg, out, in, vbr) < 0) {
-		mempool_free(vbr, vblk->pool);
+	if (virtqueue_add_buf(vblk->vq, vblk->sg, out, in, vbr) < 0)
 		return false;
-	}
 
-	list_add_tail(&vbr->list, &vblk->reqs);
 	return true;
 }
 
-static void do_virtblk_request(struct request_queue *q)
+static int virtio_queue_rq(struct blk_mq_hw_ctx *hctx, struct request *req)
 {
-	struct virtio_blk *vblk = q->queuedata;
-	struct request *req;
-	unsigned int issued = 0;
+	struct virtio_blk *vblk = hctx->queue->queuedata;
+	unsigned long flags;
 
-	while ((req = blk_peek_request(q)) != NULL) {
-		BUG_ON(req->nr_phys_segments + 2 > vblk->sg_elems);
+	BUG_ON(req->nr_phys_segments + 2 > vblk->sg_elems);
 
-		/* If this request fails, stop queue and wait for something to
-		   finish to restart it. */
-		if (!do_req(q, vblk, req)) {
-			blk_stop_queue(q);
-			break;
-		}
-		blk_start_request(req);
-		issued++;
+	/* vblk->sg is shared, and ->queue_rq may run on several CPUs. */
+	spin_lock_irqsave(&vblk->lock, flags);
+	if (!do_req(hctx->queue, vblk, req)) {
+		/* The ring is full, wait for something to finish to restart. */
+		blk_mq_stop_hw_queue(hctx);
+		spin_unlock_irqrestore(&vblk->lock, flags);
+		return BLK_MQ_RQ_QUEUE_BUSY;
 	}
+	virtqueue_kick(vblk->vq);
+	spin_unlock_irqrestore(&vblk->lock, flags);
 
-	if (issued)
-		virtqueue_kick(vblk->vq);
+	return BLK_MQ_RQ_QUEUE_OK;
 }
 
+static struct blk_mq_ops virtio_mq_ops = {
+	.queue_rq	= virtio_queue_rq,
+	.map_queue	= blk_mq_map_queue,
+};
+
+static struct blk_mq_reg virtio_mq_reg = {
+	.ops		= &virtio_mq_ops,
+	.nr_hw_queues	= 1,
+	.cmd_size	= sizeof(struct virtblk_req),
+	.numa_node	= -1,
+	.flags		= BLK_MQ_F_SHOULD_MERGE,
+};
+
 /* return id (s/n) string for *disk to *id_str
  */
 static int virtblk_get_id(struct gendisk *disk, char *id_str)
@@ -368,7 +410,6 @@ static int __devinit virtblk_probe(struct virtio_device *vdev)
 		goto out;
 	}
 
-	INIT_LIST_HEAD(&vblk->reqs);
 	spin_lock_init(&vblk->lock);
 	vblk->vdev = vdev;
 	vblk->sg_elems = sg_elems;
@@ -382,27 +423,27 @@ static int __devinit virtblk_probe(struct virtio_device *vdev)
 		goto out_free_vblk;
 	}
 
-	vblk->pool = mempool_create_kmalloc_pool(1,sizeof(struct virtblk_req));
-	if (!vblk->pool) {
-		err = -ENOMEM;
-		goto out_free_vq;
-	}
-
 	/* FIXME: How many partitions?  How long is a piece of string? */
 	vblk->disk = alloc_disk(1 << PART_BITS);
 	if (!vblk->disk) {
 		err = -ENOMEM;
-		goto out_mempool;
+		goto out_free_vq;
 	}
 
-	q = vblk->disk->queue = blk_init_queue(do_virtblk_request, &vblk->lock);
-	if (!q) {
-		err = -ENOMEM;
+	virtio_mq_reg.queue_depth = virtblk_queue_depth;
+	q = blk_mq_init_queue(&virtio_mq_reg, vblk);
+	if (IS_ERR(q)) {
+		err = PTR_ERR(q);
 		goto out_put_disk;
 	}
+	vblk->disk->queue = q;
 
 	q->queuedata = vblk;
 
+	blk_iopoll_init(&vblk->iopoll, virtblk_queue_depth, virtblk_iopoll);
+	blk_iopoll_enable(&vblk->iopoll);
+	blk_queue_iopoll(q, &vblk->iopoll);
+
 	if (index < 26) {
 		sprintf(vblk->disk->disk_name, "vd%c", 'a' + index % 26);
 	} else if (index < (26 + 1) * 26) {
@@ -510,8 +551,6 @@ out_del_disk:
 	blk_cleanup_queue(vblk->disk->queue);
 out_put_disk:
 	put_disk(vblk->disk);
-out_mempool:
-	mempool_destroy(vblk->pool);
 out_free_vq:
 	vdev->config->del_vqs(vdev);
 out_free_vblk:
@@ -526,16 +565,14 @@ static void __devexit virtblk_remove(struct virtio_device *vdev)
 
 	flush_work(&vblk->config_work);
 
-	/* Nothing should be pending. */
-	BUG_ON(!list_empty(&vblk->reqs));
-
 	/* Stop all the virtqueues. */
 	vdev->config->reset(vdev);
 
+	blk_iopoll_disable(&vblk->iopoll);
+
 	del_gendisk(vblk->disk);
 	blk_cleanup_queue(vblk->disk->queue);
 	put_disk(vblk->disk);
-	mempool_destroy(vblk->pool);
 	vdev->config->del_vqs(vdev);
 	kfree(vblk);
 }
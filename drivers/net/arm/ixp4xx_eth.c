@@ -255,9 +255,10 @@ static int ports_open;
 static struct port *npe_port_tab[MAX_NPES];
 static struct dma_pool *dma_pool;
 
-static struct sock_filter ptp_filter[] = {
+static struct sock_filter ptp_filter_prog[] = {
 	PTP_FILTER
 };
+static struct sk_filter *ptp_filter;
 
 static int ixp_ptp_match(struct sk_buff *skb, u16 uid_hi, u32 uid_lo, u16 seqid)
 {
@@ -266,7 +267,7 @@ static int ixp_ptp_match(struct sk_buff *skb, u16 uid_hi, u32 uid_lo, u16 seqid)
 	u16 *hi, *id;
 	u32 lo;
 
-	if (sk_run_filter(skb, ptp_filter) != PTP_CLASS_V1_IPV4)
+	if (SK_RUN_FILTER(ptp_filter, skb) != PTP_CLASS_V1_IPV4)
 		return 0;
 
 	offset = ETH_HLEN + IPV4_HLEN(data) + UDP_HLEN;
@@ -1355,7 +1356,8 @@ static int __devinit eth_init_one(struct platform_device *pdev)
 	char phy_id[MII_BUS_ID_SIZE + 3];
 	int err;
 
-	if (ptp_filter_init(ptp_filter, ARRAY_SIZE(ptp_filter))) {
+	if (ptp_filter_init(&ptp_filter, ptp_filter_prog,
+			    ARRAY_SIZE(ptp_filter_prog))) {
 		pr_err("ixp4xx_eth: bad ptp filter\n");
 		return -EINVAL;
 	}
@@ -37,9 +37,40 @@
 #include <linux/rtnetlink.h>
 #include <net/rtnetlink.h>
 #include <linux/u64_stats_sync.h>
+#include <linux/cpu_rmap.h>
+#include <net/dst.h>
 
 static int numdummies = 1;
 
+#ifdef CONFIG_RFS_ACCEL
+/*
+ * With rfs_rxqs set, the devices created at module load loop every
+ * transmitted frame back into their own receive path and emulate a NIC
+ * with that many Rx queues and a table of accelerated RFS filters.  This
+ * allows the RFS steering logic to be driven with pktgen and measured
+ * without any flow steering hardware.
+ */
+static int rfs_rxqs;
+
+#define DUMMY_RFS_FILTERS	256
+#define DUMMY_RFS_EXPIRE	HZ
+
+struct dummy_rfs_filter {
+	u32			rxhash;
+	u32			flow_id;
+	u16			rxq_index;
+	bool			in_use;
+};
+#endif
+
+struct dummy_priv {
+#ifdef CONFIG_RFS_ACCEL
+	struct dummy_rfs_filter	*rfs_filters;
+	spinlock_t		rfs_lock;
+	struct timer_list	rfs_timer;
+#endif
+};
+
 static int dummy_set_address(struct net_device *dev, void *p)
 {
 	struct sockaddr *sa = p;
@@ -59,6 +90,8 @@ static void set_multicast_list(struct net_device *dev)
 struct pcpu_dstats {
 	u64			tx_packets;
 	u64			tx_bytes;
+	u64			rx_packets;
+	u64			rx_bytes;
 	struct u64_stats_sync	syncp;
 };
 
@@ -69,7 +102,7 @@ static struct rtnl_link_stats64 *dummy_get_stats64(struct net_device *dev,
 
 	for_each_possible_cpu(i) {
 		const struct pcpu_dstats *dstats;
-		u64 tbytes, tpackets;
+		u64 tbytes, tpackets, rbytes, rpackets;
 		unsigned int start;
 
 		dstats = per_cpu_ptr(dev->dstats, i);
@@ -77,13 +110,179 @@ static struct rtnl_link_stats64 *dummy_get_stats64(struct net_device *dev,
 			start = u64_stats_fetch_begin(&dstats->syncp);
 			tbytes = dstats->tx_bytes;
 			tpackets = dstats->tx_packets;
+			rbytes = dstats->rx_bytes;
+			rpackets = dstats->rx_packets;
 		} while (u64_stats_fetch_retry(&dstats->syncp, start));
 		stats->tx_bytes += tbytes;
 		stats->tx_packets += tpackets;
+		stats->rx_bytes += rbytes;
+		stats->rx_packets += rpackets;
 	}
 	return stats;
 }
 
+#ifdef CONFIG_RFS_ACCEL
+static int dummy_rx_flow_steer(struct net_device *dev,
+			       const struct sk_buff *skb,
+			       u16 rxq_index, u32 flow_id)
+{
+	struct dummy_priv *priv = netdev_priv(dev);
+	struct dummy_rfs_filter *f;
+	int idx;
+
+	/* filters match on the flow hash, like the RSS hash of real NICs */
+	idx = skb->rxhash & (DUMMY_RFS_FILTERS - 1);
+	f = &priv->rfs_filters[idx];
+
+	spin_lock(&priv->rfs_lock);
+	if (f->in_use && f->rxhash != skb->rxhash) {
+		spin_unlock(&priv->rfs_lock);
+		return -EBUSY;
+	}
+	f->rxhash = skb->rxhash;
+	f->flow_id = flow_id;
+	f->rxq_index = rxq_index;
+	f->in_use = true;
+	spin_unlock(&priv->rfs_lock);
+
+	return idx;
+}
+
+static void dummy_rfs_expire(unsigned long data)
+{
+	struct net_device *dev = (struct net_device *)data;
+	struct dummy_priv *priv = netdev_priv(dev);
+	struct dummy_rfs_filter *f;
+	int i;
+
+	spin_lock(&priv->rfs_lock);
+	for (i = 0; i < DUMMY_RFS_FILTERS; i++) {
+		f = &priv->rfs_filters[i];
+		if (f->in_use &&
+		    rps_may_expire_flow(dev, f->rxq_index, f->flow_id, i))
+			f->in_use = false;
+	}
+	spin_unlock(&priv->rfs_lock);
+
+	mod_timer(&priv->rfs_timer, jiffies + DUMMY_RFS_EXPIRE);
+}
+
+/* pick the Rx queue a NIC would have delivered the frame to */
+static u16 dummy_rfs_rxq(struct net_device *dev, struct sk_buff *skb)
+{
+	struct dummy_priv *priv = netdev_priv(dev);
+	struct dummy_rfs_filter *f;
+	u32 hash = skb_get_rxhash(skb);
+	u16 rxq = ((u64)hash * dev->real_num_rx_queues) >> 32;
+
+	if (!(dev->features & NETIF_F_NTUPLE))
+		return rxq;
+
+	f = &priv->rfs_filters[hash & (DUMMY_RFS_FILTERS - 1)];
+	spin_lock(&priv->rfs_lock);
+	if (f->in_use && f->rxhash == hash &&
+	    f->rxq_index < dev->real_num_rx_queues)
+		rxq = f->rxq_index;
+	spin_unlock(&priv->rfs_lock);
+
+	return rxq;
+}
+
+static void dummy_rfs_loopback(struct sk_buff *skb, struct net_device *dev)
+{
+	struct pcpu_dstats *dstats = this_cpu_ptr(dev->dstats);
+	unsigned int len;
+
+	skb = skb_share_check(skb, GFP_ATOMIC);
+	if (!skb)
+		return;
+
+	skb_orphan(skb);
+	skb_dst_drop(skb);
+	skb->rxhash = 0;
+	skb->protocol = eth_type_trans(skb, dev);
+	skb_record_rx_queue(skb, dummy_rfs_rxq(dev, skb));
+	len = skb->len;
+
+	if (netif_rx(skb) == NET_RX_SUCCESS) {
+		u64_stats_update_begin(&dstats->syncp);
+		dstats->rx_packets++;
+		dstats->rx_bytes += len;
+		u64_stats_update_end(&dstats->syncp);
+	}
+}
+
+static int dummy_rfs_init(struct net_device *dev)
+{
+	struct dummy_priv *priv = netdev_priv(dev);
+	unsigned int i, cpu;
+	int err = -ENOMEM;
+
+	priv->rfs_filters = kcalloc(DUMMY_RFS_FILTERS,
+				    sizeof(struct dummy_rfs_filter),
+				    GFP_KERNEL);
+	if (!priv->rfs_filters)
+		return err;
+
+	/* spread the emulated queue interrupts over the online cpus */
+	dev->rx_cpu_rmap = alloc_cpu_rmap(dev->num_rx_queues, GFP_KERNEL);
+	if (!dev->rx_cpu_rmap)
+		goto err_filters;
+
+	cpu = cpumask_first(cpu_online_mask);
+	for (i = 0; i < dev->num_rx_queues; i++) {
+		cpu_rmap_add(dev->rx_cpu_rmap, NULL);
+		err = cpu_rmap_update(dev->rx_cpu_rmap, i, cpumask_of(cpu));
+		if (err)
+			goto err_rmap;
+		cpu = cpumask_next(cpu, cpu_online_mask);
+		if (cpu >= nr_cpu_ids)
+			cpu = cpumask_first(cpu_online_mask);
+	}
+
+	dev->hw_features |= NETIF_F_NTUPLE;
+	dev->features |= NETIF_F_NTUPLE;
+	return 0;
+
+err_rmap:
+	free_cpu_rmap(dev->rx_cpu_rmap);
+	dev->rx_cpu_rmap = NULL;
+err_filters:
+	kfree(priv->rfs_filters);
+	priv->rfs_filters = NULL;
+	return err;
+}
+
+static void dummy_rfs_free(struct net_device *dev)
+{
+	struct dummy_priv *priv = netdev_priv(dev);
+
+	free_cpu_rmap(dev->rx_cpu_rmap);
+	dev->rx_cpu_rmap = NULL;
+	kfree(priv->rfs_filters);
+}
+
+static int dummy_open(struct net_device *dev)
+{
+	struct dummy_priv *priv = netdev_priv(dev);
+
+	if (priv->rfs_filters)
+		mod_timer(&priv->rfs_timer, jiffies + DUMMY_RFS_EXPIRE);
+	return 0;
+}
+
+static int dummy_stop(struct net_device *dev)
+{
+	struct dummy_priv *priv = netdev_priv(dev);
+
+	del_timer_sync(&priv->rfs_timer);
+	if (priv->rfs_filters)
+		memset(priv->rfs_filters, 0,
+		       DUMMY_RFS_FILTERS * sizeof(struct dummy_rfs_filter));
+	return 0;
+}
+#endif /* CONFIG_RFS_ACCEL */
+
 static netdev_tx_t dummy_xmit(struct sk_buff *skb, struct net_device *dev)
 {
 	struct pcpu_dstats *dstats = this_cpu_ptr(dev->dstats);
@@ -93,12 +292,24 @@ static netdev_tx_t dummy_xmit(struct sk_buff *skb, struct net_device *dev)
 	dstats->tx_bytes += skb->len;
 	u64_stats_update_end(&dstats->syncp);
 
+#ifdef CONFIG_RFS_ACCEL
+	if (dev->rx_cpu_rmap) {
+		dummy_rfs_loopback(skb, dev);
+		return NETDEV_TX_OK;
+	}
+#endif
 	dev_kfree_skb(skb);
 	return NETDEV_TX_OK;
 }
 
 static int dummy_dev_init(struct net_device *dev)
 {
+#ifdef CONFIG_RFS_ACCEL
+	struct dummy_priv *priv = netdev_priv(dev);
+
+	spin_lock_init(&priv->rfs_lock);
+	setup_timer(&priv->rfs_timer, dummy_rfs_expire, (unsigned long)dev);
+#endif
 	dev->dstats = alloc_percpu(struct pcpu_dstats);
 	if (!dev->dstats)
 		return -ENOMEM;
@@ -108,12 +319,20 @@ static int dummy_dev_init(struct net_device *dev)
 
 static void dummy_dev_free(struct net_device *dev)
 {
+#ifdef CONFIG_RFS_ACCEL
+	dummy_rfs_free(dev);
+#endif
 	free_percpu(dev->dstats);
 	free_netdev(dev);
 }
 
 static const struct net_device_ops dummy_netdev_ops = {
 	.ndo_init		= dummy_dev_init,
+#ifdef CONFIG_RFS_ACCEL
+	.ndo_open		= dummy_open,
+	.ndo_stop		= dummy_stop,
+	.ndo_rx_flow_steer	= dummy_rx_flow_steer,
+#endif
 	.ndo_start_xmit		= dummy_xmit,
 	.ndo_validate_addr	= eth_validate_addr,
 	.ndo_set_multicast_list = set_multicast_list,
@@ -151,6 +370,7 @@ static int dummy_validate(struct nlattr *tb[], struct nlattr *data[])
 
 static struct rtnl_link_ops dummy_link_ops __read_mostly = {
 	.kind		= "dummy",
+	.priv_size	= sizeof(struct dummy_priv),
 	.setup		= dummy_setup,
 	.validate	= dummy_validate,
 };
@@ -159,15 +379,34 @@ static struct rtnl_link_ops dummy_link_ops __read_mostly = {
 module_param(numdummies, int, 0);
 MODULE_PARM_DESC(numdummies, "Number of dummy pseudo devices");
 
+#ifdef CONFIG_RFS_ACCEL
+module_param(rfs_rxqs, int, 0);
+MODULE_PARM_DESC(rfs_rxqs, "Loop frames back over this many emulated Rx "
+		 "queues with accelerated RFS (0 = off)");
+#endif
+
 static int __init dummy_init_one(void)
 {
 	struct net_device *dev_dummy;
+	unsigned int rxqs = 1;
 	int err;
 
-	dev_dummy = alloc_netdev(0, "dummy%d", dummy_setup);
+#ifdef CONFIG_RFS_ACCEL
+	if (rfs_rxqs > 0)
+		rxqs = rfs_rxqs;
+#endif
+	dev_dummy = alloc_netdev_mqs(sizeof(struct dummy_priv), "dummy%d",
+				     dummy_setup, 1, rxqs);
 	if (!dev_dummy)
 		return -ENOMEM;
 
+#ifdef CONFIG_RFS_ACCEL
+	if (rfs_rxqs > 0) {
+		err = dummy_rfs_init(dev_dummy);
+		if (err < 0)
+			goto err;
+	}
+#endif
 	dev_dummy->rtnl_link_ops = &dummy_link_ops;
 	err = register_netdevice(dev_dummy);
 	if (err < 0)
@@ -175,6 +414,9 @@ static int __init dummy_init_one(void)
 	return 0;
 
 err:
+#ifdef CONFIG_RFS_ACCEL
+	dummy_rfs_free(dev_dummy);
+#endif
 	free_netdev(dev_dummy);
 	return err;
 }
@@ -44,7 +44,9 @@
 #include <linux/ethtool.h>
 #include <linux/if_vlan.h>
 #include <linux/prefetch.h>
+#include <linux/cpu_rmap.h>
 #include <scsi/fc/fc_fcoe.h>
+#include <net/busy_poll.h>
 
 #include "ixgbe.h"
 #include "ixgbe_common.h"
@@ -842,6 +844,9 @@ static bool ixgbe_clean_tx_irq(struct ixgbe_q_vector *q_vector,
 	q_vector->tx.total_packets += total_packets;
 	u64_stats_update_end(&tx_ring->syncp);
 
+	netdev_tx_completed_queue(txring_txq(tx_ring),
+				  total_packets, total_bytes);
+
 	if (check_for_tx_hang(tx_ring) && ixgbe_check_tx_hang(tx_ring)) {
 		/* schedule immediate reset if we believe we hung */
 		struct ixgbe_hw *hw = &adapter->hw;
@@ -1078,7 +1083,11 @@ static void ixgbe_receive_skb(struct ixgbe_q_vector *q_vector,
 	if (is_vlan && (tag & VLAN_VID_MASK))
 		__vlan_hwaccel_put_tag(skb, tag);
 
-	if (!(adapter->flags & IXGBE_FLAG_IN_NETPOLL))
+	skb_mark_napi_id(skb, napi);
+
+	if (ixgbe_qv_busy_polling(q_vector))
+		netif_receive_skb(skb);
+	else if (!(adapter->flags & IXGBE_FLAG_IN_NETPOLL))
 		napi_gro_receive(napi, skb);
 	else
 		netif_rx(skb);
@@ -2095,8 +2104,14 @@ static int ixgbe_clean_rxonly(struct napi_struct *napi, int budget)
 	r_idx = find_first_bit(q_vector->rx.idx, adapter->num_rx_queues);
 	rx_ring = adapter->rx_ring[r_idx];
 
+	/* a socket is busy polling this queue, come back later */
+	if (!ixgbe_qv_lock_napi(q_vector))
+		return budget;
+
 	ixgbe_clean_rx_irq(q_vector, rx_ring, &work_done, budget);
 
+	ixgbe_qv_unlock_napi(q_vector);
+
 	/* If all Rx work done, exit the polling mode */
 	if (work_done < budget) {
 		napi_complete(napi);
@@ -2141,6 +2156,10 @@ static int ixgbe_clean_rxtx_many(struct napi_struct *napi, int budget)
 				      r_idx + 1);
 	}
 
+	/* a socket is busy polling the rx rings, come back later */
+	if (!ixgbe_qv_lock_napi(q_vector))
+		return budget;
+
 	/* attempt to distribute budget to each queue fairly, but don't allow
 	 * the budget to go below 1 because we'll exit polling */
 	budget /= (q_vector->rx.count ?: 1);
@@ -2153,6 +2172,8 @@ static int ixgbe_clean_rxtx_many(struct napi_struct *napi, int budget)
 				      r_idx + 1);
 	}
 
+	ixgbe_qv_unlock_napi(q_vector);
+
 	r_idx = find_first_bit(q_vector->rx.idx, adapter->num_rx_queues);
 	ring = adapter->rx_ring[r_idx];
 	/* If all Rx work done, exit the polling mode */
@@ -2305,6 +2326,61 @@ out:
  * ixgbe_request_msix_irqs allocates MSI-X vectors and requests
  * interrupts from the kernel.
  **/
+#ifdef CONFIG_RFS_ACCEL
+static void ixgbe_free_rx_cpu_rmap(struct ixgbe_adapter *adapter)
+{
+	free_irq_cpu_rmap(adapter->netdev->rx_cpu_rmap);
+	adapter->netdev->rx_cpu_rmap = NULL;
+}
+
+/**
+ * ixgbe_init_rx_cpu_rmap - map CPUs to Rx queues for accelerated RFS
+ * @adapter: board private structure
+ *
+ * The stack picks the target queue for a flow from the CPU that the
+ * interrupt of that queue is affine to, so this only works out when
+ * every Rx queue has an MSI-X vector of its own.
+ **/
+static int ixgbe_init_rx_cpu_rmap(struct ixgbe_adapter *adapter)
+{
+	struct net_device *netdev = adapter->netdev;
+	int i, err;
+
+	if (!adapter->arfs_filters)
+		return 0;
+
+	for (i = 0; i < adapter->num_rx_queues; i++)
+		if (adapter->rx_ring[i]->q_vector->rx.count != 1)
+			return 0;
+
+	netdev->rx_cpu_rmap = alloc_irq_cpu_rmap(adapter->num_rx_queues);
+	if (!netdev->rx_cpu_rmap)
+		return -ENOMEM;
+
+	for (i = 0; i < adapter->num_rx_queues; i++) {
+		struct ixgbe_q_vector *q_vector = adapter->rx_ring[i]->q_vector;
+
+		err = irq_cpu_rmap_add(netdev->rx_cpu_rmap,
+				adapter->msix_entries[q_vector->v_idx].vector);
+		if (err) {
+			ixgbe_free_rx_cpu_rmap(adapter);
+			return err;
+		}
+	}
+
+	return 0;
+}
+#else
+static inline void ixgbe_free_rx_cpu_rmap(struct ixgbe_adapter *adapter)
+{
+}
+
+static inline int ixgbe_init_rx_cpu_rmap(struct ixgbe_adapter *adapter)
+{
+	return 0;
+}
+#endif /* CONFIG_RFS_ACCEL */
+
 static int ixgbe_request_msix_irqs(struct ixgbe_adapter *adapter)
 {
 	struct net_device *netdev = adapter->netdev;
@@ -2360,6 +2436,11 @@ static int ixgbe_request_msix_irqs(struct ixgbe_adapter *adapter)
 		goto free_queue_irqs;
 	}
 
+	err = ixgbe_init_rx_cpu_rmap(adapter);
+	if (err)
+		e_warn(probe, "Unable to map Rx queue interrupts, "
+		       "accelerated RFS disabled: %d\n", err);
+
 	return 0;
 
 free_queue_irqs:
@@ -2533,6 +2614,9 @@ static void ixgbe_free_irq(struct ixgbe_adapter *adapter)
 
 		q_vectors = adapter->num_msix_vectors;
 
+		/* drop the affinity notifiers before the irqs go away */
+		ixgbe_free_rx_cpu_rmap(adapter);
+
 		i = q_vectors - 1;
 		free_irq(adapter->msix_entries[i].vector, adapter);
 
@@ -3545,6 +3629,7 @@ static void ixgbe_napi_enable_all(struct ixgbe_adapter *adapter)
 			}
 		}
 
+		ixgbe_qv_init_lock(q_vector);
 		napi_enable(napi);
 	}
 }
@@ -3562,6 +3647,10 @@ static void ixgbe_napi_disable_all(struct ixgbe_adapter *adapter)
 	for (q_idx = 0; q_idx < q_vectors; q_idx++) {
 		q_vector = adapter->q_vector[q_idx];
 		napi_disable(&q_vector->napi);
+		while (!ixgbe_qv_disable(q_vector)) {
+			pr_info("QV %d locked\n", q_idx);
+			usleep_range(1000, 20000);
+		}
 	}
 }
 
@@ -3649,6 +3738,214 @@ static void ixgbe_configure_pb(struct ixgbe_adapter *adapter)
 	hw->mac.ops.set_rxpba(&adapter->hw, num_tc, hdrm, PBA_STRATEGY_EQUAL);
 }
 
+#ifdef CONFIG_RFS_ACCEL
+/* must be called with fdir_perfect_lock held */
+static void ixgbe_arfs_filter_clear(struct ixgbe_adapter *adapter)
+{
+	if (!adapter->arfs_filters)
+		return;
+
+	memset(adapter->arfs_filters, 0,
+	       IXGBE_MAX_ARFS_FILTERS * sizeof(struct ixgbe_arfs_filter));
+	adapter->arfs_filter_count = 0;
+}
+
+/* must be called with fdir_perfect_lock held */
+static void ixgbe_arfs_filter_restore(struct ixgbe_adapter *adapter)
+{
+	struct ixgbe_hw *hw = &adapter->hw;
+	struct ixgbe_arfs_filter *arfs;
+	int i;
+
+	for (i = 0; i < IXGBE_MAX_ARFS_FILTERS && adapter->arfs_filter_count;
+	     i++) {
+		arfs = &adapter->arfs_filters[i];
+		if (!arfs->in_use)
+			continue;
+
+		/* the queue may be gone after a change of ring layout */
+		if (arfs->rxq_index >= adapter->num_rx_queues) {
+			arfs->in_use = false;
+			adapter->arfs_filter_count--;
+			continue;
+		}
+
+		ixgbe_fdir_write_perfect_filter_82599(hw, &arfs->filter,
+				IXGBE_ARFS_SW_IDX_BASE + i,
+				adapter->rx_ring[arfs->rxq_index]->reg_idx);
+	}
+}
+
+/**
+ * ixgbe_rx_flow_steer - steer a flow to the queue of the consuming CPU
+ * @netdev: network interface device structure
+ * @skb: packet of the flow
+ * @rxq_index: Rx queue the flow should be delivered to
+ * @flow_id: RFS flow table index of the flow
+ *
+ * Called from the receive path by get_rps_cpu().  Only IPv4 TCP and UDP
+ * flows are handled.  Returns the filter id on success, which the stack
+ * hands back to rps_may_expire_flow() when the filter is aged out.
+ **/
+static int ixgbe_rx_flow_steer(struct net_device *netdev,
+			       const struct sk_buff *skb,
+			       u16 rxq_index, u32 flow_id)
+{
+	struct ixgbe_adapter *adapter = netdev_priv(netdev);
+	struct ixgbe_hw *hw = &adapter->hw;
+	union ixgbe_atr_input input, mask;
+	struct ixgbe_arfs_filter *arfs;
+	const struct iphdr *ip;
+	const __be16 *ports;
+	int nhoff, idx, err;
+	u8 flow_type;
+
+	if (!(adapter->flags & IXGBE_FLAG_FDIR_PERFECT_CAPABLE) ||
+	    !adapter->arfs_filters)
+		return -EOPNOTSUPP;
+
+	if (rxq_index >= adapter->num_rx_queues)
+		return -EINVAL;
+
+	if (skb->protocol != htons(ETH_P_IP))
+		return -EPROTONOSUPPORT;
+
+	nhoff = skb_network_offset(skb);
+	ip = (const struct iphdr *)(skb->data + nhoff);
+	if (ip_is_fragment(ip))
+		return -EPROTONOSUPPORT;
+
+	switch (ip->protocol) {
+	case IPPROTO_TCP:
+		flow_type = IXGBE_ATR_FLOW_TYPE_TCPV4;
+		break;
+	case IPPROTO_UDP:
+		flow_type = IXGBE_ATR_FLOW_TYPE_UDPV4;
+		break;
+	default:
+		return -EPROTONOSUPPORT;
+	}
+
+	/* get_rps_cpu() has already pulled the ports into the linear area */
+	ports = (const __be16 *)(skb->data + nhoff + 4 * ip->ihl);
+
+	memset(&input, 0, sizeof(input));
+	input.formatted.flow_type = flow_type;
+	input.formatted.src_ip[0] = ip->saddr;
+	input.formatted.dst_ip[0] = ip->daddr;
+	input.formatted.src_port = ports[0];
+	input.formatted.dst_port = ports[1];
+
+	memset(&mask, 0, sizeof(mask));
+	mask.formatted.flow_type = IXGBE_ATR_L4TYPE_IPV6_MASK |
+				   IXGBE_ATR_L4TYPE_MASK;
+	mask.formatted.src_ip[0] = htonl(0xffffffff);
+	mask.formatted.dst_ip[0] = htonl(0xffffffff);
+	mask.formatted.src_port = htons(0xffff);
+	mask.formatted.dst_port = htons(0xffff);
+
+	ixgbe_atr_compute_perfect_hash_82599(&input, &mask);
+
+	/* never spin in the receive path, ethtool may hold the lock */
+	if (!spin_trylock(&adapter->fdir_perfect_lock))
+		return -EBUSY;
+
+	idx = flow_id & (IXGBE_MAX_ARFS_FILTERS - 1);
+	arfs = &adapter->arfs_filters[idx];
+
+	/* a different flow owns the slot until it expires */
+	if (arfs->in_use &&
+	    memcmp(&arfs->filter, &input, sizeof(input))) {
+		err = -EBUSY;
+		goto out;
+	}
+
+	if (hlist_empty(&adapter->fdir_filter_list) &&
+	    !adapter->arfs_filter_count) {
+		memcpy(&adapter->fdir_mask, &mask, sizeof(mask));
+		err = ixgbe_fdir_set_input_mask_82599(hw, &mask);
+		if (err) {
+			err = -EIO;
+			goto out;
+		}
+	} else if (memcmp(&adapter->fdir_mask, &mask, sizeof(mask))) {
+		/* the port wide mask belongs to the ethtool filters */
+		err = -EINVAL;
+		goto out;
+	}
+
+	err = ixgbe_fdir_write_perfect_filter_82599(hw, &input,
+				IXGBE_ARFS_SW_IDX_BASE + idx,
+				adapter->rx_ring[rxq_index]->reg_idx);
+	if (err) {
+		err = -EIO;
+		goto out;
+	}
+
+	if (!arfs->in_use) {
+		arfs->in_use = true;
+		adapter->arfs_filter_count++;
+	}
+	arfs->filter = input;
+	arfs->flow_id = flow_id;
+	arfs->rxq_index = rxq_index;
+	err = idx;
+out:
+	spin_unlock(&adapter->fdir_perfect_lock);
+	return err;
+}
+
+/**
+ * ixgbe_arfs_expire_subtask - remove filters of flows that went idle
+ * @adapter: pointer to the device adapter structure
+ **/
+static void ixgbe_arfs_expire_subtask(struct ixgbe_adapter *adapter)
+{
+	struct net_device *netdev = adapter->netdev;
+	struct ixgbe_hw *hw = &adapter->hw;
+	struct ixgbe_arfs_filter *arfs;
+	int i;
+
+	if (!adapter->arfs_filter_count ||
+	    test_bit(__IXGBE_DOWN, &adapter->state))
+		return;
+
+	/*
+	 * Erasing a filter polls the hardware, so keep bottom halves
+	 * enabled; the receive path only ever trylocks.
+	 */
+	spin_lock(&adapter->fdir_perfect_lock);
+
+	for (i = 0; i < IXGBE_MAX_ARFS_FILTERS && adapter->arfs_filter_count;
+	     i++) {
+		arfs = &adapter->arfs_filters[i];
+		if (!arfs->in_use ||
+		    !rps_may_expire_flow(netdev, arfs->rxq_index,
+					 arfs->flow_id, i))
+			continue;
+
+		ixgbe_fdir_erase_perfect_filter_82599(hw, &arfs->filter,
+						IXGBE_ARFS_SW_IDX_BASE + i);
+		arfs->in_use = false;
+		adapter->arfs_filter_count--;
+	}
+
+	spin_unlock(&adapter->fdir_perfect_lock);
+}
+#else
+static inline void ixgbe_arfs_filter_clear(struct ixgbe_adapter *adapter)
+{
+}
+
+static inline void ixgbe_arfs_filter_restore(struct ixgbe_adapter *adapter)
+{
+}
+
+static inline void ixgbe_arfs_expire_subtask(struct ixgbe_adapter *adapter)
+{
+}
+#endif /* CONFIG_RFS_ACCEL */
+
 static void ixgbe_fdir_filter_restore(struct ixgbe_adapter *adapter)
 {
 	struct ixgbe_hw *hw = &adapter->hw;
@@ -3657,7 +3954,8 @@ static void ixgbe_fdir_filter_restore(struct ixgbe_adapter *adapter)
 
 	spin_lock(&adapter->fdir_perfect_lock);
 
-	if (!hlist_empty(&adapter->fdir_filter_list))
+	if (!hlist_empty(&adapter->fdir_filter_list) ||
+	    ixgbe_arfs_filter_count(adapter))
 		ixgbe_fdir_set_input_mask_82599(hw, &adapter->fdir_mask);
 
 	hlist_for_each_entry_safe(filter, node, node2,
@@ -3670,6 +3968,8 @@ static void ixgbe_fdir_filter_restore(struct ixgbe_adapter *adapter)
 				adapter->rx_ring[filter->action]->reg_idx);
 	}
 
+	ixgbe_arfs_filter_restore(adapter);
+
 	spin_unlock(&adapter->fdir_perfect_lock);
 }
 
@@ -4043,6 +4343,8 @@ static void ixgbe_clean_tx_ring(struct ixgbe_ring *tx_ring)
 		ixgbe_unmap_and_free_tx_resource(tx_ring, tx_buffer_info);
 	}
 
+	netdev_tx_reset_queue(txring_txq(tx_ring));
+
 	size = sizeof(struct ixgbe_tx_buffer) * tx_ring->count;
 	memset(tx_ring->tx_buffer_info, 0, size);
 
@@ -4090,6 +4392,7 @@ static void ixgbe_fdir_filter_exit(struct ixgbe_adapter *adapter)
 		kfree(filter);
 	}
 	adapter->fdir_filter_count = 0;
+	ixgbe_arfs_filter_clear(adapter);
 
 	spin_unlock(&adapter->fdir_perfect_lock);
 }
@@ -4211,8 +4514,15 @@ static int ixgbe_poll(struct napi_struct *napi, int budget)
 #endif
 
 	tx_clean_complete = ixgbe_clean_tx_irq(q_vector, adapter->tx_ring[0]);
+
+	/* a socket is busy polling the rx ring, come back later */
+	if (!ixgbe_qv_lock_napi(q_vector))
+		return budget;
+
 	ixgbe_clean_rx_irq(q_vector, adapter->rx_ring[0], &work_done, budget);
 
+	ixgbe_qv_unlock_napi(q_vector);
+
 	if (!tx_clean_complete)
 		work_done = budget;
 
@@ -4892,6 +5202,7 @@ static int ixgbe_alloc_q_vectors(struct ixgbe_adapter *adapter)
 			q_vector->eitr = adapter->rx_eitr_param;
 		q_vector->v_idx = q_idx;
 		netif_napi_add(adapter->netdev, &q_vector->napi, (*poll), 64);
+		napi_hash_add(&q_vector->napi);
 		adapter->q_vector[q_idx] = q_vector;
 	}
 
@@ -4901,8 +5212,9 @@ err_out:
 	while (q_idx) {
 		q_idx--;
 		q_vector = adapter->q_vector[q_idx];
+		napi_hash_del(&q_vector->napi);
 		netif_napi_del(&q_vector->napi);
-		kfree(q_vector);
+		kfree_rcu(q_vector, rcu);
 		adapter->q_vector[q_idx] = NULL;
 	}
 	return -ENOMEM;
@@ -4928,8 +5240,10 @@ static void ixgbe_free_q_vectors(struct ixgbe_adapter *adapter)
 	for (q_idx = 0; q_idx < num_q_vectors; q_idx++) {
 		struct ixgbe_q_vector *q_vector = adapter->q_vector[q_idx];
 		adapter->q_vector[q_idx] = NULL;
+		napi_hash_del(&q_vector->napi);
 		netif_napi_del(&q_vector->napi);
-		kfree(q_vector);
+		/* a busy polling socket may still look at the napi */
+		kfree_rcu(q_vector, rcu);
 	}
 }
 
@@ -5082,6 +5396,11 @@ static int __devinit ixgbe_sw_init(struct ixgbe_adapter *adapter)
 		adapter->ring_feature[RING_F_FDIR].indices =
 							 IXGBE_MAX_FDIR_INDICES;
 		adapter->fdir_pballoc = IXGBE_FDIR_PBALLOC_64K;
+#ifdef CONFIG_RFS_ACCEL
+		/* accelerated RFS is simply unavailable if this fails */
+		adapter->arfs_filters = vzalloc(IXGBE_MAX_ARFS_FILTERS *
+					sizeof(struct ixgbe_arfs_filter));
+#endif
 #ifdef IXGBE_FCOE
 		adapter->flags |= IXGBE_FLAG_FCOE_CAPABLE;
 		adapter->flags &= ~IXGBE_FLAG_FCOE_ENABLED;
@@ -6261,6 +6580,7 @@ static void ixgbe_service_task(struct work_struct *work)
 	ixgbe_check_overtemp_subtask(adapter);
 	ixgbe_watchdog_subtask(adapter);
 	ixgbe_fdir_reinit_subtask(adapter);
+	ixgbe_arfs_expire_subtask(adapter);
 	ixgbe_check_hang_subtask(adapter);
 
 	ixgbe_service_event_complete(adapter);
@@ -6507,6 +6827,8 @@ static int ixgbe_tx_map(struct ixgbe_adapter *adapter,
 	tx_ring->tx_buffer_info[i].skb = skb;
 	tx_ring->tx_buffer_info[first].next_to_watch = i;
 
+	netdev_tx_sent_queue(txring_txq(tx_ring), bytecount);
+
 	return count;
 
 dma_error:
@@ -6980,6 +7302,39 @@ static void ixgbe_netpoll(struct net_device *netdev)
 }
 #endif
 
+#ifdef CONFIG_NET_RX_BUSY_POLL
+/* must be called with local_bh_disable()d */
+static int ixgbe_low_latency_recv(struct napi_struct *napi)
+{
+	struct ixgbe_q_vector *q_vector =
+			container_of(napi, struct ixgbe_q_vector, napi);
+	struct ixgbe_adapter *adapter = q_vector->adapter;
+	struct ixgbe_ring *ring;
+	int found = 0, i;
+	long r_idx;
+
+	if (test_bit(__IXGBE_DOWN, &adapter->state))
+		return LL_FLUSH_FAILED;
+
+	if (!ixgbe_qv_lock_poll(q_vector))
+		return LL_FLUSH_BUSY;
+
+	r_idx = find_first_bit(q_vector->rx.idx, adapter->num_rx_queues);
+	for (i = 0; i < q_vector->rx.count; i++) {
+		ring = adapter->rx_ring[r_idx];
+		ixgbe_clean_rx_irq(q_vector, ring, &found, 4);
+		if (found)
+			break;
+		r_idx = find_next_bit(q_vector->rx.idx, adapter->num_rx_queues,
+				      r_idx + 1);
+	}
+
+	ixgbe_qv_unlock_poll(q_vector);
+
+	return found;
+}
+#endif	/* CONFIG_NET_RX_BUSY_POLL */
+
 static struct rtnl_link_stats64 *ixgbe_get_stats64(struct net_device *netdev,
 						   struct rtnl_link_stats64 *stats)
 {
@@ -7187,6 +7542,9 @@ static int ixgbe_set_features(struct net_device *netdev, u32 data)
 	} else if (!(data & NETIF_F_NTUPLE)) {
 		/* turn off Flow Director, set ATR and reset */
 		adapter->flags &= ~IXGBE_FLAG_FDIR_PERFECT_CAPABLE;
+		spin_lock(&adapter->fdir_perfect_lock);
+		ixgbe_arfs_filter_clear(adapter);
+		spin_unlock(&adapter->fdir_perfect_lock);
 		if ((adapter->flags &  IXGBE_FLAG_RSS_ENABLED) &&
 		    !(adapter->flags &  IXGBE_FLAG_DCB_ENABLED))
 			adapter->flags |= IXGBE_FLAG_FDIR_HASH_CAPABLE;
@@ -7223,6 +7581,12 @@ static const struct net_device_ops ixgbe_netdev_ops = {
 #ifdef CONFIG_NET_POLL_CONTROLLER
 	.ndo_poll_controller	= ixgbe_netpoll,
 #endif
+#ifdef CONFIG_NET_RX_BUSY_POLL
+	.ndo_busy_poll		= ixgbe_low_latency_recv,
+#endif
+#ifdef CONFIG_RFS_ACCEL
+	.ndo_rx_flow_steer	= ixgbe_rx_flow_steer,
+#endif
 #ifdef IXGBE_FCOE
 	.ndo_fcoe_ddp_setup = ixgbe_fcoe_ddp_get,
 	.ndo_fcoe_ddp_target = ixgbe_fcoe_ddp_target,
@@ -7706,6 +8070,9 @@ err_eeprom:
 	if (adapter->flags & IXGBE_FLAG_SRIOV_ENABLED)
 		ixgbe_disable_sriov(adapter);
 	adapter->flags2 &= ~IXGBE_FLAG2_SEARCH_FOR_SFP;
+#ifdef CONFIG_RFS_ACCEL
+	vfree(adapter->arfs_filters);
+#endif
 	iounmap(hw->hw_addr);
 err_ioremap:
 	free_netdev(netdev);
@@ -7762,6 +8129,9 @@ static void __devexit ixgbe_remove(struct pci_dev *pdev)
 
 	ixgbe_release_hw_control(adapter);
 
+#ifdef CONFIG_RFS_ACCEL
+	vfree(adapter->arfs_filters);
+#endif
 	iounmap(adapter->hw.hw_addr);
 	pci_release_selected_regions(pdev, pci_select_bars(pdev,
 				     IORESOURCE_MEM));
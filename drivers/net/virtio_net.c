@@ -26,6 +26,7 @@
 #include <linux/scatterlist.h>
 #include <linux/if_vlan.h>
 #include <linux/slab.h>
+#include <net/busy_poll.h>
 
 static int napi_weight = 128;
 module_param(napi_weight, int, 0444);
@@ -138,6 +139,11 @@ static void skb_xmit_done(struct virtqueue *svq)
 
 	/* We were probably waiting for more output buffers. */
 	netif_wake_queue(vi->dev);
+
+	/* Or byte queue limits stopped the queue: nothing but reaping the
+	 * completions restarts it, and start_xmit won't run to do that. */
+	if (netif_xmit_stopped(netdev_get_tx_queue(vi->dev, 0)))
+		napi_schedule(&vi->napi);
 }
 
 static void set_skb_frag(struct sk_buff *skb, struct page *page,
@@ -333,6 +339,8 @@ static void receive_buf(struct net_device *dev, void *buf, unsigned int len)
 		skb_shinfo(skb)->gso_segs = 0;
 	}
 
+	skb_mark_napi_id(skb, &vi->napi);
+
 	netif_receive_skb(skb);
 	return;
 
@@ -494,13 +502,36 @@ static void refill_work(struct work_struct *work)
 		schedule_delayed_work(&vi->refill, HZ/2);
 }
 
-static int virtnet_poll(struct napi_struct *napi, int budget)
+static unsigned int free_old_xmit_skbs(struct virtnet_info *vi)
+{
+	struct sk_buff *skb;
+	unsigned int len, tot_sgs = 0;
+	unsigned int bytes = 0, packets = 0;
+	struct virtnet_stats __percpu *stats = this_cpu_ptr(vi->stats);
+
+	while ((skb = virtqueue_get_buf(vi->svq, &len)) != NULL) {
+		pr_debug("Sent skb %p\n", skb);
+
+		u64_stats_update_begin(&stats->syncp);
+		stats->tx_bytes += skb->len;
+		stats->tx_packets++;
+		u64_stats_update_end(&stats->syncp);
+
+		bytes += skb->len;
+		packets++;
+		tot_sgs += skb_vnet_hdr(skb)->num_sg;
+		dev_kfree_skb_any(skb);
+	}
+	netdev_completed_queue(vi->dev, packets, bytes);
+	return tot_sgs;
+}
+
+/* Caller must own the napi context (NAPI_STATE_SCHED) */
+static unsigned int virtnet_receive(struct virtnet_info *vi, int budget)
 {
-	struct virtnet_info *vi = container_of(napi, struct virtnet_info, napi);
 	void *buf;
 	unsigned int len, received = 0;
 
-again:
 	while (received < budget &&
 	       (buf = virtqueue_get_buf(vi->rvq, &len)) != NULL) {
 		receive_buf(vi->dev, buf, len);
@@ -513,6 +544,25 @@ again:
 			schedule_delayed_work(&vi->refill, 0);
 	}
 
+	return received;
+}
+
+static int virtnet_poll(struct napi_struct *napi, int budget)
+{
+	struct virtnet_info *vi = container_of(napi, struct virtnet_info, napi);
+	struct netdev_queue *txq = netdev_get_tx_queue(vi->dev, 0);
+	unsigned int received = 0;
+
+	/* Reap transmit completions if byte queue limits stopped the queue,
+	 * see skb_xmit_done(). */
+	if (unlikely(netif_xmit_stopped(txq)) && __netif_tx_trylock(txq)) {
+		free_old_xmit_skbs(vi);
+		__netif_tx_unlock(txq);
+	}
+
+again:
+	received += virtnet_receive(vi, budget - received);
+
 	/* Out of packets? */
 	if (received < budget) {
 		napi_complete(napi);
@@ -527,25 +577,45 @@ again:
 	return received;
 }
 
-static unsigned int free_old_xmit_skbs(struct virtnet_info *vi)
+#ifdef CONFIG_NET_RX_BUSY_POLL
+/* must be called with local_bh_disable()d */
+static int virtnet_busy_poll(struct napi_struct *napi)
 {
-	struct sk_buff *skb;
-	unsigned int len, tot_sgs = 0;
-	struct virtnet_stats __percpu *stats = this_cpu_ptr(vi->stats);
+	struct virtnet_info *vi = container_of(napi, struct virtnet_info, napi);
+	int received = 0, budget = 4;
 
-	while ((skb = virtqueue_get_buf(vi->svq, &len)) != NULL) {
-		pr_debug("Sent skb %p\n", skb);
+	if (!(vi->status & VIRTIO_NET_S_LINK_UP))
+		return LL_FLUSH_FAILED;
 
-		u64_stats_update_begin(&stats->syncp);
-		stats->tx_bytes += skb->len;
-		stats->tx_packets++;
-		u64_stats_update_end(&stats->syncp);
+	/* Owning NAPI_STATE_SCHED keeps virtnet_poll() and refill_work()
+	 * away from the receive queue while we poll it.
+	 */
+	if (!napi_schedule_prep(napi))
+		return LL_FLUSH_BUSY;
 
-		tot_sgs += skb_vnet_hdr(skb)->num_sg;
-		dev_kfree_skb_any(skb);
+	virtqueue_disable_cb(vi->rvq);
+
+again:
+	received += virtnet_receive(vi, budget - received);
+
+	smp_mb__before_clear_bit();
+	clear_bit(NAPI_STATE_SCHED, &napi->state);
+
+	/* The callback is re-armed only after we gave up the napi context,
+	 * so a buffer used from now on will schedule napi from the
+	 * interrupt; one that arrived before is caught here.
+	 */
+	if (unlikely(!virtqueue_enable_cb(vi->rvq)) &&
+	    napi_schedule_prep(napi)) {
+		virtqueue_disable_cb(vi->rvq);
+		if (received < budget)
+			goto again;
+		__napi_schedule(napi);
 	}
-	return tot_sgs;
+
+	return received;
 }
+#endif	/* CONFIG_NET_RX_BUSY_POLL */
 
 static int xmit_skb(struct virtnet_info *vi, struct sk_buff *skb)
 {
@@ -597,6 +667,7 @@ static int xmit_skb(struct virtnet_info *vi, struct sk_buff *skb)
 static netdev_tx_t start_xmit(struct sk_buff *skb, struct net_device *dev)
 {
 	struct virtnet_info *vi = netdev_priv(dev);
+	struct netdev_queue *txq = netdev_get_tx_queue(dev, 0);
 	int capacity;
 
 	/* Free up any pending old buffers before queueing new ones. */
@@ -622,6 +693,7 @@ static netdev_tx_t start_xmit(struct sk_buff *skb, struct net_device *dev)
 		kfree_skb(skb);
 		return NETDEV_TX_OK;
 	}
+	netdev_tx_sent_queue(txq, skb->len);
 	virtqueue_kick(vi->svq);
 
 	/* Don't wait up for transmitted skbs to be freed. */
@@ -640,6 +712,16 @@ static netdev_tx_t start_xmit(struct sk_buff *skb, struct net_device *dev)
 				virtqueue_disable_cb(vi->svq);
 			}
 		}
+	} else if (unlikely(netif_xmit_stopped(txq))) {
+		/* Byte queue limits stopped the queue with room left in the
+		 * ring.  Only a completion restarts it, so ask for one. */
+		while (unlikely(!virtqueue_enable_cb_delayed(vi->svq))) {
+			free_old_xmit_skbs(vi);
+			if (!netif_xmit_stopped(txq)) {
+				virtqueue_disable_cb(vi->svq);
+				break;
+			}
+		}
 	}
 
 	return NETDEV_TX_OK;
@@ -896,6 +978,9 @@ static const struct net_device_ops virtnet_netdev = {
 #ifdef CONFIG_NET_POLL_CONTROLLER
 	.ndo_poll_controller = virtnet_netpoll,
 #endif
+#ifdef CONFIG_NET_RX_BUSY_POLL
+	.ndo_busy_poll	     = virtnet_busy_poll,
+#endif
 };
 
 static void virtnet_update_status(struct virtnet_info *vi)
@@ -992,6 +1077,7 @@ static int virtnet_probe(struct virtio_device *vdev)
 	/* Set up our device-specific information */
 	vi = netdev_priv(dev);
 	netif_napi_add(dev, &vi->napi, virtnet_poll, napi_weight);
+	napi_hash_add(&vi->napi);
 	vi->dev = dev;
 	vi->vdev = vdev;
 	vdev->priv = vi;
@@ -1068,6 +1154,8 @@ free_vqs:
 free_stats:
 	free_percpu(vi->stats);
 free:
+	napi_hash_del(&vi->napi);
+	synchronize_net();
 	free_netdev(dev);
 	return err;
 }
@@ -1102,6 +1190,7 @@ static void __devexit virtnet_remove(struct virtio_device *vdev)
 	vdev->config->reset(vdev);
 
 
+	napi_hash_del(&vi->napi);
 	unregister_netdev(vi->dev);
 	cancel_delayed_work_sync(&vi->refill);
 
@@ -1524,9 +1524,14 @@ static void scsi_request_fn(struct request_queue *q)
 
 
 		/*
-		 * Remove the request from the request list.
+		 * Remove the request from the request list. If we cannot
+		 * get a tag, leave it where it is instead of dequeueing
+		 * and requeueing it.
 		 */
-		if (!(blk_queue_tagged(q) && !blk_queue_start_tag(q, req)))
+		if (blk_queue_tagged(q)) {
+			if (blk_queue_start_tag(q, req))
+				goto starved;
+		} else
 			blk_start_request(req);
 		sdev->device_busy++;
 
@@ -1542,21 +1547,6 @@ static void scsi_request_fn(struct request_queue *q)
 		}
 		spin_lock(shost->host_lock);
 
-		/*
-		 * We hit this when the driver is using a host wide
-		 * tag map. For device level tag maps the queue_depth check
-		 * in the device ready fn would prevent us from trying
-		 * to allocate a tag. Since the map is a shared host resource
-		 * we add the dev to the starved list so it eventually gets
-		 * a run when a tag is freed.
-		 */
-		if (blk_queue_tagged(q) && !blk_rq_tagged(req)) {
-			if (list_empty(&sdev->starved_entry))
-				list_add_tail(&sdev->starved_entry,
-					      &shost->starved_list);
-			goto not_ready;
-		}
-
 		if (!scsi_target_queue_ready(shost, sdev))
 			goto not_ready;
 
@@ -1589,6 +1579,24 @@ static void scsi_request_fn(struct request_queue *q)
 
 	goto out;
 
+ starved:
+	/*
+	 * We hit this when the driver is using a host wide
+	 * tag map. For device level tag maps the queue_depth check
+	 * in the device ready fn would prevent us from trying
+	 * to allocate a tag. Since the map is a shared host resource
+	 * we add the dev to the starved list so it eventually gets
+	 * a run when a tag is freed. The request was never dequeued,
+	 * so there is nothing to requeue.
+	 */
+	spin_unlock(q->queue_lock);
+	spin_lock(shost->host_lock);
+	if (list_empty(&sdev->starved_entry))
+		list_add_tail(&sdev->starved_entry, &shost->starved_list);
+	spin_unlock(shost->host_lock);
+	spin_lock(q->queue_lock);
+	goto out_delay;
+
  not_ready:
 	spin_unlock_irq(shost->host_lock);
 
@@ -0,0 +1,209 @@
+/*
+ * Compression streams for zram
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+#define KMSG_COMPONENT "zram"
+#define pr_fmt(fmt) KMSG_COMPONENT ": " fmt
+
+#include <linux/kernel.h>
+#include <linux/err.h>
+#include <linux/mm.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+
+#include "zcomp.h"
+
+/* Compressors zram may be configured with, default first */
+static const char * const backends[] = {
+	"lzo",
+	"deflate",
+	NULL
+};
+
+/*
+ * Compressed output can be larger than its input, so the stream buffer
+ * covers two pages.
+ */
+#define ZCOMP_BUFFER_ORDER	1
+
+int zcomp_available_algorithm(const char *name)
+{
+	int i;
+
+	for (i = 0; backends[i]; i++) {
+		if (!strcmp(backends[i], name))
+			return crypto_has_comp(name, 0, 0);
+	}
+
+	return 0;
+}
+
+/* Show the compressors the crypto layer provides, current one bracketed */
+ssize_t zcomp_available_show(const char *cur, char *buf)
+{
+	ssize_t sz = 0;
+	int i;
+
+	for (i = 0; backends[i]; i++) {
+		if (!crypto_has_comp(backends[i], 0, 0))
+			continue;
+
+		if (!strcmp(cur, backends[i]))
+			sz += sprintf(buf + sz, "[%s] ", backends[i]);
+		else
+			sz += sprintf(buf + sz, "%s ", backends[i]);
+	}
+	sz += sprintf(buf + sz, "\n");
+
+	return sz;
+}
+
+static void zcomp_strm_free(struct zcomp_strm *zstrm)
+{
+	if (zstrm->tfm)
+		crypto_free_comp(zstrm->tfm);
+	free_pages((unsigned long)zstrm->buffer, ZCOMP_BUFFER_ORDER);
+	kfree(zstrm);
+}
+
+static struct zcomp_strm *zcomp_strm_alloc(struct zcomp *comp)
+{
+	struct zcomp_strm *zstrm;
+
+	zstrm = kzalloc(sizeof(*zstrm), GFP_KERNEL);
+	if (!zstrm)
+		return NULL;
+
+	zstrm->tfm = crypto_alloc_comp(comp->name, 0, 0);
+	if (IS_ERR(zstrm->tfm)) {
+		zstrm->tfm = NULL;
+		goto fail;
+	}
+
+	zstrm->buffer = (void *)__get_free_pages(GFP_KERNEL | __GFP_ZERO,
+						ZCOMP_BUFFER_ORDER);
+	if (!zstrm->buffer)
+		goto fail;
+
+	return zstrm;
+
+fail:
+	zcomp_strm_free(zstrm);
+	return NULL;
+}
+
+/*
+ * Get an idle stream, sleeping until one is released if all of them are
+ * in use. Must not be called in atomic context.
+ */
+struct zcomp_strm *zcomp_strm_find(struct zcomp *comp)
+{
+	struct zcomp_strm *zstrm;
+
+	while (1) {
+		spin_lock(&comp->strm_lock);
+		if (!list_empty(&comp->idle_strm)) {
+			zstrm = list_first_entry(&comp->idle_strm,
+					struct zcomp_strm, list);
+			list_del(&zstrm->list);
+			spin_unlock(&comp->strm_lock);
+			return zstrm;
+		}
+		spin_unlock(&comp->strm_lock);
+
+		wait_event(comp->strm_wait, !list_empty(&comp->idle_strm));
+	}
+}
+
+void zcomp_strm_release(struct zcomp *comp, struct zcomp_strm *zstrm)
+{
+	spin_lock(&comp->strm_lock);
+	list_add(&zstrm->list, &comp->idle_strm);
+	spin_unlock(&comp->strm_lock);
+
+	wake_up(&comp->strm_wait);
+}
+
+/* Compress one page from src into zstrm->buffer */
+int zcomp_compress(struct zcomp_strm *zstrm, const unsigned char *src,
+			size_t *dst_len)
+{
+	unsigned int dlen = PAGE_SIZE << ZCOMP_BUFFER_ORDER;
+	int ret;
+
+	ret = crypto_comp_compress(zstrm->tfm, src, PAGE_SIZE,
+				zstrm->buffer, &dlen);
+	*dst_len = dlen;
+
+	return ret;
+}
+
+int zcomp_decompress(struct zcomp_strm *zstrm, const unsigned char *src,
+			size_t src_len, unsigned char *dst)
+{
+	unsigned int dlen = PAGE_SIZE;
+	int ret;
+
+	ret = crypto_comp_decompress(zstrm->tfm, src, src_len, dst, &dlen);
+	if (!ret && dlen != PAGE_SIZE)
+		ret = -EINVAL;
+
+	return ret;
+}
+
+void zcomp_destroy(struct zcomp *comp)
+{
+	struct zcomp_strm *zstrm;
+
+	while (!list_empty(&comp->idle_strm)) {
+		zstrm = list_first_entry(&comp->idle_strm,
+				struct zcomp_strm, list);
+		list_del(&zstrm->list);
+		zcomp_strm_free(zstrm);
+	}
+	kfree(comp);
+}
+
+/*
+ * Create a pool of nr_strm streams for the compressor 'name'. All streams
+ * are set up front so that reads and writes never have to allocate one.
+ */
+struct zcomp *zcomp_create(const char *name, int nr_strm)
+{
+	struct zcomp *comp;
+	struct zcomp_strm *zstrm;
+	int i;
+
+	if (!zcomp_available_algorithm(name))
+		return NULL;
+
+	comp = kzalloc(sizeof(*comp), GFP_KERNEL);
+	if (!comp)
+		return NULL;
+
+	strlcpy(comp->name, name, sizeof(comp->name));
+	spin_lock_init(&comp->strm_lock);
+	INIT_LIST_HEAD(&comp->idle_strm);
+	init_waitqueue_head(&comp->strm_wait);
+
+	for (i = 0; i < nr_strm; i++) {
+		zstrm = zcomp_strm_alloc(comp);
+		if (!zstrm) {
+			pr_err("Error allocating %s compression stream\n",
+				name);
+			zcomp_destroy(comp);
+			return NULL;
+		}
+		list_add(&zstrm->list, &comp->idle_strm);
+	}
+	comp->nr_strm = nr_strm;
+
+	return comp;
+}
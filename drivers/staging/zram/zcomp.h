@@ -0,0 +1,53 @@
+/*
+ * Compression streams for zram
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+#ifndef _ZCOMP_H_
+#define _ZCOMP_H_
+
+#include <linux/crypto.h>
+#include <linux/list.h>
+#include <linux/spinlock.h>
+#include <linux/wait.h>
+
+/*
+ * A compression stream: a crypto transform plus a buffer large enough
+ * for the worst case output of compressing one page. A stream is used
+ * by one request at a time.
+ */
+struct zcomp_strm {
+	struct crypto_comp *tfm;
+	void *buffer;
+	struct list_head list;
+};
+
+/* A per-device pool of compression streams */
+struct zcomp {
+	char name[CRYPTO_MAX_ALG_NAME];
+	spinlock_t strm_lock;		/* protects idle_strm */
+	struct list_head idle_strm;
+	wait_queue_head_t strm_wait;	/* waiters for an idle stream */
+	int nr_strm;
+};
+
+int zcomp_available_algorithm(const char *name);
+ssize_t zcomp_available_show(const char *cur, char *buf);
+
+struct zcomp *zcomp_create(const char *name, int nr_strm);
+void zcomp_destroy(struct zcomp *comp);
+
+struct zcomp_strm *zcomp_strm_find(struct zcomp *comp);
+void zcomp_strm_release(struct zcomp *comp, struct zcomp_strm *zstrm);
+
+int zcomp_compress(struct zcomp_strm *zstrm, const unsigned char *src,
+			size_t *dst_len);
+int zcomp_decompress(struct zcomp_strm *zstrm, const unsigned char *src,
+			size_t src_len, unsigned char *dst);
+
+#endif
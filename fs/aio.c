@@ -35,6 +35,8 @@
 #include <linux/eventfd.h>
 #include <linux/blkdev.h>
 #include <linux/compat.h>
+#include <linux/poll.h>
+#include <linux/socket.h>
 
 #include <asm/kmap_types.h>
 #include <asm/uaccess.h>
@@ -65,6 +67,7 @@ static LIST_HEAD(fput_head);
 
 static void aio_kick_handler(struct work_struct *);
 static void aio_queue_work(struct kioctx *);
+static int aio_wake_function(wait_queue_t *, unsigned, int, void *);
 
 /* aio_setup
  *	Creates the slab caches used by the aio routines, panic on
@@ -104,13 +107,13 @@ static void aio_free_ring(struct kioctx *ctx)
 	info->nr = 0;
 }
 
-static int aio_setup_ring(struct kioctx *ctx)
+static int aio_setup_ring(struct kioctx *ctx, unsigned sq_entries)
 {
 	struct aio_ring *ring;
 	struct aio_ring_info *info = &ctx->ring_info;
 	unsigned nr_events = ctx->max_reqs;
 	unsigned long size;
-	int nr_pages;
+	int nr_pages, sq_pages = 0;
 
 	/* Compensate for the ring buffer's head/tail overlap entry */
 	nr_events += 2;	/* 1 is required, 2 for good luck */
@@ -124,6 +127,18 @@ static int aio_setup_ring(struct kioctx *ctx)
 
 	nr_events = (PAGE_SIZE * nr_pages - sizeof(struct aio_ring)) / sizeof(struct io_event);
 
+	/*
+	 * The submission ring follows the completion ring in the same
+	 * mapping.  It is only accessed from the submitter's context, so
+	 * unlike the completion ring its pages are not pinned.
+	 */
+	if (sq_entries) {
+		size = sizeof(struct aio_sq_ring);
+		size += sizeof(struct iocb) * sq_entries;
+		sq_pages = (size + PAGE_SIZE-1) >> PAGE_SHIFT;
+		sq_entries = (PAGE_SIZE * sq_pages - sizeof(struct aio_sq_ring)) / sizeof(struct iocb);
+	}
+
 	info->nr = 0;
 	info->ring_pages = info->internal_pages;
 	if (nr_pages > AIO_RING_PAGES) {
@@ -132,7 +147,7 @@ static int aio_setup_ring(struct kioctx *ctx)
 			return -ENOMEM;
 	}
 
-	info->mmap_size = nr_pages * PAGE_SIZE;
+	info->mmap_size = (nr_pages + sq_pages) * PAGE_SIZE;
 	dprintk("attempting mmap of %lu bytes\n", info->mmap_size);
 	down_write(&ctx->mm->mmap_sem);
 	info->mmap_base = do_mmap(NULL, 0, info->mmap_size, 
@@ -170,6 +185,17 @@ static int aio_setup_ring(struct kioctx *ctx)
 	ring->header_length = sizeof(struct aio_ring);
 	kunmap_atomic(ring, KM_USER0);
 
+	if (sq_entries) {
+		ctx->sq_ring = (struct aio_sq_ring __user *)
+				(info->mmap_base + nr_pages * PAGE_SIZE);
+		if (put_user(sq_entries, &ctx->sq_ring->nr)) {
+			aio_free_ring(ctx);
+			return -EAGAIN;
+		}
+		ctx->sq_nr = sq_entries;
+		ctx->sq_head = 0;
+	}
+
 	return 0;
 }
 
@@ -249,7 +275,7 @@ static inline void put_ioctx(struct kioctx *kioctx)
 /* ioctx_alloc
  *	Allocates and initializes an ioctx.  Returns an ERR_PTR if it failed.
  */
-static struct kioctx *ioctx_alloc(unsigned nr_events)
+static struct kioctx *ioctx_alloc(unsigned nr_events, unsigned sq_entries)
 {
 	struct mm_struct *mm;
 	struct kioctx *ctx;
@@ -261,6 +287,10 @@ static struct kioctx *ioctx_alloc(unsigned nr_events)
 		pr_debug("ENOMEM: nr_events too high\n");
 		return ERR_PTR(-EINVAL);
 	}
+	if (sq_entries > (0x10000000U / sizeof(struct iocb))) {
+		pr_debug("EINVAL: sq_entries too high\n");
+		return ERR_PTR(-EINVAL);
+	}
 
 	if ((unsigned long)nr_events > aio_max_nr)
 		return ERR_PTR(-EAGAIN);
@@ -277,12 +307,13 @@ static struct kioctx *ioctx_alloc(unsigned nr_events)
 	spin_lock_init(&ctx->ctx_lock);
 	spin_lock_init(&ctx->ring_info.ring_lock);
 	init_waitqueue_head(&ctx->wait);
+	mutex_init(&ctx->sq_mutex);
 
 	INIT_LIST_HEAD(&ctx->active_reqs);
 	INIT_LIST_HEAD(&ctx->run_list);
 	INIT_DELAYED_WORK(&ctx->wq, aio_kick_handler);
 
-	if (aio_setup_ring(ctx) < 0)
+	if (aio_setup_ring(ctx, sq_entries) < 0)
 		goto out_freectx;
 
 	/* limit the number of system wide aios */
@@ -458,6 +489,8 @@ static struct kiocb *__aio_get_req(struct kioctx *ctx)
 	req->ki_iovec = NULL;
 	INIT_LIST_HEAD(&req->ki_run_list);
 	req->ki_eventfd = NULL;
+	init_waitqueue_func_entry(&req->ki_wait.wait, aio_wake_function);
+	INIT_LIST_HEAD(&req->ki_wait.wait.task_list);
 
 	/* Check if the completion queue has enough free space to
 	 * accept an event from this io.
@@ -702,6 +735,7 @@ static ssize_t aio_run_iocb(struct kiocb *iocb)
 
 	/* Quit retrying if the i/o has been cancelled */
 	if (kiocbIsCancelled(iocb)) {
+		abort_async_wait(&iocb->ki_wait.wait);
 		ret = -EINTR;
 		aio_complete(iocb, ret, 0);
 		/* must not access the iocb after this */
@@ -710,9 +744,21 @@ static ssize_t aio_run_iocb(struct kiocb *iocb)
 
 	/*
 	 * Now we are all set to call the retry method in async
-	 * context.
+	 * context. Buffered reads and writes queue ki_wait on the
+	 * page they would block on and return -EIOCBRETRY, and
+	 * aio_wake_function() kicks us once it is unlocked.
 	 */
+	current->io_wait = &iocb->ki_wait.wait;
 	ret = retry(iocb);
+	current->io_wait = NULL;
+
+	/*
+	 * The retry may have queued ki_wait and then made progress
+	 * anyway. Make sure no stale wakeup can kick the iocb once
+	 * it's completed.
+	 */
+	if (ret != -EIOCBRETRY)
+		abort_async_wait(&iocb->ki_wait.wait);
 
 	if (ret != -EIOCBRETRY && ret != -EIOCBQUEUED) {
 		/*
@@ -889,6 +935,37 @@ void kick_iocb(struct kiocb *iocb)
 }
 EXPORT_SYMBOL(kick_iocb);
 
+/*
+ * aio_wake_function:
+ *	Wait queue callback for kiocbs waiting on a page bit through
+ *	current->io_wait. Matches the key like wake_bit_function() and
+ *	kicks the iocb for a retry instead of waking a task.
+ *
+ *	Socket operations wait on the file's poll queue instead; these
+ *	have a NULL key.flags and the poll events of interest in
+ *	key.bit_nr, and the wakeup key is a poll mask.
+ */
+static int aio_wake_function(wait_queue_t *wait, unsigned mode,
+			     int sync, void *arg)
+{
+	struct wait_bit_queue *wait_bit
+		= container_of(wait, struct wait_bit_queue, wait);
+	struct kiocb *iocb = container_of(wait_bit, struct kiocb, ki_wait);
+	struct wait_bit_key *key = arg;
+
+	if (!wait_bit->key.flags) {
+		if (key && !((unsigned long)arg & wait_bit->key.bit_nr))
+			return 0;
+	} else if (key && (wait_bit->key.flags != key->flags ||
+			   wait_bit->key.bit_nr != key->bit_nr ||
+			   test_bit(key->bit_nr, key->flags)))
+		return 0;
+
+	list_del_init(&wait->task_list);
+	kick_iocb(iocb);
+	return 1;
+}
+
 /* aio_complete
  *	Called when the io request on the given iocb is complete.
  *	Returns true if this is the last user of the request.  The 
@@ -1252,7 +1329,7 @@ SYSCALL_DEFINE2(io_setup, unsigned, nr_events, aio_context_t __user *, ctxp)
 		goto out;
 	}
 
-	ioctx = ioctx_alloc(nr_events);
+	ioctx = ioctx_alloc(nr_events, 0);
 	ret = PTR_ERR(ioctx);
 	if (!IS_ERR(ioctx)) {
 		ret = put_user(ioctx->user_id, ctxp);
@@ -1418,6 +1495,143 @@ static ssize_t aio_setup_single_vector(struct kiocb *kiocb)
 	return 0;
 }
 
+struct aio_poll_table {
+	poll_table		pt;
+	struct kiocb		*iocb;
+	int			queued;
+};
+
+static void aio_poll_queue_proc(struct file *file, wait_queue_head_t *head,
+				poll_table *pt)
+{
+	struct aio_poll_table *apt = container_of(pt, struct aio_poll_table, pt);
+	wait_queue_t *wait = &apt->iocb->ki_wait.wait;
+
+	/* a kiocb has a single wait entry, sockets use a single queue */
+	if (apt->queued)
+		return;
+	apt->queued = 1;
+	wait->private = head;
+	add_wait_queue(head, wait);
+}
+
+/*
+ * aio_poll_arm:
+ *	Queue the kiocb on the file's poll wait queue so that it is kicked
+ *	once one of @events is signalled.  Returns -EIOCBRETRY if the wait
+ *	was armed, or 0 if the file is already ready and the operation
+ *	should be tried again right away.
+ */
+static ssize_t aio_poll_arm(struct kiocb *iocb, unsigned long events)
+{
+	struct aio_poll_table apt;
+	unsigned int mask;
+
+	events |= POLLERR | POLLHUP;
+	iocb->ki_wait.key.flags = NULL;
+	iocb->ki_wait.key.bit_nr = events;
+
+	init_poll_funcptr(&apt.pt, aio_poll_queue_proc);
+	apt.iocb = iocb;
+	apt.queued = 0;
+	mask = iocb->ki_filp->f_op->poll(iocb->ki_filp, &apt.pt);
+	if (!(mask & events)) {
+		if (apt.queued)
+			return -EIOCBRETRY;
+		return -EAGAIN;
+	}
+	if (apt.queued)
+		abort_async_wait(&iocb->ki_wait.wait);
+	return 0;
+}
+
+/*
+ * aio_sock_cancel:
+ *	A socket kiocb waiting for the socket to become ready is only
+ *	retried after a wakeup, which may never come, so cancellation has
+ *	to complete it here.  One that is queued for a retry is taken off
+ *	the run list.  One that is being retried right now cannot be
+ *	stopped: io_cancel() fails, io_destroy() has it retried once more
+ *	so that it ends up cancelled.
+ */
+static int aio_sock_cancel(struct kiocb *iocb, struct io_event *res)
+{
+	struct kioctx *ctx = iocb->ki_ctx;
+	int ret = 0;
+
+	spin_lock_irq(&ctx->ctx_lock);
+	if (!iocb->ki_run_list.next) {
+		if (ctx->dead)
+			kiocbSetKicked(iocb);
+		else
+			kiocbClearCancelled(iocb);
+		ret = -EAGAIN;
+	} else {
+		/* keep a racing wakeup from queueing it again */
+		kiocbSetKicked(iocb);
+		list_del_init(&iocb->ki_run_list);
+	}
+	spin_unlock_irq(&ctx->ctx_lock);
+
+	if (!ret) {
+		abort_async_wait(&iocb->ki_wait.wait);
+		res->res = -ECANCELED;
+		aio_complete(iocb, -ECANCELED, 0);
+	}
+	aio_put_req(iocb);
+	return ret;
+}
+
+/*
+ * aio_sock_ready:
+ *	Retry method of a socket kiocb that could not make progress at
+ *	submission.  Retries run from the aio workqueue, which has the
+ *	submitter's mm but not its files or credentials, so sendmsg and
+ *	recvmsg are not called from here: the kiocb completes with -EAGAIN
+ *	once the socket is ready, and userspace submits it again.
+ */
+static ssize_t aio_sock_ready(struct kiocb *iocb)
+{
+	bool send = iocb->ki_opcode == IOCB_CMD_SENDMSG;
+	ssize_t ret;
+
+	ret = aio_poll_arm(iocb, send ? POLLOUT : POLLIN);
+	return ret ? ret : -EAGAIN;
+}
+
+/*
+ * aio_sock_retry:
+ *	sendmsg/recvmsg are never allowed to block the submitter.  The
+ *	operation is tried with MSG_DONTWAIT and, if the socket is not
+ *	ready, the kiocb waits on the socket's poll queue until it is
+ *	(see aio_sock_ready()).
+ */
+static ssize_t aio_sock_retry(struct kiocb *iocb)
+{
+	struct file *file = iocb->ki_filp;
+	struct msghdr __user *msg = (struct msghdr __user *)iocb->ki_buf;
+	unsigned int flags = iocb->ki_nbytes;
+	bool send = iocb->ki_opcode == IOCB_CMD_SENDMSG;
+	ssize_t ret;
+
+	for (;;) {
+		if (send)
+			ret = sock_file_sendmsg(file, msg, flags | MSG_DONTWAIT);
+		else
+			ret = sock_file_recvmsg(file, msg, flags | MSG_DONTWAIT);
+		if (ret != -EAGAIN || (flags & MSG_DONTWAIT))
+			return ret;
+
+		ret = aio_poll_arm(iocb, send ? POLLOUT : POLLIN);
+		if (ret == -EIOCBRETRY) {
+			iocb->ki_retry = aio_sock_ready;
+			iocb->ki_cancel = aio_sock_cancel;
+		}
+		if (ret)
+			return ret;
+	}
+}
+
 /*
  * aio_setup_iocb:
  *	Performs the initial checks and aio retry method
@@ -1503,6 +1717,19 @@ static ssize_t aio_setup_iocb(struct kiocb *kiocb, bool compat)
 		if (file->f_op->aio_fsync)
 			kiocb->ki_retry = aio_fsync;
 		break;
+	case IOCB_CMD_SENDMSG:
+	case IOCB_CMD_RECVMSG:
+		ret = -ENOTSOCK;
+		if (!S_ISSOCK(file->f_path.dentry->d_inode->i_mode))
+			break;
+		ret = -EINVAL;
+		if (kiocb->ki_nbytes > UINT_MAX)
+			break;
+		if (compat)
+			kiocb->ki_nbytes |= MSG_CMSG_COMPAT;
+		if (file->f_op->poll)
+			kiocb->ki_retry = aio_sock_retry;
+		break;
 	default:
 		dprintk("EINVAL: io_submit: no operation provided\n");
 		ret = -EINVAL;
@@ -1687,6 +1914,169 @@ SYSCALL_DEFINE3(io_submit, aio_context_t, ctx_id, long, nr,
 	return do_io_submit(ctx_id, nr, iocbpp, 0);
 }
 
+static inline bool aio_compat_task(void)
+{
+#ifdef CONFIG_COMPAT
+	return is_compat_task();
+#else
+	return false;
+#endif
+}
+
+/*
+ * aio_sq_submit:
+ *	Submit up to nr iocbs queued on the submission ring, in order.
+ *	Returns the number of iocbs consumed, or an error if the first
+ *	one could not be submitted; a failed iocb is left on the ring.
+ *	Must be called with ctx->sq_mutex held.
+ */
+static long aio_sq_submit(struct kioctx *ctx, unsigned nr, bool compat)
+{
+	struct aio_sq_ring __user *sq = ctx->sq_ring;
+	unsigned head = ctx->sq_head;
+	unsigned tail;
+	struct blk_plug plug;
+	long ret = 0;
+	unsigned i;
+
+	if (unlikely(get_user(tail, &sq->tail)))
+		return -EFAULT;
+	if (unlikely(tail >= ctx->sq_nr))
+		return -EINVAL;
+	smp_rmb();	/* read the tail before the iocbs it covers */
+
+	blk_start_plug(&plug);
+	for (i = 0; i < nr && head != tail; i++) {
+		struct iocb __user *user_iocb = &sq->iocbs[head];
+		struct iocb tmp;
+
+		if (unlikely(copy_from_user(&tmp, user_iocb, sizeof(tmp)))) {
+			ret = -EFAULT;
+			break;
+		}
+
+		ret = io_submit_one(ctx, user_iocb, &tmp, compat);
+		if (ret)
+			break;
+		head = (head + 1) % ctx->sq_nr;
+	}
+	blk_finish_plug(&plug);
+
+	if (i) {
+		ctx->sq_head = head;
+		smp_mb();	/* finish reading the iocbs before freeing them */
+		if (put_user(head, &sq->head))
+			ret = -EFAULT;
+	}
+	return i ? i : ret;
+}
+
+/* aio_ring_events: number of events waiting on the completion ring */
+static unsigned aio_ring_events(struct kioctx *ctx)
+{
+	struct aio_ring_info *info = &ctx->ring_info;
+	struct aio_ring *ring;
+	unsigned nr;
+
+	ring = kmap_atomic(info->ring_pages[0], KM_USER0);
+	nr = (ring->tail + info->nr - ring->head % info->nr) % info->nr;
+	kunmap_atomic(ring, KM_USER0);
+
+	return nr;
+}
+
+/* sys_io_ring_setup:
+ *	Create an aio context with a submission ring of sq_entries iocbs
+ *	and room for at least cq_entries completions.  Both rings live
+ *	in a single mapping at the returned context address; the
+ *	submission ring starts sq_off bytes into it.  The actual ring
+ *	sizes, which may be rounded up, are written back to *params.
+ *	Fails like io_setup(), and with -EINVAL if either size is zero
+ *	or a reserved field is set.
+ */
+SYSCALL_DEFINE1(io_ring_setup, struct io_ring_params __user *, params)
+{
+	struct io_ring_params p;
+	struct kioctx *ioctx;
+	long ret;
+	int i;
+
+	if (copy_from_user(&p, params, sizeof(p)))
+		return -EFAULT;
+
+	for (i = 0; i < ARRAY_SIZE(p.resv); i++)
+		if (p.resv[i])
+			return -EINVAL;
+	if (!p.sq_entries || !p.cq_entries)
+		return -EINVAL;
+
+	ioctx = ioctx_alloc(p.cq_entries, p.sq_entries);
+	if (IS_ERR(ioctx))
+		return PTR_ERR(ioctx);
+
+	p.sq_entries = ioctx->sq_nr;
+	p.cq_entries = ioctx->max_reqs;
+	p.sq_off = (unsigned long)ioctx->sq_ring - ioctx->user_id;
+	p.ctx = ioctx->user_id;
+
+	ret = -EFAULT;
+	if (!copy_to_user(params, &p, sizeof(p)))
+		return 0;
+
+	get_ioctx(ioctx); /* io_destroy() expects us to hold a ref */
+	io_destroy(ioctx);
+	return ret;
+}
+
+/* sys_io_ring_enter:
+ *	Submit up to to_submit iocbs from the submission ring of ctx_id,
+ *	then wait until at least min_complete events are available on the
+ *	completion ring.  Returns the number of iocbs submitted.  May fail
+ *	like io_submit() if the first iocb could not be submitted, with
+ *	-EINVAL if ctx_id has no submission ring or flags is non-zero, and
+ *	with -EINTR if interrupted while waiting for completions without
+ *	having submitted anything.
+ */
+SYSCALL_DEFINE4(io_ring_enter, aio_context_t, ctx_id, unsigned int, to_submit,
+		unsigned int, min_complete, unsigned int, flags)
+{
+	struct kioctx *ctx;
+	long ret = 0;
+
+	if (unlikely(flags))
+		return -EINVAL;
+
+	ctx = lookup_ioctx(ctx_id);
+	if (unlikely(!ctx))
+		return -EINVAL;
+
+	if (unlikely(!ctx->sq_ring)) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	if (to_submit) {
+		mutex_lock(&ctx->sq_mutex);
+		ret = aio_sq_submit(ctx, to_submit, aio_compat_task());
+		mutex_unlock(&ctx->sq_mutex);
+		if (ret < 0)
+			goto out;
+	}
+
+	if (min_complete) {
+		int err;
+
+		min_complete = min(min_complete, ctx->ring_info.nr - 1);
+		err = wait_event_interruptible(ctx->wait, ctx->dead ||
+				aio_ring_events(ctx) >= min_complete);
+		if (err && !ret)
+			ret = err;
+	}
+out:
+	put_ioctx(ctx);
+	return ret;
+}
+
 /* lookup_kiocb
  *	Finds a given iocb for cancellation.
  */
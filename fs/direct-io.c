@@ -105,6 +105,8 @@ struct dio {
 	unsigned long refcount;		/* direct_io_worker() and bios */
 	struct bio *bio_list;		/* singly linked via bi_private */
 	struct task_struct *waiter;	/* waiting task (NULL if none) */
+	struct request_queue *poll_q;	/* poll here instead of sleeping */
+	ktime_t poll_issued;		/* when the last polled bio went out */
 
 	/* AIO related stuff */
 	struct kiocb *iocb;		/* kiocb */
@@ -411,6 +413,19 @@ static void dio_bio_submit(struct dio *dio)
 	if (dio->is_async && dio->rw == READ)
 		bio_set_pages_dirty(bio);
 
+	/*
+	 * Synchronous IO to a queue that supports it reaps its own
+	 * completions, see dio_await_one().
+	 */
+	if (!dio->is_async) {
+		struct request_queue *q = bdev_get_queue(bio->bi_bdev);
+
+		if (q && blk_queue_poll(q)) {
+			dio->poll_q = q;
+			dio->poll_issued = ktime_get();
+		}
+	}
+
 	if (dio->submit_io)
 		dio->submit_io(dio->rw, bio, dio->inode,
 			       dio->logical_offset_in_bio);
@@ -441,6 +456,7 @@ static struct bio *dio_await_one(struct dio *dio)
 {
 	unsigned long flags;
 	struct bio *bio = NULL;
+	bool polled = false;
 
 	spin_lock_irqsave(&dio->bio_lock, flags);
 
@@ -451,6 +467,22 @@ static struct bio *dio_await_one(struct dio *dio)
 	 * and can call it after testing our condition.
 	 */
 	while (dio->refcount > 1 && dio->bio_list == NULL) {
+		/*
+		 * On a polled queue spin for the completion first, and only
+		 * sleep if the poll budget ran out.
+		 */
+		if (dio->poll_q) {
+			bool found;
+
+			polled = true;
+			spin_unlock_irqrestore(&dio->bio_lock, flags);
+			found = blk_poll(dio->poll_q, dio->poll_issued);
+			spin_lock_irqsave(&dio->bio_lock, flags);
+			if (found)
+				continue;
+			if (dio->refcount == 1 || dio->bio_list)
+				break;
+		}
 		__set_current_state(TASK_UNINTERRUPTIBLE);
 		dio->waiter = current;
 		spin_unlock_irqrestore(&dio->bio_lock, flags);
@@ -464,6 +496,9 @@ static struct bio *dio_await_one(struct dio *dio)
 		dio->bio_list = bio->bi_private;
 	}
 	spin_unlock_irqrestore(&dio->bio_lock, flags);
+
+	if (bio && polled)
+		blk_poll_account(dio->poll_q, dio->poll_issued);
 	return bio;
 }
 
@@ -6,6 +6,7 @@
 #include <linux/aio_abi.h>
 #include <linux/uio.h>
 #include <linux/rcupdate.h>
+#include <linux/mutex.h>
 
 #include <linux/atomic.h>
 
@@ -78,7 +79,8 @@ struct kioctx;
  * If ki_retry returns -EIOCBRETRY it has made a promise that kick_iocb()
  * will be called on the kiocb pointer in the future.  This may happen
  * through generic helpers that associate kiocb->ki_wait with a wait
- * queue head that ki_retry uses via current->io_wait.  It can also happen
+ * queue head that ki_retry uses via current->io_wait, like
+ * wait_on_page_bit_async() and lock_page_async().  It can also happen
  * with custom tracking and manual calls to kick_iocb(), though that is
  * discouraged.  In either case, kick_iocb() must be called once and only
  * once.  ki_retry must ensure forward progress, the AIO core will wait
@@ -118,6 +120,12 @@ struct kiocb {
 	struct list_head	ki_list;	/* the aio core uses this
 						 * for cancellation */
 
+	/*
+	 * Queued on page wait queues while a retry waits for a page to be
+	 * unlocked, see wait_on_page_bit_async().
+	 */
+	struct wait_bit_queue	ki_wait;
+
 	/*
 	 * If the aio_resfd field of the userspace iocb is not zero,
 	 * this is the underlying eventfd context to deliver events to.
@@ -197,6 +205,12 @@ struct kioctx {
 
 	struct aio_ring_info	ring_info;
 
+	/* submission ring, only set up by io_ring_setup() */
+	struct aio_sq_ring __user *sq_ring;
+	unsigned		sq_nr;
+	unsigned		sq_head;	/* trusted copy */
+	struct mutex		sq_mutex;
+
 	struct delayed_work	wq;
 
 	struct rcu_head		rcu_head;
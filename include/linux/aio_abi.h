@@ -44,6 +44,14 @@ enum {
 	IOCB_CMD_NOOP = 6,
 	IOCB_CMD_PREADV = 7,
 	IOCB_CMD_PWRITEV = 8,
+	/*
+	 * aio_buf points to a struct msghdr, aio_nbytes holds the MSG_*
+	 * flags; aio_offset is ignored.  The operation is only attempted
+	 * at submission: if the socket is not ready, the iocb completes
+	 * with -EAGAIN once it is, and has to be submitted again.
+	 */
+	IOCB_CMD_SENDMSG = 9,
+	IOCB_CMD_RECVMSG = 10,
 };
 
 /*
@@ -104,6 +112,35 @@ struct iocb {
 	__u32	aio_resfd;
 }; /* 64 bytes */
 
+/*
+ * Submission ring set up by io_ring_setup().  It lives in the same
+ * mapping as the completion ring, sq_off bytes past the context address.
+ * Userspace fills iocbs[tail], then advances tail; the kernel consumes
+ * entries from head when io_ring_enter() is called and advances head.
+ * Both indices wrap at nr, and the ring is full when tail + 1 == head
+ * (mod nr).
+ *
+ * Completions are posted to the existing completion ring as for
+ * io_submit().  Userspace may reap them directly by reading the events
+ * between the ring head and tail and then advancing head itself, without
+ * calling io_getevents().
+ */
+struct aio_sq_ring {
+	__u32	head;		/* written by the kernel */
+	__u32	tail;		/* written by userspace */
+	__u32	nr;		/* number of iocbs */
+	__u32	flags;
+	struct iocb iocbs[0];
+};
+
+struct io_ring_params {
+	__u32	sq_entries;	/* in: requested, out: actual */
+	__u32	cq_entries;	/* in: requested, out: actual */
+	__u64	sq_off;		/* out: submission ring offset from ctx */
+	__u64	ctx;		/* out: aio_context_t */
+	__u64	resv[4];	/* must be zero */
+};
+
 #undef IFBIG
 #undef IFLITTLE
 
@@ -0,0 +1,64 @@
+/*
+ * Key/value maps for internal BPF programs
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2
+ * of the License.
+ */
+#ifndef _LINUX_BPF_H
+#define _LINUX_BPF_H
+
+#include <linux/types.h>
+#include <linux/atomic.h>
+
+enum bpf_map_type {
+	BPF_MAP_TYPE_UNSPEC,
+	BPF_MAP_TYPE_HASH,
+};
+
+/* flags for bpf_map_update_elem() */
+#define BPF_ANY		0	/* create new element or update existing */
+#define BPF_NOEXIST	1	/* create new element only */
+#define BPF_EXIST	2	/* update existing element only */
+
+struct bpf_map;
+
+struct bpf_map_ops {
+	void (*map_free)(struct bpf_map *map);
+	void *(*map_lookup_elem)(struct bpf_map *map, void *key);
+	int (*map_update_elem)(struct bpf_map *map, void *key, void *value,
+			       u64 flags);
+	int (*map_delete_elem)(struct bpf_map *map, void *key);
+};
+
+struct bpf_map {
+	atomic_t		refcnt;
+	enum bpf_map_type	map_type;
+	u32			key_size;
+	u32			value_size;
+	u32			max_entries;
+	const struct bpf_map_ops *ops;
+};
+
+extern struct bpf_map *bpf_map_create(enum bpf_map_type type, u32 key_size,
+				      u32 value_size, u32 max_entries);
+extern void bpf_map_put(struct bpf_map *map);
+
+static inline void bpf_map_get(struct bpf_map *map)
+{
+	atomic_inc(&map->refcnt);
+}
+
+/*
+ * Helpers callable from internal BPF programs with BPF_EMIT_CALL().
+ * R1 holds the map pointer, R2 a pointer to the key and, for updates,
+ * R3 a pointer to the value and R4 the BPF_ANY/NOEXIST/EXIST flags.
+ * Lookups return a pointer to the value, or 0, which stays valid for
+ * the rest of the program run.
+ */
+extern u64 bpf_map_lookup_elem(u64 r1, u64 r2, u64 r3, u64 r4, u64 r5);
+extern u64 bpf_map_update_elem(u64 r1, u64 r2, u64 r3, u64 r4, u64 r5);
+extern u64 bpf_map_delete_elem(u64 r1, u64 r2, u64 r3, u64 r4, u64 r5);
+
+#endif /* _LINUX_BPF_H */
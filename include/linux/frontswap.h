@@ -0,0 +1,118 @@
+#ifndef _LINUX_FRONTSWAP_H
+#define _LINUX_FRONTSWAP_H
+
+#include <linux/swap.h>
+#include <linux/mm.h>
+#include <linux/bitops.h>
+
+/*
+ * A frontswap backend gets a chance to keep every page swap_writepage()
+ * is about to write, keyed by swap type and offset.  Pages it accepts
+ * never reach the swap device unless the backend writes them back itself.
+ */
+struct frontswap_ops {
+	void (*init)(unsigned);
+	int (*put_page)(unsigned, pgoff_t, struct page *);
+	int (*get_page)(unsigned, pgoff_t, struct page *);
+	void (*flush_page)(unsigned, pgoff_t);
+	void (*flush_area)(unsigned);
+};
+
+extern struct frontswap_ops
+	frontswap_register_ops(struct frontswap_ops *ops);
+extern unsigned long frontswap_curr_pages(void);
+
+extern void __frontswap_init(unsigned type);
+extern int __frontswap_put_page(struct page *page);
+extern int __frontswap_get_page(struct page *page);
+extern void __frontswap_flush_page(struct swap_info_struct *sis,
+				   pgoff_t offset);
+extern void __frontswap_flush_area(struct swap_info_struct *sis);
+
+#ifdef CONFIG_FRONTSWAP
+extern bool frontswap_enabled;
+
+static inline bool frontswap_test(struct swap_info_struct *sis,
+				  pgoff_t offset)
+{
+	return sis->frontswap_map && test_bit(offset, sis->frontswap_map);
+}
+
+static inline unsigned long *frontswap_map_get(struct swap_info_struct *sis)
+{
+	return sis->frontswap_map;
+}
+
+static inline void frontswap_map_set(struct swap_info_struct *sis,
+				     unsigned long *map)
+{
+	sis->frontswap_map = map;
+}
+#else
+/* all inline routines become no-ops and all externs are ignored */
+
+#define frontswap_enabled (0)
+
+static inline bool frontswap_test(struct swap_info_struct *sis,
+				  pgoff_t offset)
+{
+	return false;
+}
+
+static inline unsigned long *frontswap_map_get(struct swap_info_struct *sis)
+{
+	return NULL;
+}
+
+static inline void frontswap_map_set(struct swap_info_struct *sis,
+				     unsigned long *map)
+{
+}
+#endif
+
+/*
+ * As with cleancache, the hooks collapse to a single global variable
+ * check when no backend has registered, and to nothing at all when
+ * CONFIG_FRONTSWAP is off.  __frontswap_init() is not conditional: it
+ * records the swap type so that a backend registering later still gets
+ * its init call.
+ */
+static inline void frontswap_init(unsigned type)
+{
+#ifdef CONFIG_FRONTSWAP
+	__frontswap_init(type);
+#endif
+}
+
+static inline int frontswap_put_page(struct page *page)
+{
+	int ret = -1;
+
+	if (frontswap_enabled)
+		ret = __frontswap_put_page(page);
+	return ret;
+}
+
+static inline int frontswap_get_page(struct page *page)
+{
+	int ret = -1;
+
+	if (frontswap_enabled)
+		ret = __frontswap_get_page(page);
+	return ret;
+}
+
+static inline void frontswap_flush_page(struct swap_info_struct *sis,
+					pgoff_t offset)
+{
+	if (frontswap_enabled)
+		__frontswap_flush_page(sis, offset);
+}
+
+static inline void frontswap_flush_area(struct swap_info_struct *sis)
+{
+	if (frontswap_enabled)
+		__frontswap_flush_area(sis);
+}
+
+#endif /* _LINUX_FRONTSWAP_H */
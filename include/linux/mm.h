@@ -1499,6 +1499,35 @@ static inline pgprot_t vm_get_page_prot(unsigned long vm_flags)
 }
 #endif
 
+#ifdef CONFIG_NUMA_BALANCING
+/*
+ * NUMA hinting faults are taken on ptes that are made PROT_NONE while
+ * the vma itself still allows access.  The cache attributes of the
+ * mapping are preserved so that restoring vm_page_prot is lossless.
+ */
+static inline pgprot_t vma_prot_none(struct vm_area_struct *vma)
+{
+	return pgprot_modify(vma->vm_page_prot, vm_get_page_prot(0));
+}
+
+static inline int pte_numa(struct vm_area_struct *vma, pte_t pte)
+{
+	/* A PROT_NONE vma faults for real; it never takes hinting faults */
+	if (!(vma->vm_flags & (VM_READ | VM_WRITE | VM_EXEC)))
+		return 0;
+
+	return pte_same(pte, pte_modify(pte, vma_prot_none(vma)));
+}
+
+extern unsigned long change_prot_numa(struct vm_area_struct *vma,
+			unsigned long start, unsigned long end);
+#else
+static inline int pte_numa(struct vm_area_struct *vma, pte_t pte)
+{
+	return 0;
+}
+#endif
+
 struct vm_area_struct *find_extend_vma(struct mm_struct *, unsigned long addr);
 int remap_pfn_range(struct vm_area_struct *, unsigned long addr,
 			unsigned long pfn, unsigned long size, pgprot_t);
@@ -22,26 +22,32 @@ static inline int page_is_file_cache(struct page *page)
 }
 
 static inline void
-__add_page_to_lru_list(struct zone *zone, struct page *page, enum lru_list l,
-		       struct list_head *head)
+update_lru_size(struct lruvec *lruvec, enum lru_list l, int nr_pages)
+{
+	__mod_zone_page_state(lruvec->zone, NR_LRU_BASE + l, nr_pages);
+	lruvec->lru_size[l] += nr_pages;
+}
+
+static inline void
+__add_page_to_lru_list(struct page *page, struct lruvec *lruvec,
+		       enum lru_list l, struct list_head *head)
 {
 	list_add(&page->lru, head);
-	__mod_zone_page_state(zone, NR_LRU_BASE + l, hpage_nr_pages(page));
-	mem_cgroup_add_lru_list(page, l);
+	update_lru_size(lruvec, l, hpage_nr_pages(page));
 }
 
 static inline void
-add_page_to_lru_list(struct zone *zone, struct page *page, enum lru_list l)
+add_page_to_lru_list(struct page *page, struct lruvec *lruvec, enum lru_list l)
 {
-	__add_page_to_lru_list(zone, page, l, &zone->lru[l].list);
+	__add_page_to_lru_list(page, lruvec, l, &lruvec->lists[l]);
 }
 
 static inline void
-del_page_from_lru_list(struct zone *zone, struct page *page, enum lru_list l)
+del_page_from_lru_list(struct page *page, struct lruvec *lruvec,
+		       enum lru_list l)
 {
 	list_del(&page->lru);
-	__mod_zone_page_state(zone, NR_LRU_BASE + l, -hpage_nr_pages(page));
-	mem_cgroup_del_lru_list(page, l);
+	update_lru_size(lruvec, l, -hpage_nr_pages(page));
 }
 
 /**
@@ -60,7 +66,7 @@ static inline enum lru_list page_lru_base_type(struct page *page)
 }
 
 static inline void
-del_page_from_lru(struct zone *zone, struct page *page)
+del_page_from_lru(struct page *page, struct lruvec *lruvec)
 {
 	enum lru_list l;
 
@@ -75,8 +81,7 @@ del_page_from_lru(struct zone *zone, struct page *page)
 			l += LRU_ACTIVE;
 		}
 	}
-	__mod_zone_page_state(zone, NR_LRU_BASE + l, -hpage_nr_pages(page));
-	mem_cgroup_del_lru_list(page, l);
+	update_lru_size(lruvec, l, -hpage_nr_pages(page));
 }
 
 /**
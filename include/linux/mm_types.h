@@ -93,7 +93,7 @@ struct page {
 
 	/* Third double word block */
 	struct list_head lru;		/* Pageout list, eg. active_list
-					 * protected by zone->lru_lock !
+					 * protected by lruvec->lru_lock !
 					 */
 
 	/* Remainder is not double word aligned */
@@ -362,6 +362,17 @@ struct mm_struct {
 #ifdef CONFIG_CPUMASK_OFFSTACK
 	struct cpumask cpumask_allocation;
 #endif
+#ifdef CONFIG_NUMA_BALANCING
+	/*
+	 * numa_next_scan is the next time (in jiffies) a task of this mm
+	 * is allowed to scan its address space for NUMA hinting faults;
+	 * numa_scan_offset is where that scan resumes and numa_scan_seq
+	 * counts completed passes, so that tasks can tell a pass finished.
+	 */
+	unsigned long numa_next_scan;
+	unsigned long numa_scan_offset;
+	int numa_scan_seq;
+#endif
 };
 
 static inline void mm_init_cpumask(struct mm_struct *mm)
@@ -0,0 +1,70 @@
+#ifndef __PERCPU_IDA_H__
+#define __PERCPU_IDA_H__
+
+/*
+ * Scalable tag allocator.
+ *
+ * Hands out integer ids in [0, nr_tags). Each CPU keeps a small cache of
+ * free ids, refilled from and spilled to a global freelist in batches, so
+ * the common alloc/free pair touches only per-cpu data. When a CPU runs
+ * dry it steals the cache of another CPU before giving up or sleeping.
+ */
+
+#include <linux/types.h>
+#include <linux/bitops.h>
+#include <linux/spinlock_types.h>
+#include <linux/wait.h>
+#include <linux/cpumask.h>
+
+struct percpu_ida_cpu;
+
+struct percpu_ida {
+	/*
+	 * number of tags available to be allocated, as passed to
+	 * percpu_ida_init()
+	 */
+	unsigned			nr_tags;
+
+	struct percpu_ida_cpu __percpu	*tag_cpu;
+
+	/*
+	 * Bitmap of cpus that (may) have tags on their percpu freelists:
+	 * steal_tags() uses this to decide when to steal tags, and which cpus
+	 * to try stealing from.
+	 *
+	 * It's ok for a freelist to be empty when its bit is set - steal_tags()
+	 * will just keep looking - but the bitmap _must_ be set whenever a
+	 * percpu freelist does have tags.
+	 */
+	cpumask_t			cpus_have_tags;
+
+	struct {
+		spinlock_t		lock;
+		/*
+		 * When we go to steal tags from another cpu (see steal_tags()),
+		 * we want to pick a cpu we think is relatively likely to have
+		 * tags: cpu_last_stolen records the last cpu we stole from.
+		 */
+		unsigned		cpu_last_stolen;
+
+		/* For sleeping on allocation failure */
+		wait_queue_head_t	wait;
+
+		/*
+		 * Global freelist - it's a stack where nr_free points to the
+		 * top
+		 */
+		unsigned		nr_free;
+		unsigned		*freelist;
+	} ____cacheline_aligned_in_smp;
+};
+
+int percpu_ida_alloc(struct percpu_ida *pool, gfp_t gfp);
+void percpu_ida_free(struct percpu_ida *pool, unsigned tag);
+
+void percpu_ida_destroy(struct percpu_ida *pool);
+int percpu_ida_init(struct percpu_ida *pool, unsigned long nr_tags);
+
+unsigned percpu_ida_free_tags(struct percpu_ida *pool);
+
+#endif /* __PERCPU_IDA_H__ */
@@ -84,12 +84,21 @@
 #define OP_RETA	(BPF_RET | BPF_A)
 #define OP_RETK	(BPF_RET | BPF_K)
 
-static inline int ptp_filter_init(struct sock_filter *f, int len)
+/*
+ * Build the classifier in *@pfp from the classic program @f, unless an
+ * earlier call has already done so.
+ */
+static inline int ptp_filter_init(struct sk_filter **pfp,
+				  struct sock_filter *f, int len)
 {
-	if (OP_LDH == f[0].code)
-		return sk_chk_filter(f, len);
-	else
+	struct sock_fprog_kern fprog = {
+		.len = len,
+		.filter = f,
+	};
+
+	if (*pfp)
 		return 0;
+	return sk_unattached_filter_create(pfp, &fprog);
 }
 
 #define PTP_FILTER \
@@ -0,0 +1,149 @@
+/*
+ *	Definitions for the 'struct ptr_ring' datastructure.
+ *
+ *	A fixed size FIFO of pointers, implemented as an array ring with
+ *	separate producer and consumer indices. A NULL slot means "free",
+ *	so the producer and the consumer never have to look at each
+ *	other's index and their cache lines are not shared.
+ *
+ *	Producers are serialized by producer_lock. There is no consumer
+ *	lock: callers must guarantee that only one context consumes at a
+ *	time (for example by owning a "running" bit), and that the ring is
+ *	not consumed concurrently with ptr_ring_cleanup().
+ *
+ *	NULL pointers can not be queued.
+ *
+ *	This program is free software; you can redistribute it and/or
+ *	modify it under the terms of the GNU General Public License
+ *	as published by the Free Software Foundation; either version
+ *	2 of the License, or (at your option) any later version.
+ */
+
+#ifndef _LINUX_PTR_RING_H
+#define _LINUX_PTR_RING_H
+
+#ifdef __KERNEL__
+#include <linux/spinlock.h>
+#include <linux/cache.h>
+#include <linux/types.h>
+#include <linux/compiler.h>
+#include <linux/slab.h>
+#include <asm/errno.h>
+#include <asm/system.h>
+
+struct ptr_ring {
+	int producer ____cacheline_aligned_in_smp;
+	spinlock_t producer_lock;
+	int consumer ____cacheline_aligned_in_smp;
+	/* Shared consumer/producer data */
+	int size ____cacheline_aligned_in_smp; /* max entries in queue */
+	void **queue;
+};
+
+/* Callers must hold producer_lock. */
+static inline int __ptr_ring_produce(struct ptr_ring *r, void *ptr)
+{
+	if (unlikely(!r->size) || r->queue[r->producer])
+		return -ENOSPC;
+
+	/* Make sure the pointer we are storing points to valid data:
+	 * pairs with the dependency barrier in __ptr_ring_peek().
+	 */
+	smp_wmb();
+
+	ACCESS_ONCE(r->queue[r->producer]) = ptr;
+	if (unlikely(++r->producer >= r->size))
+		r->producer = 0;
+	return 0;
+}
+
+/* Returns -ENOSPC if the ring is full. Callers that may race with a
+ * producer running in softirq context on the same cpu must have BH
+ * disabled.
+ */
+static inline int ptr_ring_produce(struct ptr_ring *r, void *ptr)
+{
+	int ret;
+
+	spin_lock(&r->producer_lock);
+	ret = __ptr_ring_produce(r, ptr);
+	spin_unlock(&r->producer_lock);
+
+	return ret;
+}
+
+/* Consumer side: see the single consumer rule above. */
+static inline void *__ptr_ring_peek(struct ptr_ring *r)
+{
+	void *ptr = NULL;
+
+	if (likely(r->size)) {
+		ptr = ACCESS_ONCE(r->queue[r->consumer]);
+		smp_read_barrier_depends();
+	}
+	return ptr;
+}
+
+static inline bool __ptr_ring_empty(struct ptr_ring *r)
+{
+	return !__ptr_ring_peek(r);
+}
+
+static inline void *__ptr_ring_consume(struct ptr_ring *r)
+{
+	void *ptr = __ptr_ring_peek(r);
+
+	if (ptr) {
+		ACCESS_ONCE(r->queue[r->consumer]) = NULL;
+		if (unlikely(++r->consumer >= r->size))
+			r->consumer = 0;
+	}
+	return ptr;
+}
+
+/* Number of queued entries. Lockless and racy, only meant for
+ * statistics.
+ */
+static inline int ptr_ring_count(struct ptr_ring *r)
+{
+	int producer = ACCESS_ONCE(r->producer);
+	int consumer = ACCESS_ONCE(r->consumer);
+	int count = producer - consumer;
+
+	if (count < 0)
+		count += r->size;
+	else if (!count && r->size && ACCESS_ONCE(r->queue[consumer]))
+		count = r->size;
+	return count;
+}
+
+static inline int ptr_ring_init(struct ptr_ring *r, int size, gfp_t gfp)
+{
+	r->queue = kcalloc(size, sizeof(void *), gfp);
+	if (!r->queue)
+		return -ENOMEM;
+
+	r->size = size;
+	r->producer = r->consumer = 0;
+	spin_lock_init(&r->producer_lock);
+
+	return 0;
+}
+
+/* Frees the ring, calling @destroy on every entry still queued.
+ * Must not race with producers or the consumer.
+ */
+static inline void ptr_ring_cleanup(struct ptr_ring *r, void (*destroy)(void *))
+{
+	void *ptr;
+
+	if (destroy)
+		while ((ptr = __ptr_ring_consume(r)))
+			destroy(ptr);
+	kfree(r->queue);
+	r->queue = NULL;
+	r->size = 0;
+}
+
+#endif /* __KERNEL__ */
+#endif /* _LINUX_PTR_RING_H */
@@ -1474,6 +1474,13 @@ struct task_struct {
 
 	struct io_context *io_context;
 
+/*
+ * Set while an AIO retry runs on behalf of this task: page waits queue
+ * this entry and return -EIOCBRETRY instead of sleeping. Always embedded
+ * in a struct wait_bit_queue, see wait_on_page_bit_async().
+ */
+	wait_queue_t *io_wait;
+
 	unsigned long ptrace_message;
 	siginfo_t *last_siginfo; /* For ptrace use.  */
 	struct task_io_accounting ioac;
@@ -1512,6 +1519,21 @@ struct task_struct {
 	short il_next;
 	short pref_node_fork;
 #endif
+#ifdef CONFIG_NUMA_BALANCING
+	int numa_scan_seq;
+	unsigned int numa_scan_period;
+	u64 node_stamp;			/* migration stamp  */
+	int numa_preferred_nid;
+	int numa_work_pending;
+
+	/*
+	 * numa_faults[nid] is the decayed number of hinting faults the task
+	 * took on memory of node nid; the second half of the array collects
+	 * the faults of the current scan pass until task_numa_placement()
+	 * folds them in.
+	 */
+	unsigned long *numa_faults;
+#endif /* CONFIG_NUMA_BALANCING */
 	struct rcu_head rcu;
 
 	/*
@@ -1992,6 +2014,25 @@ enum sched_tunable_scaling {
 };
 extern enum sched_tunable_scaling sysctl_sched_tunable_scaling;
 
+#ifdef CONFIG_NUMA_BALANCING
+extern unsigned int sysctl_numa_balancing;
+extern unsigned int sysctl_numa_balancing_scan_delay;
+extern unsigned int sysctl_numa_balancing_scan_period_min;
+extern unsigned int sysctl_numa_balancing_scan_period_max;
+extern unsigned int sysctl_numa_balancing_scan_size;
+
+extern void task_numa_fault(int node, int pages, bool migrated);
+extern void task_numa_work(void);
+extern void task_numa_free(struct task_struct *p);
+#else
+static inline void task_numa_fault(int node, int pages, bool migrated)
+{
+}
+static inline void task_numa_free(struct task_struct *p)
+{
+}
+#endif
+
 #ifdef CONFIG_SCHED_DEBUG
 extern unsigned int sysctl_sched_migration_cost;
 extern unsigned int sysctl_sched_nr_migrate;
@@ -56,6 +56,13 @@ struct inet_peer {
 		struct inet_peer	*gc_next;
 	};
 
+	/* TCP Fast Open client state, under tcp_fastopen_cache_get/set() */
+	unsigned long		tfo_last_syn_loss;
+	u16			tfo_mss;
+	u8			tfo_syn_loss;
+	s8			tfo_cookie_len;	/* 0 if none */
+	u8			tfo_cookie[16];	/* TCP_FASTOPEN_COOKIE_MAX */
+
 	/* following fields might be frequently dirtied */
 	__u32			dtime;	/* the time of last use of not referenced entries */
 	atomic_t		refcnt;
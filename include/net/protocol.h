@@ -100,6 +100,18 @@ extern int	inet_del_protocol(const struct net_protocol *prot, unsigned char num)
 extern void	inet_register_protosw(struct inet_protosw *p);
 extern void	inet_unregister_protosw(struct inet_protosw *p);
 
+/* Offload helpers for protocols tunnelling IPv4 */
+extern struct sk_buff *inet_tunnel_gso_segment(struct sk_buff *skb,
+					       u32 features,
+					       unsigned int tnl_hlen,
+					       __be16 inner_proto);
+extern struct sk_buff **inet_tunnel_gro_receive(struct sk_buff **head,
+						struct sk_buff *skb,
+						const void *tnl_hdr,
+						unsigned int tnl_hlen);
+extern int	inet_tunnel_gro_complete(struct sk_buff *skb,
+					 unsigned int nhoff);
+
 #if defined(CONFIG_IPV6) || defined (CONFIG_IPV6_MODULE)
 extern int	inet6_add_protocol(const struct inet6_protocol *prot, unsigned char num);
 extern int	inet6_del_protocol(const struct inet6_protocol *prot, unsigned char num);
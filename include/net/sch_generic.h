@@ -26,6 +26,8 @@ enum qdisc_state_t {
 	__QDISC_STATE_SCHED,
 	__QDISC_STATE_DEACTIVATED,
 	__QDISC_STATE_THROTTLED,
+	__QDISC_STATE_RUNNING,		/* TCQ_F_NOLOCK qdiscs only */
+	__QDISC_STATE_MISSED,		/* TCQ_F_NOLOCK qdiscs only */
 };
 
 /*
@@ -51,6 +53,7 @@ struct Qdisc {
 #define TCQ_F_INGRESS		2
 #define TCQ_F_CAN_BYPASS	4
 #define TCQ_F_MQROOT		8
+#define TCQ_F_NOLOCK		0x10 /* qdisc does not require locking */
 #define TCQ_F_WARN_NONWC	(1 << 16)
 	int			padded;
 	struct Qdisc_ops	*ops;
@@ -88,11 +91,29 @@ struct Qdisc {
 
 static inline bool qdisc_is_running(const struct Qdisc *qdisc)
 {
+	if (qdisc->flags & TCQ_F_NOLOCK)
+		return test_bit(__QDISC_STATE_RUNNING, &qdisc->state);
 	return (qdisc->__state & __QDISC___STATE_RUNNING) ? true : false;
 }
 
+/*
+ * Lockless qdiscs (TCQ_F_NOLOCK) are enqueued to without the root lock,
+ * so the RUNNING bit must be taken atomically. A cpu that loses the race
+ * sets MISSED, and the owner reschedules the qdisc on its way out: the
+ * owner may already have seen an empty queue before our enqueue.
+ */
 static inline bool qdisc_run_begin(struct Qdisc *qdisc)
 {
+	if (qdisc->flags & TCQ_F_NOLOCK) {
+		if (!test_and_set_bit(__QDISC_STATE_RUNNING, &qdisc->state))
+			return true;
+		set_bit(__QDISC_STATE_MISSED, &qdisc->state);
+		smp_mb();
+		/* Retry in case the owner cleared RUNNING before MISSED
+		 * became visible to it.
+		 */
+		return !test_and_set_bit(__QDISC_STATE_RUNNING, &qdisc->state);
+	}
 	if (qdisc_is_running(qdisc))
 		return false;
 	qdisc->__state |= __QDISC___STATE_RUNNING;
@@ -101,6 +122,15 @@ static inline bool qdisc_run_begin(struct Qdisc *qdisc)
 
 static inline void qdisc_run_end(struct Qdisc *qdisc)
 {
+	if (qdisc->flags & TCQ_F_NOLOCK) {
+		smp_mb__before_clear_bit();
+		clear_bit(__QDISC_STATE_RUNNING, &qdisc->state);
+		smp_mb__after_clear_bit();
+		if (unlikely(test_and_clear_bit(__QDISC_STATE_MISSED,
+						&qdisc->state)))
+			__netif_schedule(qdisc);
+		return;
+	}
 	qdisc->__state &= ~__QDISC___STATE_RUNNING;
 }
 
@@ -297,6 +327,7 @@ static inline void sch_tree_unlock(struct Qdisc *q)
 extern struct Qdisc noop_qdisc;
 extern struct Qdisc_ops noop_qdisc_ops;
 extern struct Qdisc_ops pfifo_fast_ops;
+extern struct Qdisc_ops pfifo_fast_nolock_ops;
 extern struct Qdisc_ops mq_qdisc_ops;
 
 struct Qdisc_class_common {
@@ -347,6 +378,7 @@ extern void dev_deactivate_many(struct list_head *head);
 extern struct Qdisc *dev_graft_qdisc(struct netdev_queue *dev_queue,
 				     struct Qdisc *qdisc);
 extern void qdisc_reset(struct Qdisc *qdisc);
+extern void qdisc_nolock_qstats(struct Qdisc *qdisc);
 extern void qdisc_destroy(struct Qdisc *qdisc);
 extern void qdisc_tree_decrease_qlen(struct Qdisc *qdisc, unsigned int n);
 extern struct Qdisc *qdisc_alloc(struct netdev_queue *dev_queue,
@@ -160,6 +160,31 @@ void abort_exclusive_wait(wait_queue_head_t *q, wait_queue_t *wait,
 }
 EXPORT_SYMBOL(abort_exclusive_wait);
 
+/**
+ * abort_async_wait - stop waiting asynchronously
+ * @wait: wait descriptor, with ->private pointing to the queue it was
+ *        last added to (or %NULL)
+ *
+ * Asynchronous waiters are not tied to a sleeping task, they stay queued
+ * after the waiter returned and have their wake function do the work.
+ * Removes @wait from its queue if it is still there, after which its
+ * wake function will not be called any more.
+ */
+void abort_async_wait(wait_queue_t *wait)
+{
+	wait_queue_head_t *q = wait->private;
+	unsigned long flags;
+
+	if (!q)
+		return;
+
+	spin_lock_irqsave(&q->lock, flags);
+	if (!list_empty(&wait->task_list))
+		list_del_init(&wait->task_list);
+	spin_unlock_irqrestore(&q->lock, flags);
+}
+EXPORT_SYMBOL(abort_async_wait);
+
 int autoremove_wake_function(wait_queue_t *wait, unsigned mode, int sync, void *key)
 {
 	int ret = default_wake_function(wait, mode, sync, key);
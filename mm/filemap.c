@@ -91,8 +91,8 @@
  *    ->swap_lock		(try_to_unmap_one)
  *    ->private_lock		(try_to_unmap_one)
  *    ->tree_lock		(try_to_unmap_one)
- *    ->zone.lru_lock		(follow_page->mark_page_accessed)
- *    ->zone.lru_lock		(check_pte_range->isolate_lru_page)
+ *    ->lruvec.lru_lock	(follow_page->mark_page_accessed)
+ *    ->lruvec.lru_lock	(check_pte_range->isolate_lru_page)
  *    ->private_lock		(page_remove_rmap->set_page_dirty)
  *    ->tree_lock		(page_remove_rmap->set_page_dirty)
  *    bdi.wb->list_lock		(page_remove_rmap->set_page_dirty)
@@ -106,12 +106,45 @@
  *    ->i_mmap_mutex
  */
 
+static void page_cache_tree_delete(struct address_space *mapping,
+				   struct page *page, void *shadow)
+{
+	void **slot;
+	int tag;
+
+	if (!shadow) {
+		radix_tree_delete(&mapping->page_tree, page->index);
+		return;
+	}
+
+	/*
+	 * Leave the shadow entry in the slot the page occupied.  Reclaim
+	 * only evicts clean pages that are not under writeback, but make
+	 * sure no stale tag is left on the slot either.
+	 */
+	slot = radix_tree_lookup_slot(&mapping->page_tree, page->index);
+	for (tag = 0; tag < RADIX_TREE_MAX_TAGS; tag++) {
+		if (radix_tree_tagged(&mapping->page_tree, tag))
+			radix_tree_tag_clear(&mapping->page_tree,
+					     page->index, tag);
+	}
+	radix_tree_replace_slot(slot, shadow);
+	mapping->nrshadows++;
+	/*
+	 * Make sure the nrshadows update is committed before the nrpages
+	 * update so that final truncate racing with reclaim does not see
+	 * both counters 0 at the same time and miss a shadow entry.
+	 */
+	smp_wmb();
+}
+
 /*
  * Delete a page from the page cache and free it. Caller has to make
  * sure the page is locked and that nobody else uses it - or that usage
- * is safe.  The caller must hold the mapping's tree_lock.
+ * is safe.  The caller must hold the mapping's tree_lock.  If @shadow
+ * is not NULL, it is left in the page's slot to detect a later refault.
  */
-void __delete_from_page_cache(struct page *page)
+void __delete_from_page_cache(struct page *page, void *shadow)
 {
 	struct address_space *mapping = page->mapping;
 
@@ -125,7 +158,7 @@ void __delete_from_page_cache(struct page *page)
 	else
 		cleancache_flush_page(mapping, page);
 
-	radix_tree_delete(&mapping->page_tree, page->index);
+	page_cache_tree_delete(mapping, page, shadow);
 	page->mapping = NULL;
 	/* Leave page->index set: truncation lookup relies upon it */
 	mapping->nrpages--;
@@ -164,7 +197,7 @@ void delete_from_page_cache(struct page *page)
 
 	freepage = mapping->a_ops->freepage;
 	spin_lock_irq(&mapping->tree_lock);
-	__delete_from_page_cache(page);
+	__delete_from_page_cache(page, NULL);
 	spin_unlock_irq(&mapping->tree_lock);
 	mem_cgroup_uncharge_cache_page(page);
 
@@ -424,7 +457,7 @@ int replace_page_cache_page(struct page *old, struct page *new, gfp_t gfp_mask)
 		new->index = offset;
 
 		spin_lock_irq(&mapping->tree_lock);
-		__delete_from_page_cache(old);
+		__delete_from_page_cache(old, NULL);
 		error = radix_tree_insert(&mapping->page_tree, offset, new);
 		BUG_ON(error);
 		mapping->nrpages++;
@@ -445,18 +478,41 @@ int replace_page_cache_page(struct page *old, struct page *new, gfp_t gfp_mask)
 }
 EXPORT_SYMBOL_GPL(replace_page_cache_page);
 
-/**
- * add_to_page_cache_locked - add a locked page to the pagecache
- * @page:	page to add
- * @mapping:	the page's address_space
- * @offset:	page index
- * @gfp_mask:	page allocation mode
- *
- * This function is used to add a page to the pagecache. It must be locked.
- * This function does not add the page to the LRU.  The caller must do that.
+/*
+ * Insert @page at its index, replacing the shadow entry of a previously
+ * evicted page if there is one.  The shadow entry is passed back in
+ * @shadowp when that is not NULL.  Caller must hold the tree_lock.
  */
-int add_to_page_cache_locked(struct page *page, struct address_space *mapping,
-		pgoff_t offset, gfp_t gfp_mask)
+static int page_cache_tree_insert(struct address_space *mapping,
+				  struct page *page, void **shadowp)
+{
+	void **slot;
+	int error;
+
+	slot = radix_tree_lookup_slot(&mapping->page_tree, page->index);
+	if (slot) {
+		void *p;
+
+		p = radix_tree_deref_slot_protected(slot, &mapping->tree_lock);
+		if (!radix_tree_exceptional_entry(p))
+			return -EEXIST;
+		radix_tree_replace_slot(slot, page);
+		mapping->nrshadows--;
+		mapping->nrpages++;
+		if (shadowp)
+			*shadowp = p;
+		return 0;
+	}
+	error = radix_tree_insert(&mapping->page_tree, page->index, page);
+	if (!error)
+		mapping->nrpages++;
+	return error;
+}
+
+static int __add_to_page_cache_locked(struct page *page,
+				      struct address_space *mapping,
+				      pgoff_t offset, gfp_t gfp_mask,
+				      void **shadowp)
 {
 	int error;
 
@@ -475,9 +531,8 @@ int add_to_page_cache_locked(struct page *page, struct address_space *mapping,
 		page->index = offset;
 
 		spin_lock_irq(&mapping->tree_lock);
-		error = radix_tree_insert(&mapping->page_tree, offset, page);
+		error = page_cache_tree_insert(mapping, page, shadowp);
 		if (likely(!error)) {
-			mapping->nrpages++;
 			__inc_zone_page_state(page, NR_FILE_PAGES);
 			spin_unlock_irq(&mapping->tree_lock);
 		} else {
@@ -493,15 +548,47 @@ int add_to_page_cache_locked(struct page *page, struct address_space *mapping,
 out:
 	return error;
 }
+
+/**
+ * add_to_page_cache_locked - add a locked page to the pagecache
+ * @page:	page to add
+ * @mapping:	the page's address_space
+ * @offset:	page index
+ * @gfp_mask:	page allocation mode
+ *
+ * This function is used to add a page to the pagecache. It must be locked.
+ * This function does not add the page to the LRU.  The caller must do that.
+ */
+int add_to_page_cache_locked(struct page *page, struct address_space *mapping,
+		pgoff_t offset, gfp_t gfp_mask)
+{
+	return __add_to_page_cache_locked(page, mapping, offset,
+					  gfp_mask, NULL);
+}
 EXPORT_SYMBOL(add_to_page_cache_locked);
 
 int add_to_page_cache_lru(struct page *page, struct address_space *mapping,
 				pgoff_t offset, gfp_t gfp_mask)
 {
+	void *shadow = NULL;
 	int ret;
 
-	ret = add_to_page_cache(page, mapping, offset, gfp_mask);
-	if (ret == 0)
+	__set_page_locked(page);
+	ret = __add_to_page_cache_locked(page, mapping, offset,
+					 gfp_mask, &shadow);
+	if (unlikely(ret)) {
+		__clear_page_locked(page);
+		return ret;
+	}
+
+	/*
+	 * The page was evicted recently enough to still be part of the
+	 * working set: put it on the active list right away.
+	 */
+	if (shadow && workingset_refault(shadow)) {
+		workingset_activation(page);
+		lru_cache_add_lru(page, LRU_ACTIVE_FILE);
+	} else
 		lru_cache_add_file(page);
 	return ret;
 }
@@ -568,6 +655,54 @@ int wait_on_page_bit_killable(struct page *page, int bit_nr)
 			     sleep_on_page_killable, TASK_KILLABLE);
 }
 
+/**
+ * wait_on_page_bit_async - wait for a page bit without blocking
+ * @page: the page
+ * @bit_nr: the bit to wait on
+ * @wait: asynchronous wait entry, embedded in a struct wait_bit_queue
+ *
+ * Instead of sleeping, queue @wait on the page's wait queue so that its
+ * wake function runs once @bit_nr is cleared. Any earlier registration
+ * of @wait is dropped first.
+ *
+ * Returns 0 if the bit is already clear, in which case nothing is left
+ * queued, or -EIOCBRETRY if the caller should back out and wait for the
+ * callback.
+ */
+int wait_on_page_bit_async(struct page *page, int bit_nr, wait_queue_t *wait)
+{
+	struct wait_bit_queue *wait_bit =
+		container_of(wait, struct wait_bit_queue, wait);
+	wait_queue_head_t *q = page_waitqueue(page);
+	unsigned long flags;
+	int ret = -EIOCBRETRY;
+
+	if (!test_bit(bit_nr, &page->flags))
+		return 0;
+
+	abort_async_wait(wait);
+
+	spin_lock_irqsave(&q->lock, flags);
+	wait_bit->key.flags = &page->flags;
+	wait_bit->key.bit_nr = bit_nr;
+	wait->private = q;
+	__add_wait_queue(q, wait);
+	/*
+	 * Order the queueing against the test below, pairs with the
+	 * barrier between clearing the bit and the waitqueue_active()
+	 * check in unlock_page() and end_page_writeback().
+	 */
+	smp_mb();
+	if (!test_bit(bit_nr, &page->flags)) {
+		list_del_init(&wait->task_list);
+		ret = 0;
+	}
+	spin_unlock_irqrestore(&q->lock, flags);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(wait_on_page_bit_async);
+
 /**
  * add_page_wait_queue - Add an arbitrary waiter to a page's wait queue
  * @page: Page defining the wait queue of interest
@@ -646,6 +781,27 @@ int __lock_page_killable(struct page *page)
 }
 EXPORT_SYMBOL_GPL(__lock_page_killable);
 
+/**
+ * __lock_page_async - lock a page, or arrange to be called back
+ * @page: the page to lock
+ * @wait: asynchronous wait entry, see wait_on_page_bit_async()
+ *
+ * Returns 0 with the page locked, or -EIOCBRETRY with @wait queued to
+ * be woken when the page is unlocked.
+ */
+int __lock_page_async(struct page *page, wait_queue_t *wait)
+{
+	int ret;
+
+	while (!trylock_page(page)) {
+		ret = wait_on_page_bit_async(page, PG_locked, wait);
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+EXPORT_SYMBOL_GPL(__lock_page_async);
+
 int __lock_page_or_retry(struct page *page, struct mm_struct *mm,
 			 unsigned int flags)
 {
@@ -679,14 +835,19 @@ int __lock_page_or_retry(struct page *page, struct mm_struct *mm,
 }
 
 /**
- * find_get_page - find and get a page reference
+ * find_get_entry - find and get a page cache entry
  * @mapping: the address_space to search
- * @offset: the page index
+ * @offset: the page cache index
  *
- * Is there a pagecache struct page at the given (mapping, offset) tuple?
- * If yes, increment its refcount and return it; if no, return NULL.
+ * Looks up the page cache slot at @mapping & @offset.  If there is a
+ * page cache page, it is returned with an increased refcount.
+ *
+ * If the slot holds a shadow entry of a previously evicted page, or a
+ * swap entry from shmem/tmpfs, it is returned.
+ *
+ * Otherwise, %NULL is returned.
  */
-struct page *find_get_page(struct address_space *mapping, pgoff_t offset)
+struct page *find_get_entry(struct address_space *mapping, pgoff_t offset)
 {
 	void **pagep;
 	struct page *page;
@@ -704,8 +865,9 @@ repeat:
 				goto repeat;
 			/*
 			 * Otherwise, shmem/tmpfs must be storing a swap entry
-			 * here as an exceptional entry: so return it without
-			 * attempting to raise page count.
+			 * here, or a shadow entry of a recently evicted page
+			 * is left: so return it without attempting to raise
+			 * page count.
 			 */
 			goto out;
 		}
@@ -727,24 +889,48 @@ out:
 
 	return page;
 }
-EXPORT_SYMBOL(find_get_page);
+EXPORT_SYMBOL(find_get_entry);
 
 /**
- * find_lock_page - locate, pin and lock a pagecache page
+ * find_get_page - find and get a page reference
  * @mapping: the address_space to search
  * @offset: the page index
  *
- * Locates the desired pagecache page, locks it, increments its reference
- * count and returns its address.
+ * Is there a pagecache struct page at the given (mapping, offset) tuple?
+ * If yes, increment its refcount and return it; if no, return NULL.
+ */
+struct page *find_get_page(struct address_space *mapping, pgoff_t offset)
+{
+	struct page *page = find_get_entry(mapping, offset);
+
+	if (radix_tree_exceptional_entry(page))
+		page = NULL;
+	return page;
+}
+EXPORT_SYMBOL(find_get_page);
+
+/**
+ * find_lock_entry - locate, pin and lock a page cache entry
+ * @mapping: the address_space to search
+ * @offset: the page cache index
  *
- * Returns zero if the page was not present. find_lock_page() may sleep.
+ * Looks up the page cache slot at @mapping & @offset.  If there is a
+ * page cache page, it is returned locked and with an increased
+ * refcount.
+ *
+ * If the slot holds a shadow entry of a previously evicted page, or a
+ * swap entry from shmem/tmpfs, it is returned.
+ *
+ * Otherwise, %NULL is returned.
+ *
+ * find_lock_entry() may sleep.
  */
-struct page *find_lock_page(struct address_space *mapping, pgoff_t offset)
+struct page *find_lock_entry(struct address_space *mapping, pgoff_t offset)
 {
 	struct page *page;
 
 repeat:
-	page = find_get_page(mapping, offset);
+	page = find_get_entry(mapping, offset);
 	if (page && !radix_tree_exception(page)) {
 		lock_page(page);
 		/* Has the page been truncated? */
@@ -757,6 +943,26 @@ repeat:
 	}
 	return page;
 }
+EXPORT_SYMBOL(find_lock_entry);
+
+/**
+ * find_lock_page - locate, pin and lock a pagecache page
+ * @mapping: the address_space to search
+ * @offset: the page index
+ *
+ * Locates the desired pagecache page, locks it, increments its reference
+ * count and returns its address.
+ *
+ * Returns zero if the page was not present. find_lock_page() may sleep.
+ */
+struct page *find_lock_page(struct address_space *mapping, pgoff_t offset)
+{
+	struct page *page = find_lock_entry(mapping, offset);
+
+	if (radix_tree_exceptional_entry(page))
+		page = NULL;
+	return page;
+}
 EXPORT_SYMBOL(find_lock_page);
 
 /**
@@ -806,6 +1012,31 @@ repeat:
 }
 EXPORT_SYMBOL(find_or_create_page);
 
+/*
+ * Return the index following the first @nr entries at or after @start,
+ * or 0 if the end of the index space is reached.  Used to step over a
+ * batch that held nothing but exceptional entries.
+ */
+static pgoff_t page_cache_skip_entries(struct address_space *mapping,
+				       pgoff_t start, unsigned int nr)
+{
+	unsigned long indices[PAGEVEC_SIZE];
+	void **slots[PAGEVEC_SIZE];
+	unsigned int found;
+
+	while (nr) {
+		found = radix_tree_gang_lookup_slot(&mapping->page_tree, slots,
+				indices, start, min(nr, (unsigned int)PAGEVEC_SIZE));
+		if (!found)
+			break;
+		start = indices[found - 1] + 1;
+		if (!start)
+			break;
+		nr -= found;
+	}
+	return start;
+}
+
 /**
  * find_get_pages - gang pagecache lookup
  * @mapping:	The address_space to search
@@ -854,8 +1085,8 @@ repeat:
 			}
 			/*
 			 * Otherwise, shmem/tmpfs must be storing a swap entry
-			 * here as an exceptional entry: so skip over it -
-			 * we only reach this from invalidate_mapping_pages().
+			 * here as an exceptional entry, or a shadow entry of
+			 * an evicted page is left: so skip over it.
 			 */
 			nr_skip++;
 			continue;
@@ -880,6 +1111,15 @@ repeat:
 	 */
 	if (unlikely(!ret && nr_found > nr_skip))
 		goto restart;
+	/*
+	 * The batch held nothing but exceptional entries: look past
+	 * them, for the same reason.
+	 */
+	if (unlikely(!ret && nr_found)) {
+		start = page_cache_skip_entries(mapping, start, nr_found);
+		if (start)
+			goto restart;
+	}
 	rcu_read_unlock();
 	return ret;
 }
@@ -1088,12 +1328,23 @@ static void shrink_readahead_size_eio(struct file *filp,
 	ra->ra_pages /= 4;
 }
 
+/*
+ * The wait entry an AIO retry of @iocb uses instead of blocking on page
+ * locks. Synchronous IO always blocks, even when it nests inside the retry
+ * of some other kiocb.
+ */
+static inline wait_queue_t *kiocb_io_wait(struct kiocb *iocb)
+{
+	return is_sync_kiocb(iocb) ? NULL : current->io_wait;
+}
+
 /**
  * do_generic_file_read - generic file read routine
  * @filp:	the file to read
  * @ppos:	current file position
  * @desc:	read_descriptor
  * @actor:	read method
+ * @io_wait:	AIO wait entry, or %NULL to block on locked pages
  *
  * This is a generic file read routine, and uses the
  * mapping->a_ops->readpage() function for the actual low-level stuff.
@@ -1102,7 +1353,8 @@ static void shrink_readahead_size_eio(struct file *filp,
  * of the logic when it comes to error handling etc.
  */
 static void do_generic_file_read(struct file *filp, loff_t *ppos,
-		read_descriptor_t *desc, read_actor_t actor)
+		read_descriptor_t *desc, read_actor_t actor,
+		wait_queue_t *io_wait)
 {
 	struct address_space *mapping = filp->f_mapping;
 	struct inode *inode = mapping->host;
@@ -1222,7 +1474,7 @@ page_ok:
 
 page_not_up_to_date:
 		/* Get exclusive access to the page ... */
-		error = lock_page_killable(page);
+		error = lock_page_async(page, io_wait);
 		if (unlikely(error))
 			goto readpage_error;
 
@@ -1259,7 +1511,11 @@ readpage:
 		}
 
 		if (!PageUptodate(page)) {
-			error = lock_page_killable(page);
+			/*
+			 * For AIO this returns -EIOCBRETRY while the read
+			 * is in flight, the retry will find the page uptodate.
+			 */
+			error = lock_page_async(page, io_wait);
 			if (unlikely(error))
 				goto readpage_error;
 			if (!PageUptodate(page)) {
@@ -1282,7 +1538,11 @@ readpage:
 		goto page_ok;
 
 readpage_error:
-		/* UHHUH! A synchronous read error occurred. Report it */
+		/*
+		 * UHHUH! A synchronous read error occurred. Report it. Or
+		 * this is AIO and we have to come back when the page is
+		 * unlocked (-EIOCBRETRY).
+		 */
 		desc->error = error;
 		page_cache_release(page);
 		goto out;
@@ -1485,7 +1745,8 @@ generic_file_aio_read(struct kiocb *iocb, const struct iovec *iov,
 		if (desc.count == 0)
 			continue;
 		desc.error = 0;
-		do_generic_file_read(filp, ppos, &desc, file_read_actor);
+		do_generic_file_read(filp, ppos, &desc, file_read_actor,
+				     kiocb_io_wait(iocb));
 		retval += desc.written;
 		if (desc.error) {
 			retval = retval ?: desc.error;
@@ -2377,8 +2638,39 @@ found:
 }
 EXPORT_SYMBOL(grab_cache_page_write_begin);
 
+/*
+ * Called for AIO before writing to the page at @index: if the page is
+ * locked, for instance because it is being read in, queue the kiocb's
+ * wait entry rather than blocking in ->write_begin(). Partial page writes
+ * need the page uptodate, so start reading it in if it's not cached.
+ *
+ * This only covers the common case, ->write_begin() may still block.
+ */
+static int generic_write_prepare_async(struct file *file, pgoff_t index,
+				       bool partial, wait_queue_t *wait)
+{
+	struct address_space *mapping = file->f_mapping;
+	struct page *page;
+	int ret = 0;
+
+	page = find_get_page(mapping, index);
+	if (!page && partial) {
+		page_cache_sync_readahead(mapping, &file->f_ra, file, index, 1);
+		page = find_get_page(mapping, index);
+	}
+	if (!page)
+		return 0;
+
+	if (PageLocked(page))
+		ret = wait_on_page_bit_async(page, PG_locked, wait);
+	page_cache_release(page);
+
+	return ret;
+}
+
 static ssize_t generic_perform_write(struct file *file,
-				struct iov_iter *i, loff_t pos)
+				struct iov_iter *i, loff_t pos,
+				wait_queue_t *io_wait)
 {
 	struct address_space *mapping = file->f_mapping;
 	const struct address_space_operations *a_ops = mapping->a_ops;
@@ -2403,6 +2695,15 @@ static ssize_t generic_perform_write(struct file *file,
 		bytes = min_t(unsigned long, PAGE_CACHE_SIZE - offset,
 						iov_iter_count(i));
 
+		if (io_wait) {
+			status = generic_write_prepare_async(file,
+					pos >> PAGE_CACHE_SHIFT,
+					offset || bytes < PAGE_CACHE_SIZE,
+					io_wait);
+			if (status)
+				break;
+		}
+
 again:
 
 		/*
@@ -2476,7 +2777,7 @@ generic_file_buffered_write(struct kiocb *iocb, const struct iovec *iov,
 	struct iov_iter i;
 
 	iov_iter_init(&i, iov, nr_segs, count, written);
-	status = generic_perform_write(file, &i, pos);
+	status = generic_perform_write(file, &i, pos, kiocb_io_wait(iocb));
 
 	if (likely(status >= 0)) {
 		written += status;
@@ -0,0 +1,242 @@
+/*
+ * Frontswap frontend
+ *
+ * This code provides the generic "frontend" layer to call a matching
+ * "backend" driver implementation of frontswap.  See
+ * Documentation/vm/frontswap.txt for more information.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.
+ */
+
+#include <linux/module.h>
+#include <linux/mm.h>
+#include <linux/swap.h>
+#include <linux/swapops.h>
+#include <linux/frontswap.h>
+
+/*
+ * As with cleancache_enabled, this is read on every swap page I/O, so a
+ * global flag set at registration time beats an indirect call.
+ */
+bool frontswap_enabled __read_mostly;
+EXPORT_SYMBOL(frontswap_enabled);
+
+/*
+ * frontswap_ops is set by frontswap_register_ops to contain the pointers
+ * to the frontswap "backend" implementation functions.
+ */
+static struct frontswap_ops frontswap_ops __read_mostly;
+
+/*
+ * Swap types that have been swapon'ed, so that a backend registering
+ * late can still be told about them.
+ */
+static DECLARE_BITMAP(frontswap_swap_types, MAX_SWAPFILES);
+
+/* total number of pages currently held by the backend */
+static atomic_long_t frontswap_pages = ATOMIC_LONG_INIT(0);
+
+/* useful stats available in /sys/kernel/mm/frontswap */
+static unsigned long frontswap_succ_puts;
+static unsigned long frontswap_failed_puts;
+static unsigned long frontswap_gets;
+static unsigned long frontswap_flushes;
+
+/*
+ * Register operations for frontswap, returning previous thus allowing
+ * detection of multiple backends and possible nesting.
+ */
+struct frontswap_ops frontswap_register_ops(struct frontswap_ops *ops)
+{
+	struct frontswap_ops old = frontswap_ops;
+	int type;
+
+	frontswap_ops = *ops;
+	for_each_set_bit(type, frontswap_swap_types, MAX_SWAPFILES)
+		frontswap_ops.init(type);
+	/* the ops must be visible before the hooks start using them */
+	smp_wmb();
+	frontswap_enabled = true;
+	return old;
+}
+EXPORT_SYMBOL(frontswap_register_ops);
+
+/* Called when a swap device is swapon'd */
+void __frontswap_init(unsigned type)
+{
+	BUG_ON(type >= MAX_SWAPFILES);
+	set_bit(type, frontswap_swap_types);
+	if (frontswap_enabled)
+		frontswap_ops.init(type);
+}
+EXPORT_SYMBOL(__frontswap_init);
+
+/*
+ * "Put" data from a page to frontswap and associate it with the page's
+ * swaptype and offset.  Page must be locked and in the swap cache.
+ * If frontswap already contains a page with matching swaptype and
+ * offset, the frontswap implementation may either overwrite the data and
+ * return success or flush the page from frontswap and return failure.
+ */
+int __frontswap_put_page(struct page *page)
+{
+	int ret = -1;
+	swp_entry_t entry = { .val = page_private(page), };
+	int type = swp_type(entry);
+	struct swap_info_struct *sis = page_swap_info(page);
+	pgoff_t offset = swp_offset(entry);
+	bool dup;
+
+	BUG_ON(!PageLocked(page));
+	if (!frontswap_map_get(sis))
+		return ret;
+
+	dup = frontswap_test(sis, offset);
+	ret = frontswap_ops.put_page(type, offset, page);
+	if (ret == 0) {
+		set_bit(offset, sis->frontswap_map);
+		frontswap_succ_puts++;
+		if (!dup) {
+			atomic_inc(&sis->frontswap_pages);
+			atomic_long_inc(&frontswap_pages);
+		}
+	} else {
+		/*
+		 * The older copy must not outlive the failed put: the page
+		 * is about to be written to the swap device and a stale copy
+		 * could otherwise be read back, or written back, later.
+		 */
+		frontswap_failed_puts++;
+		if (dup) {
+			frontswap_ops.flush_page(type, offset);
+			clear_bit(offset, sis->frontswap_map);
+			atomic_dec(&sis->frontswap_pages);
+			atomic_long_dec(&frontswap_pages);
+		}
+	}
+	return ret;
+}
+EXPORT_SYMBOL(__frontswap_put_page);
+
+/*
+ * "Get" data from frontswap associated with swaptype and offset that were
+ * specified when the data was put to frontswap and use it to fill the
+ * specified page with data.  Page must be locked and in the swap cache.
+ */
+int __frontswap_get_page(struct page *page)
+{
+	int ret = -1;
+	swp_entry_t entry = { .val = page_private(page), };
+	int type = swp_type(entry);
+	struct swap_info_struct *sis = page_swap_info(page);
+	pgoff_t offset = swp_offset(entry);
+
+	BUG_ON(!PageLocked(page));
+	if (frontswap_test(sis, offset))
+		ret = frontswap_ops.get_page(type, offset, page);
+	if (ret == 0)
+		frontswap_gets++;
+	return ret;
+}
+EXPORT_SYMBOL(__frontswap_get_page);
+
+/*
+ * Flush any data from frontswap associated with the specified swaptype
+ * and offset so that a subsequent "get" will fail.  Called with
+ * swap_lock held when the swap slot is freed.
+ */
+void __frontswap_flush_page(struct swap_info_struct *sis, pgoff_t offset)
+{
+	if (frontswap_test(sis, offset)) {
+		frontswap_ops.flush_page(sis->type, offset);
+		clear_bit(offset, sis->frontswap_map);
+		atomic_dec(&sis->frontswap_pages);
+		atomic_long_dec(&frontswap_pages);
+		frontswap_flushes++;
+	}
+}
+EXPORT_SYMBOL(__frontswap_flush_page);
+
+/*
+ * Flush all data from frontswap associated with all offsets for the
+ * specified swaptype, at swapoff time.
+ */
+void __frontswap_flush_area(struct swap_info_struct *sis)
+{
+	if (!frontswap_map_get(sis))
+		return;
+
+	frontswap_ops.flush_area(sis->type);
+	atomic_long_sub(atomic_read(&sis->frontswap_pages), &frontswap_pages);
+	atomic_set(&sis->frontswap_pages, 0);
+	bitmap_zero(sis->frontswap_map, sis->max);
+	clear_bit(sis->type, frontswap_swap_types);
+}
+EXPORT_SYMBOL(__frontswap_flush_area);
+
+/*
+ * Number of pages currently held by the frontswap backend, across all
+ * swap areas.
+ */
+unsigned long frontswap_curr_pages(void)
+{
+	return atomic_long_read(&frontswap_pages);
+}
+EXPORT_SYMBOL(frontswap_curr_pages);
+
+#ifdef CONFIG_SYSFS
+
+#define FRONTSWAP_SYSFS_RO(_name) \
+	static ssize_t frontswap_##_name##_show(struct kobject *kobj, \
+				struct kobj_attribute *attr, char *buf) \
+	{ \
+		return sprintf(buf, "%lu\n", frontswap_##_name); \
+	} \
+	static struct kobj_attribute frontswap_##_name##_attr = { \
+		.attr = { .name = __stringify(_name), .mode = 0444 }, \
+		.show = frontswap_##_name##_show, \
+	}
+
+FRONTSWAP_SYSFS_RO(succ_puts);
+FRONTSWAP_SYSFS_RO(failed_puts);
+FRONTSWAP_SYSFS_RO(gets);
+FRONTSWAP_SYSFS_RO(flushes);
+
+static ssize_t frontswap_curr_pages_show(struct kobject *kobj,
+				struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", frontswap_curr_pages());
+}
+static struct kobj_attribute frontswap_curr_pages_attr = {
+	.attr = { .name = "curr_pages", .mode = 0444 },
+	.show = frontswap_curr_pages_show,
+};
+
+static struct attribute *frontswap_attrs[] = {
+	&frontswap_succ_puts_attr.attr,
+	&frontswap_failed_puts_attr.attr,
+	&frontswap_gets_attr.attr,
+	&frontswap_flushes_attr.attr,
+	&frontswap_curr_pages_attr.attr,
+	NULL,
+};
+
+static struct attribute_group frontswap_attr_group = {
+	.attrs = frontswap_attrs,
+	.name = "frontswap",
+};
+
+#endif /* CONFIG_SYSFS */
+
+static int __init init_frontswap(void)
+{
+#ifdef CONFIG_SYSFS
+	int err;
+
+	err = sysfs_create_group(mm_kobj, &frontswap_attr_group);
+	if (err)
+		printk(KERN_ERR "frontswap: register sysfs failed\n");
+#endif /* CONFIG_SYSFS */
+	return 0;
+}
+module_init(init_frontswap);
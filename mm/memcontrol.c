@@ -48,6 +48,7 @@
 #include <linux/page_cgroup.h>
 #include <linux/cpu.h>
 #include <linux/oom.h>
+#include <linux/shmem_fs.h>
 #include "internal.h"
 
 #include <asm/uaccess.h>
@@ -124,23 +125,16 @@ struct mem_cgroup_stat_cpu {
  * per-zone information in memory controller.
  */
 struct mem_cgroup_per_zone {
-	/*
-	 * spin_lock to protect the per cgroup LRU
-	 */
-	struct list_head	lists[NR_LRU_LISTS];
-	unsigned long		count[NR_LRU_LISTS];
-
-	struct zone_reclaim_stat reclaim_stat;
+	struct lruvec		lruvec;		/* unused for the root cgroup */
 	struct rb_node		tree_node;	/* RB tree node */
 	unsigned long long	usage_in_excess;/* Set to the value by which */
 						/* the soft limit is exceeded*/
 	bool			on_tree;
 	struct mem_cgroup	*mem;		/* Back pointer, we cannot */
 						/* use container_of	   */
+	int			reclaim_id;	/* css_id global reclaim */
+						/* last scanned, root only */
 };
-/* Macro for accessing counter */
-#define MEM_CGROUP_ZSTAT(mz, idx)	((mz)->count[(idx)])
-
 struct mem_cgroup_per_node {
 	struct mem_cgroup_per_zone zoneinfo[MAX_NR_ZONES];
 };
@@ -201,6 +195,20 @@ struct mem_cgroup_eventfd_list {
 	struct eventfd_ctx *eventfd;
 };
 
+/* for memory pressure */
+enum mem_cgroup_pressure_level {
+	MEM_CGROUP_PRESSURE_LOW,
+	MEM_CGROUP_PRESSURE_MEDIUM,
+	MEM_CGROUP_PRESSURE_CRITICAL,
+	MEM_CGROUP_NR_PRESSURE_LEVELS,
+};
+
+struct mem_cgroup_pressure_event {
+	struct list_head list;
+	struct eventfd_ctx *eventfd;
+	enum mem_cgroup_pressure_level level;
+};
+
 static void mem_cgroup_threshold(struct mem_cgroup *mem);
 static void mem_cgroup_oom_notify(struct mem_cgroup *mem);
 
@@ -270,6 +278,16 @@ struct mem_cgroup {
 	/* For oom notifier event fd */
 	struct list_head oom_notify;
 
+	/* Reclaim efficiency sampled for pressure notification */
+	spinlock_t pressure_lock;
+	unsigned long pressure_scanned;
+	unsigned long pressure_reclaimed;
+	struct work_struct pressure_work;
+
+	/* For pressure notifier event fd, protected by pressure_events_lock */
+	struct list_head pressure_events;
+	struct mutex pressure_events_lock;
+
 	/*
 	 * Should we move charges of a task when a task is moved into this
 	 * mem_cgroup ? And what type of charges should we move ?
@@ -285,6 +303,15 @@ struct mem_cgroup {
 	 */
 	struct mem_cgroup_stat_cpu nocpu_base;
 	spinlock_t pcp_counter_lock;
+	/*
+	 * LRU lookups may race with the removal of the memcg, so it is
+	 * freed only after an RCU grace period, from a work item because
+	 * vfree() cannot be called from the RCU callback.
+	 */
+	union {
+		struct rcu_head rcu_freeing;
+		struct work_struct work_freeing;
+	};
 };
 
 /* Stuffs for move charges at task migration. */
@@ -378,15 +405,6 @@ struct cgroup_subsys_state *mem_cgroup_css(struct mem_cgroup *mem)
 	return &mem->css;
 }
 
-static struct mem_cgroup_per_zone *
-page_cgroup_zoneinfo(struct mem_cgroup *mem, struct page *page)
-{
-	int nid = page_to_nid(page);
-	int zid = page_zonenum(page);
-
-	return mem_cgroup_zoneinfo(mem, nid, zid);
-}
-
 static struct mem_cgroup_tree_per_zone *
 soft_limit_tree_node_zone(int nid, int zid)
 {
@@ -638,19 +656,19 @@ static void mem_cgroup_charge_statistics(struct mem_cgroup *mem,
 	preempt_enable();
 }
 
-unsigned long
+static unsigned long
 mem_cgroup_zone_nr_lru_pages(struct mem_cgroup *mem, int nid, int zid,
 			unsigned int lru_mask)
 {
-	struct mem_cgroup_per_zone *mz;
+	struct lruvec *lruvec;
 	enum lru_list l;
 	unsigned long ret = 0;
 
-	mz = mem_cgroup_zoneinfo(mem, nid, zid);
+	lruvec = mem_cgroup_zone_lruvec(&NODE_DATA(nid)->node_zones[zid], mem);
 
 	for_each_lru(l) {
 		if (BIT(l) & lru_mask)
-			ret += MEM_CGROUP_ZSTAT(mz, l);
+			ret += lruvec->lru_size[l];
 	}
 	return ret;
 }
@@ -858,6 +876,85 @@ static struct mem_cgroup *mem_cgroup_get_next(struct mem_cgroup *iter,
 #define for_each_mem_cgroup_all(iter) \
 	for_each_mem_cgroup_tree_cond(iter, NULL, true)
 
+/**
+ * mem_cgroup_iter - iterate over all memory cgroups
+ * @prev: previously returned memcg, NULL on first invocation
+ *
+ * Returns references to all memcgs in turn, starting with the root
+ * cgroup, and NULL after the last one.  The reference to @prev is
+ * dropped, so the walk must be run to its end.
+ */
+struct mem_cgroup *mem_cgroup_iter(struct mem_cgroup *prev)
+{
+	if (mem_cgroup_disabled())
+		return NULL;
+	if (!prev)
+		return mem_cgroup_start_loop(NULL);
+	return mem_cgroup_get_next(prev, NULL, true);
+}
+
+/**
+ * mem_cgroup_reclaim_iter - iterate over memory cgroups for zone reclaim
+ * @zone: zone being reclaimed
+ * @prev: previously returned memcg, NULL on first invocation
+ *
+ * Like mem_cgroup_iter(), but a new walk resumes after the memcg that
+ * the last walk over @zone stopped at, so that walks cut short with
+ * mem_cgroup_iter_break() still visit every memcg over successive
+ * walks.  Returns NULL after the last memcg in the hierarchy.
+ */
+struct mem_cgroup *mem_cgroup_reclaim_iter(struct zone *zone,
+					   struct mem_cgroup *prev)
+{
+	struct mem_cgroup_per_zone *mz;
+	struct cgroup_subsys_state *css;
+	struct mem_cgroup *mem;
+	bool wrapped = false;
+	int nextid, found;
+
+	if (mem_cgroup_disabled())
+		return NULL;
+
+	mz = mem_cgroup_zoneinfo(root_mem_cgroup, zone_to_nid(zone),
+				 zone_idx(zone));
+	if (prev) {
+		nextid = css_id(&prev->css) + 1;
+		css_put(&prev->css);
+	} else
+		nextid = mz->reclaim_id + 1;
+
+	mem = NULL;
+	while (!mem) {
+		rcu_read_lock();
+		css = css_get_next(&mem_cgroup_subsys, nextid,
+				   &root_mem_cgroup->css, &found);
+		if (css && css_tryget(css))
+			mem = container_of(css, struct mem_cgroup, css);
+		rcu_read_unlock();
+		if (css) {
+			nextid = found + 1;
+			continue;
+		}
+		/* A new walk that started after the last memcg wraps */
+		if (prev || wrapped)
+			break;
+		nextid = 1;
+		wrapped = true;
+	}
+
+	mz->reclaim_id = mem ? css_id(&mem->css) : 0;
+	return mem;
+}
+
+/**
+ * mem_cgroup_iter_break - abort a memcg walk early
+ * @prev: last memcg returned by the walk
+ */
+void mem_cgroup_iter_break(struct mem_cgroup *prev)
+{
+	if (prev)
+		css_put(&prev->css);
+}
 
 static inline bool mem_cgroup_is_root(struct mem_cgroup *mem)
 {
@@ -891,175 +988,95 @@ out:
 }
 EXPORT_SYMBOL(mem_cgroup_count_vm_event);
 
-/*
- * Following LRU functions are allowed to be used without PCG_LOCK.
- * Operations are called by routine of global LRU independently from memcg.
- * What we have to take care of here is validness of pc->mem_cgroup.
+/**
+ * mem_cgroup_zone_lruvec - get the lru list vector for a zone and memcg
+ * @zone: zone of the wanted lruvec
+ * @mem: memcg of the wanted lruvec
  *
- * Changes to pc->mem_cgroup happens when
- * 1. charge
- * 2. moving account
- * In typical case, "charge" is done before add-to-lru. Exception is SwapCache.
- * It is added to LRU before charge.
- * If PCG_USED bit is not set, page_cgroup is not added to this private LRU.
- * When moving account, the page is not on LRU. It's isolated.
+ * Returns the lru list vector holding the LRU lists for @zone and @mem.
+ * The root cgroup has no lists of its own and uses the zone's.
  */
-
-void mem_cgroup_del_lru_list(struct page *page, enum lru_list lru)
+struct lruvec *mem_cgroup_zone_lruvec(struct zone *zone, struct mem_cgroup *mem)
 {
-	struct page_cgroup *pc;
 	struct mem_cgroup_per_zone *mz;
 
-	if (mem_cgroup_disabled())
-		return;
-	pc = lookup_page_cgroup(page);
-	/* can happen while we handle swapcache. */
-	if (!TestClearPageCgroupAcctLRU(pc))
-		return;
-	VM_BUG_ON(!pc->mem_cgroup);
+	if (mem_cgroup_disabled() || !mem || mem_cgroup_is_root(mem))
+		return &zone->lruvec;
+
+	mz = mem_cgroup_zoneinfo(mem, zone_to_nid(zone), zone_idx(zone));
 	/*
-	 * We don't check PCG_USED bit. It's cleared when the "page" is finally
-	 * removed from global LRU.
+	 * The node of the zone may have been onlined after the memcg was
+	 * created, so the lruvec learns about its zone here.
 	 */
-	mz = page_cgroup_zoneinfo(pc->mem_cgroup, page);
-	/* huge page split is done under lru_lock. so, we have no races. */
-	MEM_CGROUP_ZSTAT(mz, lru) -= 1 << compound_order(page);
-	if (mem_cgroup_is_root(pc->mem_cgroup))
-		return;
-	VM_BUG_ON(list_empty(&pc->lru));
-	list_del_init(&pc->lru);
-}
-
-void mem_cgroup_del_lru(struct page *page)
-{
-	mem_cgroup_del_lru_list(page, page_lru(page));
+	if (unlikely(mz->lruvec.zone != zone))
+		mz->lruvec.zone = zone;
+	return &mz->lruvec;
 }
 
 /*
- * Writeback is about to end against a page which has been marked for immediate
- * reclaim.  If it still appears to be reclaimable, move it to the tail of the
- * inactive list.
+ * Following LRU functions are allowed to be used without PCG_LOCK.
+ * What we have to take care of here is validness of pc->mem_cgroup.
+ *
+ * Changes to pc->mem_cgroup happens when
+ * 1. charge
+ * 2. moving account
+ * In typical case, "charge" is done before add-to-lru. Exception is SwapCache
+ * and FUSE, whose pages are charged under the lru_lock of the lruvec they
+ * are on, see __mem_cgroup_commit_charge_lrucare().
+ * When moving account, the page is not on LRU. It's isolated.
+ *
+ * An uncharged page stays on the lists of its old memcg until it leaves
+ * the LRU.  Off the LRU it belongs to the root lists, so that a page that
+ * is not charged never keeps a memcg that is being removed busy.
  */
-void mem_cgroup_rotate_reclaimable_page(struct page *page)
-{
-	struct mem_cgroup_per_zone *mz;
-	struct page_cgroup *pc;
-	enum lru_list lru = page_lru(page);
 
-	if (mem_cgroup_disabled())
-		return;
-
-	pc = lookup_page_cgroup(page);
-	/* unused or root page is not rotated. */
-	if (!PageCgroupUsed(pc))
-		return;
-	/* Ensure pc->mem_cgroup is visible after reading PCG_USED. */
-	smp_rmb();
-	if (mem_cgroup_is_root(pc->mem_cgroup))
-		return;
-	mz = page_cgroup_zoneinfo(pc->mem_cgroup, page);
-	list_move_tail(&pc->lru, &mz->lists[lru]);
-}
-
-void mem_cgroup_rotate_lru_list(struct page *page, enum lru_list lru)
+/**
+ * mem_cgroup_page_lruvec - get the lru list vector a page belongs to
+ * @page: the page
+ * @zone: zone of the page
+ *
+ * The result is only stable while the lru_lock of the returned lruvec is
+ * held, so callers look it up again after taking the lock.  Lookups done
+ * without that lock must be under rcu_read_lock().
+ */
+struct lruvec *mem_cgroup_page_lruvec(struct page *page, struct zone *zone)
 {
-	struct mem_cgroup_per_zone *mz;
 	struct page_cgroup *pc;
+	struct mem_cgroup *mem;
 
 	if (mem_cgroup_disabled())
-		return;
+		return &zone->lruvec;
 
 	pc = lookup_page_cgroup(page);
-	/* unused or root page is not rotated. */
-	if (!PageCgroupUsed(pc))
-		return;
-	/* Ensure pc->mem_cgroup is visible after reading PCG_USED. */
-	smp_rmb();
-	if (mem_cgroup_is_root(pc->mem_cgroup))
-		return;
-	mz = page_cgroup_zoneinfo(pc->mem_cgroup, page);
-	list_move(&pc->lru, &mz->lists[lru]);
+	if (PageCgroupUsed(pc)) {
+		/* Ensure pc->mem_cgroup is visible after reading PCG_USED. */
+		smp_rmb();
+		mem = pc->mem_cgroup;
+	} else if (PageLRU(page))
+		mem = pc->mem_cgroup;
+	else
+		mem = root_mem_cgroup;
+	return mem_cgroup_zone_lruvec(zone, mem);
 }
 
-void mem_cgroup_add_lru_list(struct page *page, enum lru_list lru)
+/**
+ * mem_cgroup_reset_owner - hand an uncharged page to the root cgroup
+ * @page: the page, not on the LRU
+ *
+ * Called under the lru_lock of the page's lruvec before the page is put
+ * on the LRU, so that mem_cgroup_page_lruvec() still finds the root lists
+ * once PageLRU is set.
+ */
+void mem_cgroup_reset_owner(struct page *page)
 {
 	struct page_cgroup *pc;
-	struct mem_cgroup_per_zone *mz;
 
 	if (mem_cgroup_disabled())
 		return;
-	pc = lookup_page_cgroup(page);
-	VM_BUG_ON(PageCgroupAcctLRU(pc));
-	if (!PageCgroupUsed(pc))
-		return;
-	/* Ensure pc->mem_cgroup is visible after reading PCG_USED. */
-	smp_rmb();
-	mz = page_cgroup_zoneinfo(pc->mem_cgroup, page);
-	/* huge page split is done under lru_lock. so, we have no races. */
-	MEM_CGROUP_ZSTAT(mz, lru) += 1 << compound_order(page);
-	SetPageCgroupAcctLRU(pc);
-	if (mem_cgroup_is_root(pc->mem_cgroup))
-		return;
-	list_add(&pc->lru, &mz->lists[lru]);
-}
-
-/*
- * At handling SwapCache and other FUSE stuff, pc->mem_cgroup may be changed
- * while it's linked to lru because the page may be reused after it's fully
- * uncharged. To handle that, unlink page_cgroup from LRU when charge it again.
- * It's done under lock_page and expected that zone->lru_lock isnever held.
- */
-static void mem_cgroup_lru_del_before_commit(struct page *page)
-{
-	unsigned long flags;
-	struct zone *zone = page_zone(page);
-	struct page_cgroup *pc = lookup_page_cgroup(page);
-
-	/*
-	 * Doing this check without taking ->lru_lock seems wrong but this
-	 * is safe. Because if page_cgroup's USED bit is unset, the page
-	 * will not be added to any memcg's LRU. If page_cgroup's USED bit is
-	 * set, the commit after this will fail, anyway.
-	 * This all charge/uncharge is done under some mutual execustion.
-	 * So, we don't need to taking care of changes in USED bit.
-	 */
-	if (likely(!PageLRU(page)))
-		return;
 
-	spin_lock_irqsave(&zone->lru_lock, flags);
-	/*
-	 * Forget old LRU when this page_cgroup is *not* used. This Used bit
-	 * is guarded by lock_page() because the page is SwapCache.
-	 */
+	pc = lookup_page_cgroup(page);
 	if (!PageCgroupUsed(pc))
-		mem_cgroup_del_lru_list(page, page_lru(page));
-	spin_unlock_irqrestore(&zone->lru_lock, flags);
-}
-
-static void mem_cgroup_lru_add_after_commit(struct page *page)
-{
-	unsigned long flags;
-	struct zone *zone = page_zone(page);
-	struct page_cgroup *pc = lookup_page_cgroup(page);
-
-	/* taking care of that the page is added to LRU while we commit it */
-	if (likely(!PageLRU(page)))
-		return;
-	spin_lock_irqsave(&zone->lru_lock, flags);
-	/* link when the page is linked to LRU but page_cgroup isn't */
-	if (PageLRU(page) && !PageCgroupAcctLRU(pc))
-		mem_cgroup_add_lru_list(page, page_lru(page));
-	spin_unlock_irqrestore(&zone->lru_lock, flags);
-}
-
-
-void mem_cgroup_move_lists(struct page *page,
-			   enum lru_list from, enum lru_list to)
-{
-	if (mem_cgroup_disabled())
-		return;
-	mem_cgroup_del_lru_list(page, from);
-	mem_cgroup_add_lru_list(page, to);
+		pc->mem_cgroup = root_mem_cgroup;
 }
 
 /*
@@ -1101,6 +1118,7 @@ int task_in_mem_cgroup(struct task_struct *task, const struct mem_cgroup *mem)
 	return ret;
 }
 
+#ifdef CONFIG_DEBUG_VM
 static int calc_inactive_ratio(struct mem_cgroup *memcg, unsigned long *present_pages)
 {
 	unsigned long active;
@@ -1124,124 +1142,7 @@ static int calc_inactive_ratio(struct mem_cgroup *memcg, unsigned long *present_
 
 	return inactive_ratio;
 }
-
-int mem_cgroup_inactive_anon_is_low(struct mem_cgroup *memcg)
-{
-	unsigned long active;
-	unsigned long inactive;
-	unsigned long present_pages[2];
-	unsigned long inactive_ratio;
-
-	inactive_ratio = calc_inactive_ratio(memcg, present_pages);
-
-	inactive = present_pages[0];
-	active = present_pages[1];
-
-	if (inactive * inactive_ratio < active)
-		return 1;
-
-	return 0;
-}
-
-int mem_cgroup_inactive_file_is_low(struct mem_cgroup *memcg)
-{
-	unsigned long active;
-	unsigned long inactive;
-
-	inactive = mem_cgroup_nr_lru_pages(memcg, BIT(LRU_INACTIVE_FILE));
-	active = mem_cgroup_nr_lru_pages(memcg, BIT(LRU_ACTIVE_FILE));
-
-	return (active > inactive);
-}
-
-struct zone_reclaim_stat *mem_cgroup_get_reclaim_stat(struct mem_cgroup *memcg,
-						      struct zone *zone)
-{
-	int nid = zone_to_nid(zone);
-	int zid = zone_idx(zone);
-	struct mem_cgroup_per_zone *mz = mem_cgroup_zoneinfo(memcg, nid, zid);
-
-	return &mz->reclaim_stat;
-}
-
-struct zone_reclaim_stat *
-mem_cgroup_get_reclaim_stat_from_page(struct page *page)
-{
-	struct page_cgroup *pc;
-	struct mem_cgroup_per_zone *mz;
-
-	if (mem_cgroup_disabled())
-		return NULL;
-
-	pc = lookup_page_cgroup(page);
-	if (!PageCgroupUsed(pc))
-		return NULL;
-	/* Ensure pc->mem_cgroup is visible after reading PCG_USED. */
-	smp_rmb();
-	mz = page_cgroup_zoneinfo(pc->mem_cgroup, page);
-	return &mz->reclaim_stat;
-}
-
-unsigned long mem_cgroup_isolate_pages(unsigned long nr_to_scan,
-					struct list_head *dst,
-					unsigned long *scanned, int order,
-					int mode, struct zone *z,
-					struct mem_cgroup *mem_cont,
-					int active, int file)
-{
-	unsigned long nr_taken = 0;
-	struct page *page;
-	unsigned long scan;
-	LIST_HEAD(pc_list);
-	struct list_head *src;
-	struct page_cgroup *pc, *tmp;
-	int nid = zone_to_nid(z);
-	int zid = zone_idx(z);
-	struct mem_cgroup_per_zone *mz;
-	int lru = LRU_FILE * file + active;
-	int ret;
-
-	BUG_ON(!mem_cont);
-	mz = mem_cgroup_zoneinfo(mem_cont, nid, zid);
-	src = &mz->lists[lru];
-
-	scan = 0;
-	list_for_each_entry_safe_reverse(pc, tmp, src, lru) {
-		if (scan >= nr_to_scan)
-			break;
-
-		if (unlikely(!PageCgroupUsed(pc)))
-			continue;
-
-		page = lookup_cgroup_page(pc);
-
-		if (unlikely(!PageLRU(page)))
-			continue;
-
-		scan++;
-		ret = __isolate_lru_page(page, mode, file);
-		switch (ret) {
-		case 0:
-			list_move(&page->lru, dst);
-			mem_cgroup_del_lru(page);
-			nr_taken += hpage_nr_pages(page);
-			break;
-		case -EBUSY:
-			/* we don't affect global LRU but rotate in our LRU */
-			mem_cgroup_rotate_lru_list(page, page_lru(page));
-			break;
-		default:
-			break;
-		}
-	}
-
-	*scanned = scan;
-
-	trace_mm_vmscan_memcg_isolate(0, nr_to_scan, scan, nr_taken,
-				      0, 0, 0, mode);
-
-	return nr_taken;
-}
+#endif
 
 #define mem_cgroup_from_res_counter(counter, member)	\
 	container_of(counter, struct mem_cgroup, member)
@@ -2508,10 +2409,11 @@ static void __mem_cgroup_commit_charge(struct mem_cgroup *mem,
 #ifdef CONFIG_TRANSPARENT_HUGEPAGE
 
 #define PCGF_NOCOPY_AT_SPLIT ((1 << PCG_LOCK) | (1 << PCG_MOVE_LOCK) |\
-			(1 << PCG_ACCT_LRU) | (1 << PCG_MIGRATION))
+			(1 << PCG_MIGRATION))
 /*
  * Because tail pages are not marked as "used", set it. We're under
- * zone->lru_lock, 'splitting on pmd' and compund_lock.
+ * the lru_lock of the head page's lruvec, 'splitting on pmd' and
+ * compound_lock.  The tail pages go on the same lruvec as the head.
  */
 void mem_cgroup_split_huge_fixup(struct page *head, struct page *tail)
 {
@@ -2529,19 +2431,6 @@ void mem_cgroup_split_huge_fixup(struct page *head, struct page *tail)
 
 	tail_pc->mem_cgroup = head_pc->mem_cgroup;
 	smp_wmb(); /* see __commit_charge() */
-	if (PageCgroupAcctLRU(head_pc)) {
-		enum lru_list lru;
-		struct mem_cgroup_per_zone *mz;
-
-		/*
-		 * LRU flags cannot be copied because we need to add tail
-		 *.page to LRU by generic call and our hook will be called.
-		 * We hold lru_lock, then, reduce counter directly.
-		 */
-		lru = page_lru(head);
-		mz = page_cgroup_zoneinfo(head_pc->mem_cgroup, head);
-		MEM_CGROUP_ZSTAT(mz, lru) -= 1;
-	}
 	tail_pc->flags = head_pc->flags & ~PCGF_NOCOPY_AT_SPLIT;
 	move_unlock_page_cgroup(head_pc, &flags);
 }
@@ -2745,15 +2634,29 @@ __mem_cgroup_commit_charge_lrucare(struct page *page, struct mem_cgroup *mem,
 					enum charge_type ctype)
 {
 	struct page_cgroup *pc = lookup_page_cgroup(page);
+	struct lruvec *lruvec;
+	unsigned long flags;
+	bool removed = false;
+
 	/*
 	 * In some case, SwapCache, FUSE(splice_buf->radixtree), the page
-	 * is already on LRU. It means the page may on some other page_cgroup's
-	 * LRU. Take care of it.
+	 * is already on LRU. It means the page may be on the lists of some
+	 * other lruvec, which the charge moves it away from. Take care of it.
 	 */
-	mem_cgroup_lru_del_before_commit(page);
+	lruvec = lock_page_lruvec_irqsave(page, &flags);
+	if (PageLRU(page) && !PageCgroupUsed(pc)) {
+		ClearPageLRU(page);
+		del_page_from_lru_list(page, lruvec, page_lru(page));
+		removed = true;
+	}
 	__mem_cgroup_commit_charge(mem, page, 1, pc, ctype);
-	mem_cgroup_lru_add_after_commit(page);
-	return;
+	if (removed) {
+		lruvec = relock_page_lruvec_irqsave(page, lruvec, &flags);
+		VM_BUG_ON(PageLRU(page));
+		SetPageLRU(page);
+		add_page_to_lru_list(page, lruvec, page_lru(page));
+	}
+	spin_unlock_irqrestore(&lruvec->lru_lock, flags);
 }
 
 int mem_cgroup_cache_charge(struct page *page, struct mm_struct *mm,
@@ -3635,39 +3538,44 @@ static int mem_cgroup_force_empty_list(struct mem_cgroup *mem,
 				int node, int zid, enum lru_list lru)
 {
 	struct zone *zone;
-	struct mem_cgroup_per_zone *mz;
-	struct page_cgroup *pc, *busy;
+	struct lruvec *lruvec;
+	struct page *busy;
 	unsigned long flags, loop;
 	struct list_head *list;
 	int ret = 0;
 
+	/* The root cgroup shares the zone's lists and has no parent. */
+	if (mem_cgroup_is_root(mem))
+		return 0;
+
 	zone = &NODE_DATA(node)->node_zones[zid];
-	mz = mem_cgroup_zoneinfo(mem, node, zid);
-	list = &mz->lists[lru];
+	lruvec = mem_cgroup_zone_lruvec(zone, mem);
+	list = &lruvec->lists[lru];
 
-	loop = MEM_CGROUP_ZSTAT(mz, lru);
+	loop = lruvec->lru_size[lru];
 	/* give some margin against EBUSY etc...*/
 	loop += 256;
 	busy = NULL;
 	while (loop--) {
+		struct page_cgroup *pc;
 		struct page *page;
 
 		ret = 0;
-		spin_lock_irqsave(&zone->lru_lock, flags);
+		spin_lock_irqsave(&lruvec->lru_lock, flags);
 		if (list_empty(list)) {
-			spin_unlock_irqrestore(&zone->lru_lock, flags);
+			spin_unlock_irqrestore(&lruvec->lru_lock, flags);
 			break;
 		}
-		pc = list_entry(list->prev, struct page_cgroup, lru);
-		if (busy == pc) {
-			list_move(&pc->lru, list);
+		page = list_entry(list->prev, struct page, lru);
+		if (busy == page) {
+			list_move(&page->lru, list);
 			busy = NULL;
-			spin_unlock_irqrestore(&zone->lru_lock, flags);
+			spin_unlock_irqrestore(&lruvec->lru_lock, flags);
 			continue;
 		}
-		spin_unlock_irqrestore(&zone->lru_lock, flags);
+		spin_unlock_irqrestore(&lruvec->lru_lock, flags);
 
-		page = lookup_cgroup_page(pc);
+		pc = lookup_page_cgroup(page);
 
 		ret = mem_cgroup_move_parent(page, pc, mem, GFP_KERNEL);
 		if (ret == -ENOMEM)
@@ -3675,7 +3583,7 @@ static int mem_cgroup_force_empty_list(struct mem_cgroup *mem,
 
 		if (ret == -EBUSY || ret == -EINVAL) {
 			/* found lock contention or "pc" is obsolete. */
-			busy = pc;
+			busy = page;
 			cond_resched();
 		} else
 			busy = NULL;
@@ -4192,22 +4100,20 @@ static int mem_control_stat_show(struct cgroup *cont, struct cftype *cft,
 
 	{
 		int nid, zid;
-		struct mem_cgroup_per_zone *mz;
+		struct zone_reclaim_stat *rstat;
 		unsigned long recent_rotated[2] = {0, 0};
 		unsigned long recent_scanned[2] = {0, 0};
 
 		for_each_online_node(nid)
 			for (zid = 0; zid < MAX_NR_ZONES; zid++) {
-				mz = mem_cgroup_zoneinfo(mem_cont, nid, zid);
-
-				recent_rotated[0] +=
-					mz->reclaim_stat.recent_rotated[0];
-				recent_rotated[1] +=
-					mz->reclaim_stat.recent_rotated[1];
-				recent_scanned[0] +=
-					mz->reclaim_stat.recent_scanned[0];
-				recent_scanned[1] +=
-					mz->reclaim_stat.recent_scanned[1];
+				rstat = &mem_cgroup_zone_lruvec(
+					&NODE_DATA(nid)->node_zones[zid],
+					mem_cont)->reclaim_stat;
+
+				recent_rotated[0] += rstat->recent_rotated[0];
+				recent_rotated[1] += rstat->recent_rotated[1];
+				recent_scanned[0] += rstat->recent_scanned[0];
+				recent_scanned[1] += rstat->recent_scanned[1];
 			}
 		cb->fill(cb, "recent_rotated_anon", recent_rotated[0]);
 		cb->fill(cb, "recent_rotated_file", recent_rotated[1]);
@@ -4587,6 +4493,217 @@ static int mem_cgroup_oom_control_write(struct cgroup *cgrp,
 	return 0;
 }
 
+/*
+ * Memory pressure notification
+ *
+ * The ratio of pages reclaimed to pages scanned tells how hard it is
+ * for reclaim to find memory it can free: when most scanned pages are
+ * reclaimed, there is plenty of cache to drop; when most are not, the
+ * working set no longer fits and the system is close to thrashing or
+ * OOM.  Reclaim reports scanned and reclaimed pages to the mem_cgroup
+ * it works for (the root mem_cgroup for global reclaim), and once a
+ * window of pages has been scanned, the level is computed and sent to
+ * userspace listeners so that they can shrink their own caches.
+ */
+
+/*
+ * Number of scanned pages after which the reclaim efficiency is
+ * evaluated.  Smaller windows give quicker but noisier notifications.
+ */
+#define MEM_CGROUP_PRESSURE_WIN		(SWAP_CLUSTER_MAX * 16)
+
+/*
+ * Percentage of scanned pages that were not reclaimed at which the
+ * medium and critical levels start.
+ */
+#define MEM_CGROUP_PRESSURE_MEDIUM_PCT	60
+#define MEM_CGROUP_PRESSURE_CRITICAL_PCT	95
+
+/*
+ * Reclaim priority at which the pressure is critical no matter what
+ * the efficiency is: priority 3 scans 1/8 of the LRU lists per round,
+ * which means earlier rounds already failed to make progress.
+ */
+#define MEM_CGROUP_PRESSURE_CRITICAL_PRIO	3
+
+static const char * const mem_cgroup_pressure_level_names[] = {
+	[MEM_CGROUP_PRESSURE_LOW]	= "low",
+	[MEM_CGROUP_PRESSURE_MEDIUM]	= "medium",
+	[MEM_CGROUP_PRESSURE_CRITICAL]	= "critical",
+};
+
+static enum mem_cgroup_pressure_level
+mem_cgroup_pressure_level(unsigned long scanned, unsigned long reclaimed)
+{
+	unsigned long pressure = 0;
+
+	/* Reclaim of huge pages may free more than was scanned */
+	if (reclaimed < scanned)
+		pressure = (scanned - reclaimed) * 100 / scanned;
+
+	if (pressure >= MEM_CGROUP_PRESSURE_CRITICAL_PCT)
+		return MEM_CGROUP_PRESSURE_CRITICAL;
+	if (pressure >= MEM_CGROUP_PRESSURE_MEDIUM_PCT)
+		return MEM_CGROUP_PRESSURE_MEDIUM;
+	return MEM_CGROUP_PRESSURE_LOW;
+}
+
+/*
+ * Signal all listeners of @mem that asked for @level or a lower level.
+ * Returns true if there was anybody to signal.
+ */
+static bool mem_cgroup_pressure_notify(struct mem_cgroup *mem,
+				       enum mem_cgroup_pressure_level level)
+{
+	struct mem_cgroup_pressure_event *ev;
+	bool signalled = false;
+
+	mutex_lock(&mem->pressure_events_lock);
+	list_for_each_entry(ev, &mem->pressure_events, list) {
+		if (level >= ev->level) {
+			eventfd_signal(ev->eventfd, 1);
+			signalled = true;
+		}
+	}
+	mutex_unlock(&mem->pressure_events_lock);
+	return signalled;
+}
+
+static void mem_cgroup_pressure_work_fn(struct work_struct *work)
+{
+	struct mem_cgroup *mem = container_of(work, struct mem_cgroup,
+					      pressure_work);
+	enum mem_cgroup_pressure_level level;
+	unsigned long scanned, reclaimed;
+
+	spin_lock(&mem->pressure_lock);
+	scanned = mem->pressure_scanned;
+	reclaimed = mem->pressure_reclaimed;
+	mem->pressure_scanned = 0;
+	mem->pressure_reclaimed = 0;
+	spin_unlock(&mem->pressure_lock);
+
+	/* Several reports may have been folded into one run */
+	if (!scanned)
+		return;
+
+	level = mem_cgroup_pressure_level(scanned, reclaimed);
+	/*
+	 * Reclaim in a hierarchy is pressure on its ancestors as well:
+	 * tell the closest mem_cgroup that has listeners.
+	 */
+	do {
+		if (mem_cgroup_pressure_notify(mem, level))
+			break;
+	} while ((mem = parent_mem_cgroup(mem)));
+}
+
+/**
+ * mem_cgroup_vmpressure - account reclaim efficiency for a mem_cgroup
+ * @mem: mem_cgroup reclaim works for, %NULL for global reclaim
+ * @gfp: reclaimer's gfp mask
+ * @scanned: number of pages scanned
+ * @reclaimed: number of pages reclaimed
+ *
+ * Called by reclaim after each round of scanning.  Once enough pages
+ * were scanned, the pressure level is evaluated and the listeners are
+ * notified from a work item, outside of the reclaim path.
+ */
+void mem_cgroup_vmpressure(struct mem_cgroup *mem, gfp_t gfp,
+			   unsigned long scanned, unsigned long reclaimed)
+{
+	if (mem_cgroup_disabled())
+		return;
+	/*
+	 * Reclaim on behalf of GFP_NOIO/NOFS allocations cannot write
+	 * back or swap out, so its efficiency is artificially poor and
+	 * says nothing about the pressure on userspace caches.
+	 */
+	if ((gfp & (__GFP_IO | __GFP_FS)) != (__GFP_IO | __GFP_FS))
+		return;
+	if (!scanned)
+		return;
+	if (!mem)
+		mem = root_mem_cgroup;
+	/* reclaim can run before the root cgroup is set up */
+	if (!mem)
+		return;
+
+	spin_lock(&mem->pressure_lock);
+	mem->pressure_scanned += scanned;
+	mem->pressure_reclaimed += reclaimed;
+	scanned = mem->pressure_scanned;
+	spin_unlock(&mem->pressure_lock);
+
+	if (scanned < MEM_CGROUP_PRESSURE_WIN)
+		return;
+	schedule_work(&mem->pressure_work);
+}
+
+/**
+ * mem_cgroup_vmpressure_prio - account reclaim priority for a mem_cgroup
+ * @mem: mem_cgroup reclaim works for, %NULL for global reclaim
+ * @gfp: reclaimer's gfp mask
+ * @prio: reclaim priority
+ *
+ * Reclaim that keeps raising its priority is failing to make progress
+ * even if the pages it does reclaim make its efficiency look fine.
+ * Report a full window of unsuccessful scanning once the priority
+ * reaches the critical level.
+ */
+void mem_cgroup_vmpressure_prio(struct mem_cgroup *mem, gfp_t gfp, int prio)
+{
+	if (prio > MEM_CGROUP_PRESSURE_CRITICAL_PRIO)
+		return;
+	mem_cgroup_vmpressure(mem, gfp, MEM_CGROUP_PRESSURE_WIN, 0);
+}
+
+static int mem_cgroup_pressure_register_event(struct cgroup *cgrp,
+	struct cftype *cft, struct eventfd_ctx *eventfd, const char *args)
+{
+	struct mem_cgroup *mem = mem_cgroup_from_cont(cgrp);
+	struct mem_cgroup_pressure_event *event;
+	int level;
+
+	for (level = 0; level < MEM_CGROUP_NR_PRESSURE_LEVELS; level++) {
+		if (!strcmp(mem_cgroup_pressure_level_names[level], args))
+			break;
+	}
+	if (level == MEM_CGROUP_NR_PRESSURE_LEVELS)
+		return -EINVAL;
+
+	event = kmalloc(sizeof(*event), GFP_KERNEL);
+	if (!event)
+		return -ENOMEM;
+
+	event->eventfd = eventfd;
+	event->level = level;
+
+	mutex_lock(&mem->pressure_events_lock);
+	list_add(&event->list, &mem->pressure_events);
+	mutex_unlock(&mem->pressure_events_lock);
+
+	return 0;
+}
+
+static void mem_cgroup_pressure_unregister_event(struct cgroup *cgrp,
+	struct cftype *cft, struct eventfd_ctx *eventfd)
+{
+	struct mem_cgroup *mem = mem_cgroup_from_cont(cgrp);
+	struct mem_cgroup_pressure_event *ev, *tmp;
+
+	mutex_lock(&mem->pressure_events_lock);
+
+	list_for_each_entry_safe(ev, tmp, &mem->pressure_events, list) {
+		if (ev->eventfd == eventfd) {
+			list_del(&ev->list);
+			kfree(ev);
+		}
+	}
+
+	mutex_unlock(&mem->pressure_events_lock);
+}
+
 #ifdef CONFIG_NUMA
 static const struct file_operations mem_control_numa_stat_file_operations = {
 	.read = seq_read,
@@ -4666,6 +4783,11 @@ static struct cftype mem_cgroup_files[] = {
 		.unregister_event = mem_cgroup_oom_unregister_event,
 		.private = MEMFILE_PRIVATE(_OOM_TYPE, OOM_CONTROL),
 	},
+	{
+		.name = "pressure_level",
+		.register_event = mem_cgroup_pressure_register_event,
+		.unregister_event = mem_cgroup_pressure_unregister_event,
+	},
 #ifdef CONFIG_NUMA
 	{
 		.name = "numa_stat",
@@ -4722,7 +4844,6 @@ static int alloc_mem_cgroup_per_zone_info(struct mem_cgroup *mem, int node)
 {
 	struct mem_cgroup_per_node *pn;
 	struct mem_cgroup_per_zone *mz;
-	enum lru_list l;
 	int zone, tmp = node;
 	/*
 	 * This routine is called against possible nodes.
@@ -4741,8 +4862,8 @@ static int alloc_mem_cgroup_per_zone_info(struct mem_cgroup *mem, int node)
 	mem->info.nodeinfo[node] = pn;
 	for (zone = 0; zone < MAX_NR_ZONES; zone++) {
 		mz = &pn->zoneinfo[zone];
-		for_each_lru(l)
-			INIT_LIST_HEAD(&mz->lists[l]);
+		/* The node may not be online yet, see mem_cgroup_zone_lruvec() */
+		lruvec_init(&mz->lruvec, NULL);
 		mz->usage_in_excess = 0;
 		mz->on_tree = false;
 		mz->mem = mem;
@@ -4798,7 +4919,6 @@ static void __mem_cgroup_free(struct mem_cgroup *mem)
 {
 	int node;
 
-	mem_cgroup_remove_from_trees(mem);
 	free_css_id(&mem_cgroup_subsys, &mem->css);
 
 	for_each_node_state(node, N_POSSIBLE)
@@ -4811,6 +4931,23 @@ static void __mem_cgroup_free(struct mem_cgroup *mem)
 		vfree(mem);
 }
 
+static void mem_cgroup_free_work(struct work_struct *work)
+{
+	struct mem_cgroup *mem;
+
+	mem = container_of(work, struct mem_cgroup, work_freeing);
+	__mem_cgroup_free(mem);
+}
+
+static void mem_cgroup_free_rcu(struct rcu_head *head)
+{
+	struct mem_cgroup *mem;
+
+	mem = container_of(head, struct mem_cgroup, rcu_freeing);
+	INIT_WORK(&mem->work_freeing, mem_cgroup_free_work);
+	schedule_work(&mem->work_freeing);
+}
+
 static void mem_cgroup_get(struct mem_cgroup *mem)
 {
 	atomic_inc(&mem->refcnt);
@@ -4820,7 +4957,8 @@ static void __mem_cgroup_put(struct mem_cgroup *mem, int count)
 {
 	if (atomic_sub_and_test(count, &mem->refcnt)) {
 		struct mem_cgroup *parent = parent_mem_cgroup(mem);
-		__mem_cgroup_free(mem);
+		mem_cgroup_remove_from_trees(mem);
+		call_rcu(&mem->rcu_freeing, mem_cgroup_free_rcu);
 		if (parent)
 			mem_cgroup_put(parent);
 	}
@@ -4930,6 +5068,10 @@ mem_cgroup_create(struct cgroup_subsys *ss, struct cgroup *cont)
 	mem->last_scanned_child = 0;
 	mem->last_scanned_node = MAX_NUMNODES;
 	INIT_LIST_HEAD(&mem->oom_notify);
+	spin_lock_init(&mem->pressure_lock);
+	INIT_WORK(&mem->pressure_work, mem_cgroup_pressure_work_fn);
+	INIT_LIST_HEAD(&mem->pressure_events);
+	mutex_init(&mem->pressure_events_lock);
 
 	if (parent)
 		mem->swappiness = mem_cgroup_swappiness(parent);
@@ -4956,6 +5098,8 @@ static void mem_cgroup_destroy(struct cgroup_subsys *ss,
 {
 	struct mem_cgroup *mem = mem_cgroup_from_cont(cont);
 
+	/* Nobody reclaims on behalf of @mem anymore, wait for the last report */
+	flush_work_sync(&mem->pressure_work);
 	mem_cgroup_put(mem);
 }
 
@@ -5116,16 +5260,20 @@ static struct page *mc_handle_file_pte(struct vm_area_struct *vma,
 		pgoff = pte_to_pgoff(ptent);
 
 	/* page is moved even if it's not RSS of this task(page-faulted). */
-	page = find_get_page(mapping, pgoff);
-
 #ifdef CONFIG_SWAP
 	/* shmem/tmpfs may report page out on swap: account for that too. */
-	if (radix_tree_exceptional_entry(page)) {
-		swp_entry_t swap = radix_to_swp_entry(page);
-		if (do_swap_account)
-			*entry = swap;
-		page = find_get_page(&swapper_space, swap.val);
-	}
+	if (shmem_mapping(mapping)) {
+		page = find_get_entry(mapping, pgoff);
+		if (radix_tree_exceptional_entry(page)) {
+			swp_entry_t swap = radix_to_swp_entry(page);
+			if (do_swap_account)
+				*entry = swap;
+			page = find_get_page(&swapper_space, swap.val);
+		}
+	} else
+		page = find_get_page(mapping, pgoff);
+#else
+	page = find_get_page(mapping, pgoff);
 #endif
 	return page;
 }
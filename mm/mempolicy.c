@@ -1506,6 +1506,59 @@ struct mempolicy *get_vma_policy(struct task_struct *task,
 	return pol;
 }
 
+#ifdef CONFIG_NUMA_BALANCING
+/**
+ * mpol_misplaced - check whether current page node is valid in policy
+ *
+ * @page   - page to be checked
+ * @vma    - vm area where page mapped
+ * @addr   - virtual address where page mapped
+ *
+ * Lookup current policy node id for vma,addr and "compare to" page's
+ * node id.  Only pages placed by the default local allocation policy are
+ * ever considered misplaced: an explicit policy says where the page
+ * belongs, and NUMA balancing must not second-guess it.
+ *
+ * Returns:
+ *	-1	- not misplaced, page is in the right node
+ *	node	- node id where the page should be
+ *
+ * Policy determination "mimics" alloc_page_vma().
+ * Called from fault path where we know the vma and faulting address.
+ */
+int mpol_misplaced(struct page *page, struct vm_area_struct *vma,
+		   unsigned long addr)
+{
+	struct mempolicy *pol;
+	int curnid = page_to_nid(page);
+	int thisnid = numa_node_id();
+	int ret = -1;
+
+	pol = get_vma_policy(current, vma, addr);
+	if (pol->mode != MPOL_PREFERRED || !(pol->flags & MPOL_F_LOCAL))
+		goto out;
+
+	if (curnid == thisnid)
+		goto out;
+
+	/*
+	 * The scheduler is about to move current to its preferred node;
+	 * pulling the page here would only make it bounce back.
+	 */
+	if (current->numa_preferred_nid != -1 &&
+	    current->numa_preferred_nid != thisnid)
+		goto out;
+
+	if (!node_isset(thisnid, cpuset_current_mems_allowed))
+		goto out;
+
+	ret = thisnid;
+out:
+	mpol_cond_put(pol);
+	return ret;
+}
+#endif /* CONFIG_NUMA_BALANCING */
+
 /*
  * Return a nodemask representing a mempolicy for filtering nodes for
  * page allocation
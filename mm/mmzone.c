@@ -87,3 +87,14 @@ int memmap_valid_within(unsigned long pfn,
 	return 1;
 }
 #endif /* CONFIG_ARCH_HAS_HOLES_MEMORYMODEL */
+
+void lruvec_init(struct lruvec *lruvec, struct zone *zone)
+{
+	enum lru_list l;
+
+	memset(lruvec, 0, sizeof(struct lruvec));
+	spin_lock_init(&lruvec->lru_lock);
+	for_each_lru(l)
+		INIT_LIST_HEAD(&lruvec->lists[l]);
+	lruvec->zone = zone;
+}
@@ -141,6 +141,117 @@ static void change_protection(struct vm_area_struct *vma,
 	flush_tlb_range(vma, start, end);
 }
 
+#ifdef CONFIG_NUMA_BALANCING
+static unsigned long change_prot_numa_pte_range(struct vm_area_struct *vma,
+		pmd_t *pmd, unsigned long addr, unsigned long end)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	pgprot_t newprot = vma_prot_none(vma);
+	unsigned long pages = 0;
+	pte_t *pte, oldpte;
+	spinlock_t *ptl;
+
+	pte = pte_offset_map_lock(mm, pmd, addr, &ptl);
+	arch_enter_lazy_mmu_mode();
+	do {
+		oldpte = *pte;
+		if (!pte_present(oldpte) || pte_numa(vma, oldpte))
+			continue;
+		/* Only pages that could be migrated are worth a fault */
+		if (!vm_normal_page(vma, addr, oldpte))
+			continue;
+
+		oldpte = ptep_modify_prot_start(mm, addr, pte);
+		ptep_modify_prot_commit(mm, addr, pte,
+					pte_modify(oldpte, newprot));
+		pages++;
+	} while (pte++, addr += PAGE_SIZE, addr != end);
+	arch_leave_lazy_mmu_mode();
+	pte_unmap_unlock(pte - 1, ptl);
+
+	return pages;
+}
+
+static unsigned long change_prot_numa_pmd_range(struct vm_area_struct *vma,
+		pud_t *pud, unsigned long addr, unsigned long end)
+{
+	unsigned long next, pages = 0;
+	pmd_t *pmd, pmdval;
+
+	pmd = pmd_offset(pud, addr);
+	do {
+		next = pmd_addr_end(addr, end);
+		/*
+		 * Only mmap_sem is held for read, so the pmd may be
+		 * populated under us: work on a stable copy and leave
+		 * transparent huge pages alone.
+		 */
+		pmdval = *pmd;
+		barrier();
+		if (pmd_none(pmdval) || pmd_trans_huge(pmdval))
+			continue;
+		if (unlikely(pmd_bad(pmdval))) {
+			pmd_clear_bad(pmd);
+			continue;
+		}
+		pages += change_prot_numa_pte_range(vma, pmd, addr, next);
+	} while (pmd++, addr = next, addr != end);
+
+	return pages;
+}
+
+static unsigned long change_prot_numa_pud_range(struct vm_area_struct *vma,
+		pgd_t *pgd, unsigned long addr, unsigned long end)
+{
+	unsigned long next, pages = 0;
+	pud_t *pud;
+
+	pud = pud_offset(pgd, addr);
+	do {
+		next = pud_addr_end(addr, end);
+		if (pud_none_or_clear_bad(pud))
+			continue;
+		pages += change_prot_numa_pmd_range(vma, pud, addr, next);
+	} while (pud++, addr = next, addr != end);
+
+	return pages;
+}
+
+/*
+ * change_prot_numa - arm NUMA hinting faults on a range of a vma
+ *
+ * Every present pte mapping a normal page in [start, end) is made
+ * PROT_NONE so that the next access to it traps into do_numa_page(),
+ * which restores the vma protection and may migrate the page towards
+ * the faulting node.  Must be called with mmap_sem held for read.
+ * Returns the number of ptes updated.
+ */
+unsigned long change_prot_numa(struct vm_area_struct *vma,
+			unsigned long start, unsigned long end)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	unsigned long addr = start, next, pages = 0;
+	pgd_t *pgd;
+
+	BUG_ON(addr >= end);
+	pgd = pgd_offset(mm, addr);
+	flush_cache_range(vma, addr, end);
+	do {
+		next = pgd_addr_end(addr, end);
+		if (pgd_none_or_clear_bad(pgd))
+			continue;
+		pages += change_prot_numa_pud_range(vma, pgd, addr, next);
+	} while (pgd++, addr = next, addr != end);
+
+	if (pages) {
+		flush_tlb_range(vma, start, end);
+		count_vm_numa_events(NUMA_PTE_UPDATES, pages);
+	}
+
+	return pages;
+}
+#endif /* CONFIG_NUMA_BALANCING */
+
 int
 mprotect_fixup(struct vm_area_struct *vma, struct vm_area_struct **pprev,
 	unsigned long start, unsigned long end, unsigned long newflags)
@@ -0,0 +1,170 @@
+/*
+ * mm/page_alloc-bench.c
+ *
+ * Measure page allocator throughput for a range of orders, with one
+ * thread allocating and freeing pages on each of a growing number of
+ * CPUs. The results are printed to the kernel log when the module is
+ * loaded:
+ *
+ *	modprobe page_alloc-bench max_order=4 batch=64 loops=2000
+ *
+ * Orders up to PAGE_ALLOC_COSTLY_ORDER are served from the per-cpu
+ * lists; higher orders go through zone->lock and can be used to compare
+ * both paths.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/gfp.h>
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/cpu.h>
+#include <linux/kthread.h>
+#include <linux/completion.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+
+static unsigned int max_order = PAGE_ALLOC_COSTLY_ORDER + 1;
+module_param(max_order, uint, 0444);
+MODULE_PARM_DESC(max_order, "Highest page order to measure");
+
+static unsigned int batch = 64;
+module_param(batch, uint, 0444);
+MODULE_PARM_DESC(batch, "Pages held by each thread before freeing them");
+
+static unsigned int loops = 1000;
+module_param(loops, uint, 0444);
+MODULE_PARM_DESC(loops, "Number of allocate/free rounds per thread");
+
+struct bench_thread {
+	unsigned int order;
+	struct page **pages;
+	unsigned long allocated;
+	u64 nsecs;
+	struct completion done;
+};
+
+static struct completion bench_go;
+
+static int page_alloc_bench_thread(void *data)
+{
+	struct bench_thread *bt = data;
+	unsigned int i, j;
+	ktime_t start;
+
+	wait_for_completion(&bench_go);
+
+	start = ktime_get();
+	for (i = 0; i < loops; i++) {
+		for (j = 0; j < batch; j++) {
+			bt->pages[j] = alloc_pages(GFP_KERNEL | __GFP_NOWARN,
+						   bt->order);
+			if (!bt->pages[j])
+				break;
+		}
+		bt->allocated += j;
+		while (j--)
+			__free_pages(bt->pages[j], bt->order);
+		cond_resched();
+	}
+	bt->nsecs = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	complete(&bt->done);
+	return 0;
+}
+
+static void page_alloc_bench_run(struct bench_thread *bt,
+				 unsigned int order, unsigned int nr_cpus)
+{
+	struct task_struct *tsk;
+	unsigned long allocated = 0;
+	u64 nsecs = 0, total_nsecs = 0;
+	unsigned int cpu, i = 0;
+
+	init_completion(&bench_go);
+	for_each_online_cpu(cpu) {
+		if (i == nr_cpus)
+			break;
+		bt[i].order = order;
+		bt[i].allocated = 0;
+		bt[i].nsecs = 0;
+		init_completion(&bt[i].done);
+		tsk = kthread_create(page_alloc_bench_thread, &bt[i],
+				     "page_alloc_bench/%u", cpu);
+		if (IS_ERR(tsk))
+			break;
+		kthread_bind(tsk, cpu);
+		wake_up_process(tsk);
+		i++;
+	}
+	nr_cpus = i;
+	complete_all(&bench_go);
+
+	for (i = 0; i < nr_cpus; i++) {
+		wait_for_completion(&bt[i].done);
+		allocated += bt[i].allocated;
+		total_nsecs += bt[i].nsecs;
+		nsecs = max(nsecs, bt[i].nsecs);
+	}
+
+	if (!allocated || !nsecs) {
+		printk(KERN_INFO "page_alloc_bench: order %u cpus %u: "
+		       "no allocations succeeded\n", order, nr_cpus);
+		return;
+	}
+	printk(KERN_INFO "page_alloc_bench: order %u cpus %u: "
+	       "%llu allocs/sec, %llu ns per alloc+free\n", order, nr_cpus,
+	       div64_u64((u64)allocated * NSEC_PER_SEC, nsecs),
+	       div64_u64(total_nsecs, allocated));
+}
+
+static int __init page_alloc_bench_init(void)
+{
+	struct bench_thread *bt;
+	unsigned int order, nr_cpus, online, i;
+	int ret = -ENOMEM;
+
+	if (!batch || max_order >= MAX_ORDER)
+		return -EINVAL;
+
+	bt = kcalloc(num_possible_cpus(), sizeof(*bt), GFP_KERNEL);
+	if (!bt)
+		return -ENOMEM;
+	for (i = 0; i < num_possible_cpus(); i++) {
+		bt[i].pages = kcalloc(batch, sizeof(struct page *), GFP_KERNEL);
+		if (!bt[i].pages)
+			goto out;
+	}
+
+	get_online_cpus();
+	online = num_online_cpus();
+	for (order = 0; order <= max_order; order++) {
+		for (nr_cpus = 1; ; nr_cpus *= 2) {
+			nr_cpus = min(nr_cpus, online);
+			page_alloc_bench_run(bt, order, nr_cpus);
+			if (nr_cpus == online)
+				break;
+		}
+	}
+	put_online_cpus();
+	ret = 0;
+out:
+	for (i = 0; i < num_possible_cpus(); i++)
+		kfree(bt[i].pages);
+	kfree(bt);
+	return ret;
+}
+module_init(page_alloc_bench_init);
+
+static void __exit page_alloc_bench_exit(void)
+{
+}
+module_exit(page_alloc_bench_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Page allocator throughput benchmark");
@@ -26,7 +26,7 @@
  *       mapping->i_mmap_mutex
  *         anon_vma->mutex
  *           mm->page_table_lock or pte_lock
- *             zone->lru_lock (in mark_page_accessed, isolate_lru_page)
+ *             lruvec->lru_lock (in mark_page_accessed, isolate_lru_page)
  *             swap_lock (in swap_duplicate, swap_info_get)
  *               mmlist_lock (in mmput, drain_mmlist and others)
  *               mapping->private_lock (in __set_page_dirty_buffers)
@@ -1198,6 +1198,13 @@ int try_to_unmap_one(struct page *page, struct vm_area_struct *vma,
 		}
   	}
 
+	/* Written to after MADV_FREE: no need to flush the TLB to find out */
+	if ((flags & TTU_LAZYFREE) && pte_dirty(*pte)) {
+		set_page_dirty(page);
+		ret = SWAP_FAIL;
+		goto out_unmap;
+	}
+
 	/* Nuke the page table entry. */
 	flush_cache_page(vma, address, page_to_pfn(page));
 	pteval = ptep_clear_flush_notify(vma, address, pte);
@@ -1206,6 +1213,17 @@ int try_to_unmap_one(struct page *page, struct vm_area_struct *vma,
 	if (pte_dirty(pteval))
 		set_page_dirty(page);
 
+	/*
+	 * A page freed with MADV_FREE can be discarded as long as it was
+	 * not written to since.  If it was written to in the meantime,
+	 * give up and keep it mapped.
+	 */
+	if ((flags & TTU_LAZYFREE) && PageDirty(page)) {
+		set_pte_at(mm, address, pte, pteval);
+		ret = SWAP_FAIL;
+		goto out_unmap;
+	}
+
 	/* Update high watermark before we lower rss */
 	update_hiwater_rss(mm);
 
@@ -1237,6 +1255,10 @@ int try_to_unmap_one(struct page *page, struct vm_area_struct *vma,
 			}
 			dec_mm_counter(mm, MM_ANONPAGES);
 			inc_mm_counter(mm, MM_SWAPENTS);
+		} else if (flags & TTU_LAZYFREE) {
+			/* Leave the pte clear: the next fault gets a new page */
+			dec_mm_counter(mm, MM_ANONPAGES);
+			goto discard;
 		} else if (PAGE_MIGRATION) {
 			/*
 			 * Store the pfn of the page in a special migration
@@ -1255,7 +1277,7 @@ int try_to_unmap_one(struct page *page, struct vm_area_struct *vma,
 		set_pte_at(mm, address, pte, swp_entry_to_pte(entry));
 	} else
 		dec_mm_counter(mm, MM_FILEPAGES);
-
+discard:
 	page_remove_rmap(page);
 	page_cache_release(page);
 
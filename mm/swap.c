@@ -37,9 +37,95 @@
 /* How many pages do we try to swap or page in/out together? */
 int page_cluster;
 
-static DEFINE_PER_CPU(struct pagevec[NR_LRU_LISTS], lru_add_pvecs);
+/*
+ * Pages on their way to the LRU are gathered per cpu in batches larger
+ * than a pagevec, so that the lru_lock is taken once per LRU_ADD_BATCH
+ * pages rather than once per PAGEVEC_SIZE pages.  The batch matches the
+ * reclaim isolation batch, which bounds the irq-off hold time the same way.
+ */
+#define LRU_ADD_BATCH	SWAP_CLUSTER_MAX
+
+struct lru_add_batch {
+	unsigned int nr;
+	struct page *pages[LRU_ADD_BATCH];
+};
+
+static DEFINE_PER_CPU(struct lru_add_batch[NR_LRU_LISTS], lru_add_batches);
 static DEFINE_PER_CPU(struct pagevec, lru_rotate_pvecs);
 static DEFINE_PER_CPU(struct pagevec, lru_deactivate_pvecs);
+static DEFINE_PER_CPU(struct pagevec, lru_lazyfree_pvecs);
+
+/*
+ * The lruvec of a page changes when a page on the LRU is charged to a
+ * memcg, which happens under the lru_lock of the old lruvec, see
+ * __mem_cgroup_commit_charge_lrucare(), and when an uncharged page goes
+ * back on the LRU, see mem_cgroup_reset_owner().  So look it up again
+ * once its lru_lock is held, until the lock we hold is the right one.
+ * @locked is the lruvec whose lock the caller already holds, or NULL.
+ * Interrupts must be disabled.
+ */
+static struct lruvec *__relock_page_lruvec(struct page *page,
+					   struct lruvec *locked)
+{
+	struct zone *zone = page_zone(page);
+	struct lruvec *lruvec;
+
+	rcu_read_lock();
+	while ((lruvec = mem_cgroup_page_lruvec(page, zone)) != locked) {
+		if (locked)
+			spin_unlock(&locked->lru_lock);
+		spin_lock(&lruvec->lru_lock);
+		locked = lruvec;
+	}
+	rcu_read_unlock();
+
+	return lruvec;
+}
+
+/**
+ * lock_page_lruvec_irq - lock the lruvec a page belongs to
+ * @page: the page
+ *
+ * Disables interrupts and returns the lruvec of @page with its lru_lock
+ * held.  Drop it with spin_unlock_irq(&lruvec->lru_lock).
+ */
+struct lruvec *lock_page_lruvec_irq(struct page *page)
+{
+	local_irq_disable();
+	return __relock_page_lruvec(page, NULL);
+}
+
+struct lruvec *lock_page_lruvec_irqsave(struct page *page,
+					unsigned long *flags)
+{
+	local_irq_save(*flags);
+	return __relock_page_lruvec(page, NULL);
+}
+
+/**
+ * relock_page_lruvec_irq - switch to the lruvec lock of the next page
+ * @page: the page
+ * @locked: lruvec locked by the caller, or NULL
+ *
+ * For loops over a batch of pages: the lock of @locked is kept when
+ * @page belongs to it, and dropped in favour of the right one otherwise.
+ */
+struct lruvec *relock_page_lruvec_irq(struct page *page,
+				      struct lruvec *locked)
+{
+	if (!locked)
+		local_irq_disable();
+	return __relock_page_lruvec(page, locked);
+}
+
+struct lruvec *relock_page_lruvec_irqsave(struct page *page,
+					  struct lruvec *locked,
+					  unsigned long *flags)
+{
+	if (!locked)
+		local_irq_save(*flags);
+	return __relock_page_lruvec(page, locked);
+}
 
 /*
  * This path almost never happens for VM activity - pages are normally
@@ -49,13 +135,13 @@ static void __page_cache_release(struct page *page)
 {
 	if (PageLRU(page)) {
 		unsigned long flags;
-		struct zone *zone = page_zone(page);
+		struct lruvec *lruvec;
 
-		spin_lock_irqsave(&zone->lru_lock, flags);
+		lruvec = lock_page_lruvec_irqsave(page, &flags);
 		VM_BUG_ON(!PageLRU(page));
 		__ClearPageLRU(page);
-		del_page_from_lru(zone, page);
-		spin_unlock_irqrestore(&zone->lru_lock, flags);
+		del_page_from_lru(page, lruvec);
+		spin_unlock_irqrestore(&lruvec->lru_lock, flags);
 	}
 }
 
@@ -202,42 +288,49 @@ void put_pages_list(struct list_head *pages)
 }
 EXPORT_SYMBOL(put_pages_list);
 
-static void pagevec_lru_move_fn(struct pagevec *pvec,
-				void (*move_fn)(struct page *page, void *arg),
-				void *arg)
+/*
+ * Apply move_fn to every page in the array under the lru_lock of the
+ * page's lruvec, keeping the lock held for as long as consecutive pages
+ * belong to the same lruvec.
+ */
+static void lru_move_pages(struct page **pages, int nr,
+			   void (*move_fn)(struct page *page,
+					   struct lruvec *lruvec, void *arg),
+			   void *arg)
 {
 	int i;
-	struct zone *zone = NULL;
+	struct lruvec *lruvec = NULL;
 	unsigned long flags = 0;
 
-	for (i = 0; i < pagevec_count(pvec); i++) {
-		struct page *page = pvec->pages[i];
-		struct zone *pagezone = page_zone(page);
-
-		if (pagezone != zone) {
-			if (zone)
-				spin_unlock_irqrestore(&zone->lru_lock, flags);
-			zone = pagezone;
-			spin_lock_irqsave(&zone->lru_lock, flags);
-		}
+	for (i = 0; i < nr; i++) {
+		struct page *page = pages[i];
 
-		(*move_fn)(page, arg);
+		lruvec = relock_page_lruvec_irqsave(page, lruvec, &flags);
+		(*move_fn)(page, lruvec, arg);
 	}
-	if (zone)
-		spin_unlock_irqrestore(&zone->lru_lock, flags);
+	if (lruvec)
+		spin_unlock_irqrestore(&lruvec->lru_lock, flags);
+}
+
+static void pagevec_lru_move_fn(struct pagevec *pvec,
+				void (*move_fn)(struct page *page,
+						struct lruvec *lruvec,
+						void *arg),
+				void *arg)
+{
+	lru_move_pages(pvec->pages, pagevec_count(pvec), move_fn, arg);
 	release_pages(pvec->pages, pvec->nr, pvec->cold);
 	pagevec_reinit(pvec);
 }
 
-static void pagevec_move_tail_fn(struct page *page, void *arg)
+static void pagevec_move_tail_fn(struct page *page, struct lruvec *lruvec,
+				 void *arg)
 {
 	int *pgmoved = arg;
-	struct zone *zone = page_zone(page);
 
 	if (PageLRU(page) && !PageActive(page) && !PageUnevictable(page)) {
 		enum lru_list lru = page_lru_base_type(page);
-		list_move_tail(&page->lru, &zone->lru[lru].list);
-		mem_cgroup_rotate_reclaimable_page(page);
+		list_move_tail(&page->lru, &lruvec->lists[lru]);
 		(*pgmoved)++;
 	}
 }
@@ -275,41 +368,30 @@ void rotate_reclaimable_page(struct page *page)
 	}
 }
 
-static void update_page_reclaim_stat(struct zone *zone, struct page *page,
+static void update_page_reclaim_stat(struct lruvec *lruvec,
 				     int file, int rotated)
 {
-	struct zone_reclaim_stat *reclaim_stat = &zone->reclaim_stat;
-	struct zone_reclaim_stat *memcg_reclaim_stat;
-
-	memcg_reclaim_stat = mem_cgroup_get_reclaim_stat_from_page(page);
+	struct zone_reclaim_stat *reclaim_stat = &lruvec->reclaim_stat;
 
 	reclaim_stat->recent_scanned[file]++;
 	if (rotated)
 		reclaim_stat->recent_rotated[file]++;
-
-	if (!memcg_reclaim_stat)
-		return;
-
-	memcg_reclaim_stat->recent_scanned[file]++;
-	if (rotated)
-		memcg_reclaim_stat->recent_rotated[file]++;
 }
 
-static void __activate_page(struct page *page, void *arg)
+static void __activate_page(struct page *page, struct lruvec *lruvec,
+			    void *arg)
 {
-	struct zone *zone = page_zone(page);
-
 	if (PageLRU(page) && !PageActive(page) && !PageUnevictable(page)) {
 		int file = page_is_file_cache(page);
 		int lru = page_lru_base_type(page);
-		del_page_from_lru_list(zone, page, lru);
+		del_page_from_lru_list(page, lruvec, lru);
 
 		SetPageActive(page);
 		lru += LRU_ACTIVE;
-		add_page_to_lru_list(zone, page, lru);
+		add_page_to_lru_list(page, lruvec, lru);
 		__count_vm_event(PGACTIVATE);
 
-		update_page_reclaim_stat(zone, page, file, 1);
+		update_page_reclaim_stat(lruvec, file, 1);
 	}
 }
 
@@ -343,14 +425,41 @@ static inline void activate_page_drain(int cpu)
 
 void activate_page(struct page *page)
 {
-	struct zone *zone = page_zone(page);
+	struct lruvec *lruvec;
 
-	spin_lock_irq(&zone->lru_lock);
-	__activate_page(page, NULL);
-	spin_unlock_irq(&zone->lru_lock);
+	lruvec = lock_page_lruvec_irq(page);
+	__activate_page(page, lruvec, NULL);
+	spin_unlock_irq(&lruvec->lru_lock);
 }
 #endif
 
+/*
+ * A page that is accessed again before it made it onto the LRU is most
+ * likely still sitting in this cpu's lru_add batch.  It can be activated
+ * there without the lru_lock: ____pagevec_lru_add_fn() will put a page
+ * with PG_active set straight onto the active list.  The batch is only
+ * drained by its own cpu, and preemption is disabled while we look.
+ * A page found in no batch of ours is left alone; it will be promoted
+ * on a later reference once it is on the LRU.
+ */
+static void __lru_cache_activate_page(struct page *page)
+{
+	struct lru_add_batch *batch;
+	int i;
+
+	batch = &get_cpu_var(lru_add_batches)[page_lru_base_type(page)];
+
+	/* Search backwards, the page was most likely added recently */
+	for (i = batch->nr - 1; i >= 0; i--) {
+		if (batch->pages[i] == page) {
+			SetPageActive(page);
+			break;
+		}
+	}
+
+	put_cpu_var(lru_add_batches);
+}
+
 /*
  * Mark a page as having seen activity.
  *
@@ -361,9 +470,14 @@ void activate_page(struct page *page)
 void mark_page_accessed(struct page *page)
 {
 	if (!PageActive(page) && !PageUnevictable(page) &&
-			PageReferenced(page) && PageLRU(page)) {
-		activate_page(page);
+			PageReferenced(page)) {
+		if (PageLRU(page))
+			activate_page(page);
+		else
+			__lru_cache_activate_page(page);
 		ClearPageReferenced(page);
+		if (page_is_file_cache(page))
+			workingset_activation(page);
 	} else if (!PageReferenced(page)) {
 		SetPageReferenced(page);
 	}
@@ -371,14 +485,29 @@ void mark_page_accessed(struct page *page)
 
 EXPORT_SYMBOL(mark_page_accessed);
 
+static void ____pagevec_lru_add_fn(struct page *page, struct lruvec *lruvec,
+				   void *arg);
+
+static void lru_add_batch_drain(struct lru_add_batch *batch,
+				enum lru_list lru)
+{
+	lru_move_pages(batch->pages, batch->nr, ____pagevec_lru_add_fn,
+		       (void *)lru);
+	release_pages(batch->pages, batch->nr, 0);
+	batch->nr = 0;
+}
+
 void __lru_cache_add(struct page *page, enum lru_list lru)
 {
-	struct pagevec *pvec = &get_cpu_var(lru_add_pvecs)[lru];
+	struct lru_add_batch *batch = &get_cpu_var(lru_add_batches)[lru];
+
+	VM_BUG_ON(is_unevictable_lru(lru));
 
 	page_cache_get(page);
-	if (!pagevec_add(pvec, page))
-		____pagevec_lru_add(pvec, lru);
-	put_cpu_var(lru_add_pvecs);
+	batch->pages[batch->nr++] = page;
+	if (batch->nr == LRU_ADD_BATCH)
+		lru_add_batch_drain(batch, lru);
+	put_cpu_var(lru_add_batches);
 }
 EXPORT_SYMBOL(__lru_cache_add);
 
@@ -413,13 +542,14 @@ void lru_cache_add_lru(struct page *page, enum lru_list lru)
  */
 void add_page_to_unevictable_list(struct page *page)
 {
-	struct zone *zone = page_zone(page);
+	struct lruvec *lruvec;
 
-	spin_lock_irq(&zone->lru_lock);
+	lruvec = lock_page_lruvec_irq(page);
+	mem_cgroup_reset_owner(page);
 	SetPageUnevictable(page);
 	SetPageLRU(page);
-	add_page_to_lru_list(zone, page, LRU_UNEVICTABLE);
-	spin_unlock_irq(&zone->lru_lock);
+	add_page_to_lru_list(page, lruvec, LRU_UNEVICTABLE);
+	spin_unlock_irq(&lruvec->lru_lock);
 }
 
 /*
@@ -443,11 +573,11 @@ void add_page_to_unevictable_list(struct page *page)
  * be write it out by flusher threads as this is much more effective
  * than the single-page writeout from reclaim.
  */
-static void lru_deactivate_fn(struct page *page, void *arg)
+static void lru_deactivate_fn(struct page *page, struct lruvec *lruvec,
+			      void *arg)
 {
 	int lru, file;
 	bool active;
-	struct zone *zone = page_zone(page);
 
 	if (!PageLRU(page))
 		return;
@@ -463,10 +593,10 @@ static void lru_deactivate_fn(struct page *page, void *arg)
 
 	file = page_is_file_cache(page);
 	lru = page_lru_base_type(page);
-	del_page_from_lru_list(zone, page, lru + active);
+	del_page_from_lru_list(page, lruvec, lru + active);
 	ClearPageActive(page);
 	ClearPageReferenced(page);
-	add_page_to_lru_list(zone, page, lru);
+	add_page_to_lru_list(page, lruvec, lru);
 
 	if (PageWriteback(page) || PageDirty(page)) {
 		/*
@@ -480,14 +610,34 @@ static void lru_deactivate_fn(struct page *page, void *arg)
 		 * The page's writeback ends up during pagevec
 		 * We moves tha page into tail of inactive.
 		 */
-		list_move_tail(&page->lru, &zone->lru[lru].list);
-		mem_cgroup_rotate_reclaimable_page(page);
+		list_move_tail(&page->lru, &lruvec->lists[lru]);
 		__count_vm_event(PGROTATED);
 	}
 
 	if (active)
 		__count_vm_event(PGDEACTIVATE);
-	update_page_reclaim_stat(zone, page, file, 0);
+	update_page_reclaim_stat(lruvec, file, 0);
+}
+
+/*
+ * Move a page that was freed with MADV_FREE to the inactive anon list,
+ * where reclaim finds it soon.  Unlike lru_deactivate_fn(), the page is
+ * still mapped: reclaim will discard it, unless it gets written to again.
+ */
+static void lru_lazyfree_fn(struct page *page, struct lruvec *lruvec,
+			    void *arg)
+{
+	if (!PageLRU(page) || PageUnevictable(page))
+		return;
+
+	if (PageActive(page)) {
+		del_page_from_lru_list(page, lruvec, LRU_ACTIVE_ANON);
+		ClearPageActive(page);
+		add_page_to_lru_list(page, lruvec, LRU_INACTIVE_ANON);
+		__count_vm_event(PGDEACTIVATE);
+		update_page_reclaim_stat(lruvec, 0, 0);
+	}
+	ClearPageReferenced(page);
 }
 
 /*
@@ -497,14 +647,15 @@ static void lru_deactivate_fn(struct page *page, void *arg)
  */
 static void drain_cpu_pagevecs(int cpu)
 {
-	struct pagevec *pvecs = per_cpu(lru_add_pvecs, cpu);
+	struct lru_add_batch *batches = per_cpu(lru_add_batches, cpu);
 	struct pagevec *pvec;
 	int lru;
 
-	for_each_lru(lru) {
-		pvec = &pvecs[lru - LRU_BASE];
-		if (pagevec_count(pvec))
-			____pagevec_lru_add(pvec, lru);
+	for_each_evictable_lru(lru) {
+		struct lru_add_batch *batch = &batches[lru - LRU_BASE];
+
+		if (batch->nr)
+			lru_add_batch_drain(batch, lru);
 	}
 
 	pvec = &per_cpu(lru_rotate_pvecs, cpu);
@@ -521,6 +672,10 @@ static void drain_cpu_pagevecs(int cpu)
 	if (pagevec_count(pvec))
 		pagevec_lru_move_fn(pvec, lru_deactivate_fn, NULL);
 
+	pvec = &per_cpu(lru_lazyfree_pvecs, cpu);
+	if (pagevec_count(pvec))
+		pagevec_lru_move_fn(pvec, lru_lazyfree_fn, NULL);
+
 	activate_page_drain(cpu);
 }
 
@@ -550,6 +705,27 @@ void deactivate_page(struct page *page)
 	}
 }
 
+/**
+ * mark_page_lazyfree - make an anonymous page a reclaim candidate
+ * @page: page freed with MADV_FREE
+ *
+ * This function moves @page to the inactive anon list, where reclaim
+ * can discard it if it stays clean.
+ */
+void mark_page_lazyfree(struct page *page)
+{
+	if (!PageAnon(page) || PageUnevictable(page))
+		return;
+
+	if (likely(get_page_unless_zero(page))) {
+		struct pagevec *pvec = &get_cpu_var(lru_lazyfree_pvecs);
+
+		if (!pagevec_add(pvec, page))
+			pagevec_lru_move_fn(pvec, lru_lazyfree_fn, NULL);
+		put_cpu_var(lru_lazyfree_pvecs);
+	}
+}
+
 void lru_add_drain(void)
 {
 	drain_cpu_pagevecs(get_cpu());
@@ -574,8 +750,8 @@ int lru_add_drain_all(void)
  * passed pages.  If it fell to zero then remove the page from the LRU and
  * free it.
  *
- * Avoid taking zone->lru_lock if possible, but if it is taken, retain it
- * for the remainder of the operation.
+ * Avoid taking the lru_lock if possible, but if it is taken, retain it
+ * for as long as the following pages belong to the same lruvec.
  *
  * The locking in this function is against shrink_inactive_list(): we recheck
  * the page count inside the lock to see whether shrink_inactive_list()
@@ -586,7 +762,7 @@ void release_pages(struct page **pages, int nr, int cold)
 {
 	int i;
 	struct pagevec pages_to_free;
-	struct zone *zone = NULL;
+	struct lruvec *lruvec = NULL;
 	unsigned long uninitialized_var(flags);
 
 	pagevec_init(&pages_to_free, cold);
@@ -594,9 +770,10 @@ void release_pages(struct page **pages, int nr, int cold)
 		struct page *page = pages[i];
 
 		if (unlikely(PageCompound(page))) {
-			if (zone) {
-				spin_unlock_irqrestore(&zone->lru_lock, flags);
-				zone = NULL;
+			if (lruvec) {
+				spin_unlock_irqrestore(&lruvec->lru_lock,
+						       flags);
+				lruvec = NULL;
 			}
 			put_compound_page(page);
 			continue;
@@ -606,31 +783,25 @@ void release_pages(struct page **pages, int nr, int cold)
 			continue;
 
 		if (PageLRU(page)) {
-			struct zone *pagezone = page_zone(page);
-
-			if (pagezone != zone) {
-				if (zone)
-					spin_unlock_irqrestore(&zone->lru_lock,
-									flags);
-				zone = pagezone;
-				spin_lock_irqsave(&zone->lru_lock, flags);
-			}
+			lruvec = relock_page_lruvec_irqsave(page, lruvec,
+							    &flags);
 			VM_BUG_ON(!PageLRU(page));
 			__ClearPageLRU(page);
-			del_page_from_lru(zone, page);
+			del_page_from_lru(page, lruvec);
 		}
 
 		if (!pagevec_add(&pages_to_free, page)) {
-			if (zone) {
-				spin_unlock_irqrestore(&zone->lru_lock, flags);
-				zone = NULL;
+			if (lruvec) {
+				spin_unlock_irqrestore(&lruvec->lru_lock,
+						       flags);
+				lruvec = NULL;
 			}
 			__pagevec_free(&pages_to_free);
 			pagevec_reinit(&pages_to_free);
   		}
 	}
-	if (zone)
-		spin_unlock_irqrestore(&zone->lru_lock, flags);
+	if (lruvec)
+		spin_unlock_irqrestore(&lruvec->lru_lock, flags);
 
 	pagevec_free(&pages_to_free);
 }
@@ -656,7 +827,7 @@ void __pagevec_release(struct pagevec *pvec)
 EXPORT_SYMBOL(__pagevec_release);
 
 /* used by __split_huge_page_refcount() */
-void lru_add_page_tail(struct zone* zone,
+void lru_add_page_tail(struct lruvec *lruvec,
 		       struct page *page, struct page *page_tail)
 {
 	int active;
@@ -667,8 +838,11 @@ void lru_add_page_tail(struct zone* zone,
 	VM_BUG_ON(!PageHead(page));
 	VM_BUG_ON(PageCompound(page_tail));
 	VM_BUG_ON(PageLRU(page_tail));
-	VM_BUG_ON(!spin_is_locked(&zone->lru_lock));
+	VM_BUG_ON(!spin_is_locked(&lruvec->lru_lock));
 
+	/* The tail joins the head, see mem_cgroup_split_huge_fixup() */
+	if (!PageLRU(page))
+		mem_cgroup_reset_owner(page_tail);
 	SetPageLRU(page_tail);
 
 	if (page_evictable(page_tail, NULL)) {
@@ -680,34 +854,41 @@ void lru_add_page_tail(struct zone* zone,
 			active = 0;
 			lru = LRU_INACTIVE_ANON;
 		}
-		update_page_reclaim_stat(zone, page_tail, file, active);
+		update_page_reclaim_stat(lruvec, file, active);
 		if (likely(PageLRU(page)))
 			head = page->lru.prev;
 		else
-			head = &zone->lru[lru].list;
-		__add_page_to_lru_list(zone, page_tail, lru, head);
+			head = &lruvec->lists[lru];
+		__add_page_to_lru_list(page_tail, lruvec, lru, head);
 	} else {
 		SetPageUnevictable(page_tail);
-		add_page_to_lru_list(zone, page_tail, LRU_UNEVICTABLE);
+		add_page_to_lru_list(page_tail, lruvec, LRU_UNEVICTABLE);
 	}
 }
 
-static void ____pagevec_lru_add_fn(struct page *page, void *arg)
+static void ____pagevec_lru_add_fn(struct page *page, struct lruvec *lruvec,
+				   void *arg)
 {
 	enum lru_list lru = (enum lru_list)arg;
-	struct zone *zone = page_zone(page);
 	int file = is_file_lru(lru);
 	int active = is_active_lru(lru);
 
-	VM_BUG_ON(PageActive(page));
 	VM_BUG_ON(PageUnevictable(page));
 	VM_BUG_ON(PageLRU(page));
 
+	/* Activated by mark_page_accessed() while waiting in a batch */
+	if (!active && PageActive(page)) {
+		lru += LRU_ACTIVE;
+		active = 1;
+		__count_vm_event(PGACTIVATE);
+	}
+
+	mem_cgroup_reset_owner(page);
 	SetPageLRU(page);
 	if (active)
 		SetPageActive(page);
-	update_page_reclaim_stat(zone, page, file, active);
-	add_page_to_lru_list(zone, page, lru);
+	update_page_reclaim_stat(lruvec, file, active);
+	add_page_to_lru_list(page, lruvec, lru);
 }
 
 /*
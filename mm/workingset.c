@@ -0,0 +1,141 @@
+/*
+ * linux/mm/workingset.c
+ *
+ * Workingset detection
+ *
+ * Per zone, two clock lists are maintained for file pages: the inactive
+ * list, which new pages enter and which reclaim scans, and the active
+ * list, which pages are promoted to when they are referenced twice.
+ *
+ * A page that is accessed again only after it was evicted from the
+ * inactive list "refaults".  If the inactive list had been bigger by the
+ * number of pages that were evicted or activated between the page's
+ * eviction and its refault - the refault distance - the page would have
+ * stayed in memory.  The active list is the only place such space could
+ * be taken from, so a refault whose distance is at most the size of the
+ * active list means that the page belongs to the working set: it is then
+ * activated right away instead of having to prove itself on the inactive
+ * list once more, where a large streaming read would evict it again.
+ *
+ * To measure the distance, every zone counts evictions and activations in
+ * zone->inactive_age.  On eviction, the counter is stored in the page
+ * cache slot the page leaves behind, as a radix tree exceptional entry
+ * ("shadow entry"); on refault, the counter is read again and the
+ * difference is the refault distance.
+ */
+
+#include <linux/mm.h>
+#include <linux/mmzone.h>
+#include <linux/swap.h>
+#include <linux/fs.h>
+#include <linux/radix-tree.h>
+#include <linux/vmstat.h>
+
+/*
+ * A shadow entry holds the zone of the evicted page and the zone's
+ * inactive_age at eviction time, above the exceptional entry tag bits.
+ */
+#define EVICTION_SHIFT	(RADIX_TREE_EXCEPTIONAL_SHIFT + \
+			 ZONES_SHIFT + NODES_SHIFT)
+#define EVICTION_MASK	(~0UL >> EVICTION_SHIFT)
+
+static void *pack_shadow(unsigned long eviction, struct zone *zone)
+{
+	eviction = (eviction << NODES_SHIFT) | zone_to_nid(zone);
+	eviction = (eviction << ZONES_SHIFT) | zone_idx(zone);
+	eviction = (eviction << RADIX_TREE_EXCEPTIONAL_SHIFT);
+
+	return (void *)(eviction | RADIX_TREE_EXCEPTIONAL_ENTRY);
+}
+
+static void unpack_shadow(void *shadow, struct zone **zone,
+			  unsigned long *distance)
+{
+	unsigned long entry = (unsigned long)shadow;
+	unsigned long eviction, refault;
+	int zid, nid;
+
+	entry >>= RADIX_TREE_EXCEPTIONAL_SHIFT;
+	zid = entry & ((1UL << ZONES_SHIFT) - 1);
+	entry >>= ZONES_SHIFT;
+	nid = entry & ((1UL << NODES_SHIFT) - 1);
+	entry >>= NODES_SHIFT;
+	eviction = entry;
+
+	*zone = NODE_DATA(nid)->node_zones + zid;
+
+	refault = atomic_long_read(&(*zone)->inactive_age);
+	/*
+	 * The counter may have wrapped around since eviction, as only
+	 * the low bits of it fit in the shadow entry.  Masking the
+	 * difference gives the right distance unless the page stayed
+	 * out for more than a full cycle, in which case it is not part
+	 * of the working set either way.
+	 */
+	*distance = (refault - eviction) & EVICTION_MASK;
+}
+
+/**
+ * workingset_eviction - note the eviction of a page from memory
+ * @mapping: address space the page was backing
+ * @page: the page being evicted
+ *
+ * Returns a shadow entry to be stored in @mapping->page_tree in place
+ * of the evicted @page, or %NULL if no shadow entry should be left.
+ */
+void *workingset_eviction(struct address_space *mapping, struct page *page)
+{
+	struct zone *zone = page_zone(page);
+	unsigned long eviction;
+
+	/*
+	 * Every eviction ages the inactive list, whether or not a
+	 * shadow entry is left for it, or the distances of other
+	 * refaults would come out too small.
+	 */
+	eviction = atomic_long_inc_return(&zone->inactive_age);
+
+	/*
+	 * Shadow entries are only reclaimed when the file is truncated.
+	 * A refault can only be detected as a working set refault while
+	 * its distance is within the active file list, so there is no
+	 * point in a mapping keeping more shadows than that around.
+	 */
+	if (mapping->nrshadows >= global_page_state(NR_ACTIVE_FILE))
+		return NULL;
+
+	return pack_shadow(eviction, zone);
+}
+
+/**
+ * workingset_refault - evaluate the refault of a previously evicted page
+ * @shadow: shadow entry of the evicted page
+ *
+ * Calculates and evaluates the refault distance of the previously
+ * evicted page in the context of the zone it was allocated in.
+ *
+ * Returns %true if the page should be activated, %false otherwise.
+ */
+bool workingset_refault(void *shadow)
+{
+	unsigned long refault_distance;
+	struct zone *zone;
+
+	unpack_shadow(shadow, &zone, &refault_distance);
+	inc_zone_state(zone, WORKINGSET_REFAULT);
+
+	if (refault_distance <= zone_page_state(zone, NR_ACTIVE_FILE)) {
+		inc_zone_state(zone, WORKINGSET_ACTIVATE);
+		return true;
+	}
+	return false;
+}
+
+/**
+ * workingset_activation - note a page activation
+ * @page: page that is being activated
+ */
+void workingset_activation(struct page *page)
+{
+	atomic_long_inc(&page_zone(page)->inactive_age);
+}
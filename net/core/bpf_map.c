@@ -0,0 +1,308 @@
+/*
+ * Key/value maps for internal BPF programs
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2
+ * of the License.
+ *
+ * Maps are created by kernel code, handed to the programs it builds as
+ * an immediate (BPF_LD_IMM64) and accessed through the helpers below.
+ * Lookups run under the RCU read lock every filter invocation already
+ * holds; updates and deletes take a per-map spinlock and may
+ * be called from softirq context.
+ */
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/mm.h>
+#include <linux/vmalloc.h>
+#include <linux/jhash.h>
+#include <linux/log2.h>
+#include <linux/rculist.h>
+#include <linux/spinlock.h>
+#include <linux/bpf.h>
+
+struct bpf_htab {
+	struct bpf_map		map;
+	struct hlist_head	*buckets;
+	spinlock_t		lock;
+	u32			count;		/* number of elements */
+	u32			n_buckets;	/* power of two */
+	u32			elem_size;
+};
+
+struct htab_elem {
+	struct hlist_node	hash_node;
+	struct rcu_head		rcu;
+	u32			hash;
+	char			key[0] __aligned(8);
+};
+
+/* keep the hash table below this size so the buckets fit in a vmalloc */
+#define HTAB_MAX_ENTRIES	(1U << 20)
+
+static struct bpf_map *htab_map_alloc(u32 key_size, u32 value_size,
+				      u32 max_entries)
+{
+	struct bpf_htab *htab;
+	size_t size;
+	u32 i;
+
+	if (!key_size || !value_size || !max_entries ||
+	    max_entries > HTAB_MAX_ENTRIES || key_size > PAGE_SIZE ||
+	    value_size > PAGE_SIZE)
+		return ERR_PTR(-EINVAL);
+
+	htab = kzalloc(sizeof(*htab), GFP_KERNEL);
+	if (!htab)
+		return ERR_PTR(-ENOMEM);
+
+	htab->n_buckets = roundup_pow_of_two(max_entries);
+	size = htab->n_buckets * sizeof(struct hlist_head);
+	if (size <= PAGE_SIZE)
+		htab->buckets = kmalloc(size, GFP_KERNEL);
+	else
+		htab->buckets = vmalloc(size);
+	if (!htab->buckets) {
+		kfree(htab);
+		return ERR_PTR(-ENOMEM);
+	}
+
+	for (i = 0; i < htab->n_buckets; i++)
+		INIT_HLIST_HEAD(&htab->buckets[i]);
+
+	spin_lock_init(&htab->lock);
+	htab->elem_size = sizeof(struct htab_elem) + round_up(key_size, 8) +
+			  value_size;
+	return &htab->map;
+}
+
+static inline u32 htab_map_hash(const void *key, u32 key_len)
+{
+	return jhash(key, key_len, 0);
+}
+
+static inline struct hlist_head *select_bucket(struct bpf_htab *htab, u32 hash)
+{
+	return &htab->buckets[hash & (htab->n_buckets - 1)];
+}
+
+static struct htab_elem *lookup_elem_raw(struct hlist_head *head, u32 hash,
+					 void *key, u32 key_size)
+{
+	struct hlist_node *n;
+	struct htab_elem *l;
+
+	hlist_for_each_entry_rcu(l, n, head, hash_node)
+		if (l->hash == hash && !memcmp(&l->key, key, key_size))
+			return l;
+
+	return NULL;
+}
+
+static void *htab_map_lookup_elem(struct bpf_map *map, void *key)
+{
+	struct bpf_htab *htab = container_of(map, struct bpf_htab, map);
+	u32 key_size = map->key_size;
+	struct htab_elem *l;
+	u32 hash;
+
+	hash = htab_map_hash(key, key_size);
+	l = lookup_elem_raw(select_bucket(htab, hash), hash, key, key_size);
+	if (l)
+		return l->key + round_up(key_size, 8);
+
+	return NULL;
+}
+
+static int htab_map_update_elem(struct bpf_map *map, void *key, void *value,
+				u64 flags)
+{
+	struct bpf_htab *htab = container_of(map, struct bpf_htab, map);
+	u32 key_size = map->key_size;
+	struct htab_elem *l_new, *l_old;
+	struct hlist_head *head;
+	unsigned long irqflags;
+	int ret;
+
+	if (flags > BPF_EXIST)
+		return -EINVAL;
+
+	/* allocate outside of the lock, the element may not be needed */
+	l_new = kmalloc(htab->elem_size, GFP_ATOMIC | __GFP_NOWARN);
+	if (!l_new)
+		return -ENOMEM;
+
+	memcpy(l_new->key, key, key_size);
+	memcpy(l_new->key + round_up(key_size, 8), value, map->value_size);
+	l_new->hash = htab_map_hash(l_new->key, key_size);
+	head = select_bucket(htab, l_new->hash);
+
+	spin_lock_irqsave(&htab->lock, irqflags);
+
+	l_old = lookup_elem_raw(head, l_new->hash, key, key_size);
+
+	if (!l_old && unlikely(htab->count >= map->max_entries)) {
+		ret = -E2BIG;
+		goto err;
+	}
+	if (l_old && flags == BPF_NOEXIST) {
+		ret = -EEXIST;
+		goto err;
+	}
+	if (!l_old && flags == BPF_EXIST) {
+		ret = -ENOENT;
+		goto err;
+	}
+
+	/* add the new element first so that concurrent lookups always
+	 * find either the old or the new value
+	 */
+	hlist_add_head_rcu(&l_new->hash_node, head);
+	if (l_old) {
+		hlist_del_rcu(&l_old->hash_node);
+		kfree_rcu(l_old, rcu);
+	} else {
+		htab->count++;
+	}
+	spin_unlock_irqrestore(&htab->lock, irqflags);
+
+	return 0;
+err:
+	spin_unlock_irqrestore(&htab->lock, irqflags);
+	kfree(l_new);
+	return ret;
+}
+
+static int htab_map_delete_elem(struct bpf_map *map, void *key)
+{
+	struct bpf_htab *htab = container_of(map, struct bpf_htab, map);
+	u32 key_size = map->key_size;
+	unsigned long irqflags;
+	struct htab_elem *l;
+	u32 hash;
+	int ret = -ENOENT;
+
+	hash = htab_map_hash(key, key_size);
+
+	spin_lock_irqsave(&htab->lock, irqflags);
+	l = lookup_elem_raw(select_bucket(htab, hash), hash, key, key_size);
+	if (l) {
+		hlist_del_rcu(&l->hash_node);
+		htab->count--;
+		kfree_rcu(l, rcu);
+		ret = 0;
+	}
+	spin_unlock_irqrestore(&htab->lock, irqflags);
+
+	return ret;
+}
+
+static void htab_map_free(struct bpf_map *map)
+{
+	struct bpf_htab *htab = container_of(map, struct bpf_htab, map);
+	struct hlist_node *n, *tmp;
+	struct htab_elem *l;
+	u32 i;
+
+	/* no program may be using the map any more, but wait for
+	 * lookups that started before the last reference went away
+	 */
+	synchronize_rcu();
+
+	for (i = 0; i < htab->n_buckets; i++)
+		hlist_for_each_entry_safe(l, n, tmp, &htab->buckets[i],
+					  hash_node)
+			kfree(l);
+
+	/* elements released with kfree_rcu() earlier */
+	rcu_barrier();
+
+	if (is_vmalloc_addr(htab->buckets))
+		vfree(htab->buckets);
+	else
+		kfree(htab->buckets);
+	kfree(htab);
+}
+
+static const struct bpf_map_ops htab_ops = {
+	.map_free = htab_map_free,
+	.map_lookup_elem = htab_map_lookup_elem,
+	.map_update_elem = htab_map_update_elem,
+	.map_delete_elem = htab_map_delete_elem,
+};
+
+/**
+ *	bpf_map_create - allocate a map for internal BPF programs
+ *	@type: BPF_MAP_TYPE_*
+ *	@key_size: size of a key in bytes
+ *	@value_size: size of a value in bytes
+ *	@max_entries: maximum number of elements
+ *
+ * Returns the map with one reference held, or an ERR_PTR(). The caller
+ * must keep that reference for as long as any program using the map
+ * may run.
+ */
+struct bpf_map *bpf_map_create(enum bpf_map_type type, u32 key_size,
+			       u32 value_size, u32 max_entries)
+{
+	struct bpf_map *map;
+
+	switch (type) {
+	case BPF_MAP_TYPE_HASH:
+		map = htab_map_alloc(key_size, value_size, max_entries);
+		if (IS_ERR(map))
+			return map;
+		map->ops = &htab_ops;
+		break;
+	default:
+		return ERR_PTR(-EINVAL);
+	}
+
+	atomic_set(&map->refcnt, 1);
+	map->map_type = type;
+	map->key_size = key_size;
+	map->value_size = value_size;
+	map->max_entries = max_entries;
+	return map;
+}
+EXPORT_SYMBOL_GPL(bpf_map_create);
+
+/**
+ *	bpf_map_put - drop a reference to a map
+ *	@map: map to release
+ *
+ * The map is freed when the last reference is dropped. May sleep.
+ */
+void bpf_map_put(struct bpf_map *map)
+{
+	might_sleep();
+	if (atomic_dec_and_test(&map->refcnt))
+		map->ops->map_free(map);
+}
+EXPORT_SYMBOL_GPL(bpf_map_put);
+
+u64 bpf_map_lookup_elem(u64 r1, u64 r2, u64 r3, u64 r4, u64 r5)
+{
+	struct bpf_map *map = (struct bpf_map *) (unsigned long) r1;
+	void *key = (void *) (unsigned long) r2;
+
+	return (unsigned long) map->ops->map_lookup_elem(map, key);
+}
+
+u64 bpf_map_update_elem(u64 r1, u64 r2, u64 r3, u64 r4, u64 r5)
+{
+	struct bpf_map *map = (struct bpf_map *) (unsigned long) r1;
+	void *key = (void *) (unsigned long) r2;
+	void *value = (void *) (unsigned long) r3;
+
+	return map->ops->map_update_elem(map, key, value, r4);
+}
+
+u64 bpf_map_delete_elem(u64 r1, u64 r2, u64 r3, u64 r4, u64 r5)
+{
+	struct bpf_map *map = (struct bpf_map *) (unsigned long) r1;
+	void *key = (void *) (unsigned long) r2;
+
+	return map->ops->map_delete_elem(map, key);
+}
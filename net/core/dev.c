@@ -2198,7 +2198,7 @@ gso:
 			return rc;
 		}
 		txq_trans_update(txq);
-		if (unlikely(netif_tx_queue_stopped(txq) && skb->next))
+		if (unlikely(netif_xmit_stopped(txq) && skb->next))
 			return NETDEV_TX_BUSY;
 	} while (skb->next);
 
@@ -2345,6 +2345,18 @@ static inline int __dev_xmit_skb(struct sk_buff *skb, struct Qdisc *q,
 
 	qdisc_skb_cb(skb)->pkt_len = skb->len;
 	qdisc_calculate_pkt_len(skb, q);
+
+	if (q->flags & TCQ_F_NOLOCK) {
+		if (unlikely(test_bit(__QDISC_STATE_DEACTIVATED, &q->state))) {
+			kfree_skb(skb);
+			return NET_XMIT_DROP;
+		}
+		skb_dst_force(skb);
+		rc = q->enqueue(skb, q) & NET_XMIT_MASK;
+		qdisc_run(q);
+		return rc;
+	}
+
 	/*
 	 * Heuristic to force contended enqueues to serialize on a
 	 * separate lock before trying to get qdisc main lock.
@@ -2472,7 +2484,7 @@ int dev_queue_xmit(struct sk_buff *skb)
 
 			HARD_TX_LOCK(dev, txq, cpu);
 
-			if (!netif_tx_queue_stopped(txq)) {
+			if (!netif_xmit_stopped(txq)) {
 				__this_cpu_inc(xmit_recursion);
 				rc = dev_hard_start_xmit(skb, dev, txq);
 				__this_cpu_dec(xmit_recursion);
@@ -2633,8 +2645,11 @@ set_rps_cpu(struct net_device *dev, struct sk_buff *skb,
 		flow_id = skb->rxhash & flow_table->mask;
 		rc = dev->netdev_ops->ndo_rx_flow_steer(dev, skb,
 							rxq_index, flow_id);
-		if (rc < 0)
+		if (rc < 0) {
+			this_cpu_inc(softnet_data.rfs_accel_failed);
 			goto out;
+		}
+		this_cpu_inc(softnet_data.rfs_accel_steered);
 		old_rflow = rflow;
 		rflow = &flow_table->flows[flow_id];
 		rflow->cpu = next_cpu;
@@ -2707,6 +2722,12 @@ static int get_rps_cpu(struct net_device *dev, struct sk_buff *skb,
 		next_cpu = sock_flow_table->ents[skb->rxhash &
 		    sock_flow_table->mask];
 
+		if (next_cpu != RPS_NO_CPU) {
+			this_cpu_inc(softnet_data.rfs_flows);
+			if (next_cpu == raw_smp_processor_id())
+				this_cpu_inc(softnet_data.rfs_local);
+		}
+
 		/*
 		 * If the desired CPU (where last recvmsg was done) is
 		 * different from current CPU (one in the rx-queue flow
@@ -2721,8 +2742,10 @@ static int get_rps_cpu(struct net_device *dev, struct sk_buff *skb,
 		if (unlikely(tcpu != next_cpu) &&
 		    (tcpu == RPS_NO_CPU || !cpu_online(tcpu) ||
 		     ((int)(per_cpu(softnet_data, tcpu).input_queue_head -
-		      rflow->last_qtail)) >= 0))
+		      rflow->last_qtail)) >= 0)) {
+			this_cpu_inc(softnet_data.rfs_steered);
 			rflow = set_rps_cpu(dev, skb, rflow, next_cpu);
+		}
 
 		if (tcpu != RPS_NO_CPU && cpu_online(tcpu)) {
 			*rflowp = rflow;
@@ -2778,6 +2801,8 @@ bool rps_may_expire_flow(struct net_device *dev, u16 rxq_index,
 			expire = false;
 	}
 	rcu_read_unlock();
+	if (expire)
+		this_cpu_inc(softnet_data.rfs_accel_expired);
 	return expire;
 }
 EXPORT_SYMBOL(rps_may_expire_flow);
@@ -2967,6 +2992,13 @@ static void net_tx_action(struct softirq_action *h)
 
 			head = head->next_sched;
 
+			if (q->flags & TCQ_F_NOLOCK) {
+				smp_mb__before_clear_bit();
+				clear_bit(__QDISC_STATE_SCHED, &q->state);
+				qdisc_run(q);
+				continue;
+			}
+
 			root_lock = qdisc_lock(q);
 			if (spin_trylock(root_lock)) {
 				smp_mb__before_clear_bit();
@@ -3383,6 +3415,7 @@ enum gro_result dev_gro_receive(struct napi_struct *napi, struct sk_buff *skb)
 		NAPI_GRO_CB(skb)->same_flow = 0;
 		NAPI_GRO_CB(skb)->flush = 0;
 		NAPI_GRO_CB(skb)->free = 0;
+		NAPI_GRO_CB(skb)->encapsulated = 0;
 
 		pp = ptype->gro_receive(&napi->gro_list, skb);
 		break;
@@ -3779,6 +3812,67 @@ void netif_napi_del(struct napi_struct *napi)
 }
 EXPORT_SYMBOL(netif_napi_del);
 
+#ifdef CONFIG_NET_RX_BUSY_POLL
+#define NAPI_HASH_BITS	8
+
+static DEFINE_SPINLOCK(napi_hash_lock);
+static unsigned int napi_gen_id;
+static struct hlist_head napi_hash[1 << NAPI_HASH_BITS];
+
+/* must be called under rcu_read_lock(), as we dont take a reference */
+struct napi_struct *napi_by_id(unsigned int napi_id)
+{
+	unsigned int hash = napi_id % (1 << NAPI_HASH_BITS);
+	struct napi_struct *napi;
+	struct hlist_node *pos;
+
+	hlist_for_each_entry_rcu(napi, pos, &napi_hash[hash], napi_hash_node)
+		if (napi->napi_id == napi_id)
+			return napi;
+
+	return NULL;
+}
+EXPORT_SYMBOL_GPL(napi_by_id);
+
+void napi_hash_add(struct napi_struct *napi)
+{
+	if (!test_and_set_bit(NAPI_STATE_HASHED, &napi->state)) {
+
+		spin_lock(&napi_hash_lock);
+
+		/* 0 is not a valid id, we also skip an id that is taken
+		 * we expect both events to be extremely rare
+		 */
+		napi->napi_id = 0;
+		while (!napi->napi_id) {
+			napi->napi_id = ++napi_gen_id;
+			if (napi_by_id(napi->napi_id))
+				napi->napi_id = 0;
+		}
+
+		hlist_add_head_rcu(&napi->napi_hash_node,
+			&napi_hash[napi->napi_id % (1 << NAPI_HASH_BITS)]);
+
+		spin_unlock(&napi_hash_lock);
+	}
+}
+EXPORT_SYMBOL_GPL(napi_hash_add);
+
+/* Warning : caller is responsible to make sure rcu grace period
+ * is respected before freeing memory containing @napi
+ */
+void napi_hash_del(struct napi_struct *napi)
+{
+	spin_lock(&napi_hash_lock);
+
+	if (test_and_clear_bit(NAPI_STATE_HASHED, &napi->state))
+		hlist_del_rcu(&napi->napi_hash_node);
+
+	spin_unlock(&napi_hash_lock);
+}
+EXPORT_SYMBOL_GPL(napi_hash_del);
+#endif /* CONFIG_NET_RX_BUSY_POLL */
+
 static void net_rx_action(struct softirq_action *h)
 {
 	struct softnet_data *sd = &__get_cpu_var(softnet_data);
@@ -4104,6 +4198,23 @@ static int softnet_seq_show(struct seq_file *seq, void *v)
 	return 0;
 }
 
+#ifdef CONFIG_RPS
+/*
+ * One line per online cpu:
+ * flows local steered accel_steered accel_failed accel_expired
+ */
+static int rfs_stat_seq_show(struct seq_file *seq, void *v)
+{
+	struct softnet_data *sd = v;
+
+	seq_printf(seq, "%08x %08x %08x %08x %08x %08x\n",
+		   sd->rfs_flows, sd->rfs_local, sd->rfs_steered,
+		   sd->rfs_accel_steered, sd->rfs_accel_failed,
+		   sd->rfs_accel_expired);
+	return 0;
+}
+#endif
+
 static const struct seq_operations dev_seq_ops = {
 	.start = dev_seq_start,
 	.next  = dev_seq_next,
@@ -4145,6 +4256,50 @@ static const struct file_operations softnet_seq_fops = {
 	.release = seq_release,
 };
 
+#ifdef CONFIG_RPS
+static const struct seq_operations rfs_stat_seq_ops = {
+	.start = softnet_seq_start,
+	.next  = softnet_seq_next,
+	.stop  = softnet_seq_stop,
+	.show  = rfs_stat_seq_show,
+};
+
+static int rfs_stat_seq_open(struct inode *inode, struct file *file)
+{
+	return seq_open(file, &rfs_stat_seq_ops);
+}
+
+static const struct file_operations rfs_stat_seq_fops = {
+	.owner	 = THIS_MODULE,
+	.open    = rfs_stat_seq_open,
+	.read    = seq_read,
+	.llseek  = seq_lseek,
+	.release = seq_release,
+};
+
+static int __net_init rfs_stat_proc_init(struct net *net)
+{
+	if (!proc_net_fops_create(net, "rfs_stat", S_IRUGO,
+				  &rfs_stat_seq_fops))
+		return -ENOMEM;
+	return 0;
+}
+
+static void rfs_stat_proc_exit(struct net *net)
+{
+	proc_net_remove(net, "rfs_stat");
+}
+#else
+static inline int rfs_stat_proc_init(struct net *net)
+{
+	return 0;
+}
+
+static inline void rfs_stat_proc_exit(struct net *net)
+{
+}
+#endif /* CONFIG_RPS */
+
 static void *ptype_get_idx(loff_t pos)
 {
 	struct packet_type *pt = NULL;
@@ -4260,12 +4415,16 @@ static int __net_init dev_proc_net_init(struct net *net)
 		goto out_dev;
 	if (!proc_net_fops_create(net, "ptype", S_IRUGO, &ptype_seq_fops))
 		goto out_softnet;
+	if (rfs_stat_proc_init(net))
+		goto out_ptype;
 
 	if (wext_proc_init(net))
-		goto out_ptype;
+		goto out_rfs;
 	rc = 0;
 out:
 	return rc;
+out_rfs:
+	rfs_stat_proc_exit(net);
 out_ptype:
 	proc_net_remove(net, "ptype");
 out_softnet:
@@ -4279,6 +4438,7 @@ static void __net_exit dev_proc_net_exit(struct net *net)
 {
 	wext_proc_exit(net);
 
+	rfs_stat_proc_exit(net);
 	proc_net_remove(net, "ptype");
 	proc_net_remove(net, "softnet_stat");
 	proc_net_remove(net, "dev");
@@ -5403,6 +5563,9 @@ static void netdev_init_one_queue(struct net_device *dev,
 	queue->xmit_lock_owner = -1;
 	netdev_queue_numa_node_write(queue, NUMA_NO_NODE);
 	queue->dev = dev;
+#ifdef CONFIG_BQL
+	dql_init(&queue->dql, HZ);
+#endif
 }
 
 static int netif_alloc_netdev_queues(struct net_device *dev)
@@ -130,6 +130,25 @@ u32 secure_ipv4_port_ephemeral(__be32 saddr, __be32 daddr, __be16 dport)
 	return hash[0];
 }
 EXPORT_SYMBOL_GPL(secure_ipv4_port_ephemeral);
+
+/* TCP Fast Open cookie: a MAC of the client and server addresses, so
+ * that only a client that has been seen at that address can have data
+ * in its SYN accepted.
+ */
+void secure_tcp_fastopen_cookie(__be32 saddr, __be32 daddr, u32 *cookie)
+{
+	u32 hash[MD5_DIGEST_WORDS];
+
+	hash[0] = (__force u32)saddr;
+	hash[1] = (__force u32)daddr;
+	hash[2] = net_secret[12];
+	hash[3] = net_secret[13];
+
+	md5_transform(hash, net_secret);
+
+	cookie[0] = hash[0];
+	cookie[1] = hash[1];
+}
 #endif
 
 #if defined(CONFIG_IP_DCCP) || defined(CONFIG_IP_DCCP_MODULE)
@@ -22,16 +22,17 @@
 #include <linux/ptp_classify.h>
 #include <linux/skbuff.h>
 
-static struct sock_filter ptp_filter[] = {
+static struct sock_filter ptp_filter_prog[] = {
 	PTP_FILTER
 };
+static struct sk_filter *ptp_filter __read_mostly;
 
 static unsigned int classify(const struct sk_buff *skb)
 {
 	if (likely(skb->dev &&
 		   skb->dev->phydev &&
 		   skb->dev->phydev->drv))
-		return sk_run_filter(skb, ptp_filter);
+		return SK_RUN_FILTER(ptp_filter, skb);
 	else
 		return PTP_CLASS_NONE;
 }
@@ -134,5 +135,6 @@ EXPORT_SYMBOL_GPL(skb_defer_rx_timestamp);
 
 void __init skb_timestamping_init(void)
 {
-	BUG_ON(sk_chk_filter(ptp_filter, ARRAY_SIZE(ptp_filter)));
+	BUG_ON(ptp_filter_init(&ptp_filter, ptp_filter_prog,
+			       ARRAY_SIZE(ptp_filter_prog)));
 }
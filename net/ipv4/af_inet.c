@@ -555,11 +555,12 @@ int inet_dgram_connect(struct socket *sock, struct sockaddr * uaddr,
 }
 EXPORT_SYMBOL(inet_dgram_connect);
 
-static long inet_wait_for_connect(struct sock *sk, long timeo)
+static long inet_wait_for_connect(struct sock *sk, long timeo, int writebias)
 {
 	DEFINE_WAIT(wait);
 
 	prepare_to_wait(sk_sleep(sk), &wait, TASK_INTERRUPTIBLE);
+	sk->sk_write_pending += writebias;
 
 	/* Basic assumption: if someone sets sk->sk_err, he _must_
 	 * change state of the socket from TCP_SYN_*.
@@ -575,6 +576,7 @@ static long inet_wait_for_connect(struct sock *sk, long timeo)
 		prepare_to_wait(sk_sleep(sk), &wait, TASK_INTERRUPTIBLE);
 	}
 	finish_wait(sk_sleep(sk), &wait);
+	sk->sk_write_pending -= writebias;
 	return timeo;
 }
 
@@ -582,8 +584,8 @@ static long inet_wait_for_connect(struct sock *sk, long timeo)
  *	Connect to a remote host. There is regrettably still a little
  *	TCP 'magic' in here.
  */
-int inet_stream_connect(struct socket *sock, struct sockaddr *uaddr,
-			int addr_len, int flags)
+int __inet_stream_connect(struct socket *sock, struct sockaddr *uaddr,
+			  int addr_len, int flags)
 {
 	struct sock *sk = sock->sk;
 	int err;
@@ -592,8 +594,6 @@ int inet_stream_connect(struct socket *sock, struct sockaddr *uaddr,
 	if (addr_len < sizeof(uaddr->sa_family))
 		return -EINVAL;
 
-	lock_sock(sk);
-
 	if (uaddr->sa_family == AF_UNSPEC) {
 		err = sk->sk_prot->disconnect(sk, flags);
 		sock->state = err ? SS_DISCONNECTING : SS_UNCONNECTED;
@@ -633,8 +633,15 @@ int inet_stream_connect(struct socket *sock, struct sockaddr *uaddr,
 	timeo = sock_sndtimeo(sk, flags & O_NONBLOCK);
 
 	if ((1 << sk->sk_state) & (TCPF_SYN_SENT | TCPF_SYN_RECV)) {
+		/* Data left over from a Fast Open SYN is going to be sent
+		 * right after the SYN-ACK, so let that delay the ACK.
+		 */
+		int writebias = (sk->sk_protocol == IPPROTO_TCP) &&
+				tcp_sk(sk)->fastopen_req &&
+				tcp_sk(sk)->fastopen_req->data ? 1 : 0;
+
 		/* Error code is set above */
-		if (!timeo || !inet_wait_for_connect(sk, timeo))
+		if (!timeo || !inet_wait_for_connect(sk, timeo, writebias))
 			goto out;
 
 		err = sock_intr_errno(timeo);
@@ -656,7 +663,6 @@ int inet_stream_connect(struct socket *sock, struct sockaddr *uaddr,
 	sock->state = SS_CONNECTED;
 	err = 0;
 out:
-	release_sock(sk);
 	return err;
 
 sock_error:
@@ -666,6 +672,18 @@ sock_error:
 		sock->state = SS_DISCONNECTING;
 	goto out;
 }
+EXPORT_SYMBOL(__inet_stream_connect);
+
+int inet_stream_connect(struct socket *sock, struct sockaddr *uaddr,
+			int addr_len, int flags)
+{
+	int err;
+
+	lock_sock(sock->sk);
+	err = __inet_stream_connect(sock, uaddr, addr_len, flags);
+	release_sock(sock->sk);
+	return err;
+}
 EXPORT_SYMBOL(inet_stream_connect);
 
 /*
@@ -1259,6 +1277,7 @@ static struct sk_buff *inet_gso_segment(struct sk_buff *skb, u32 features)
 	int ihl;
 	int id;
 	unsigned int offset = 0;
+	bool udpfrag;
 
 	if (!(features & NETIF_F_V4_CSUM))
 		features &= ~NETIF_F_SG;
@@ -1268,6 +1287,8 @@ static struct sk_buff *inet_gso_segment(struct sk_buff *skb, u32 features)
 		       SKB_GSO_UDP |
 		       SKB_GSO_DODGY |
 		       SKB_GSO_TCP_ECN |
+		       SKB_GSO_TUNNEL |
+		       SKB_GSO_UDP_L4 |
 		       0)))
 		goto out;
 
@@ -1289,6 +1310,10 @@ static struct sk_buff *inet_gso_segment(struct sk_buff *skb, u32 features)
 	proto = iph->protocol & (MAX_INET_PROTOS - 1);
 	segs = ERR_PTR(-EPROTONOSUPPORT);
 
+	/* UFO turns the datagram into IP fragments, the rest into packets */
+	udpfrag = proto == IPPROTO_UDP &&
+		  (skb_shinfo(skb)->gso_type & SKB_GSO_UDP);
+
 	rcu_read_lock();
 	ops = rcu_dereference(inet_protos[proto]);
 	if (likely(ops && ops->gso_segment))
@@ -1301,7 +1326,7 @@ static struct sk_buff *inet_gso_segment(struct sk_buff *skb, u32 features)
 	skb = segs;
 	do {
 		iph = ip_hdr(skb);
-		if (proto == IPPROTO_UDP) {
+		if (udpfrag) {
 			iph->id = htons(id);
 			iph->frag_off = htons(offset >> 3);
 			if (skb->next != NULL)
@@ -1363,7 +1388,11 @@ static struct sk_buff **inet_gro_receive(struct sk_buff **head,
 		if (!NAPI_GRO_CB(p)->same_flow)
 			continue;
 
-		iph2 = ip_hdr(p);
+		/*
+		 * Not ip_hdr(p): for a tunnelled packet the network header
+		 * of p is the outer one.
+		 */
+		iph2 = (struct iphdr *)(p->data + off);
 
 		if ((iph->protocol ^ iph2->protocol) |
 		    (iph->tos ^ iph2->tos) |
@@ -1420,6 +1449,138 @@ out_unlock:
 	return err;
 }
 
+/**
+ * inet_tunnel_gso_segment - segment a GSO packet sent through an IP tunnel
+ * @skb: packet with skb->data at the tunnel header after the outer IP header
+ * @features: features of the output device
+ * @tnl_hlen: length of the tunnel header
+ * @inner_proto: ethertype of the encapsulated packet
+ *
+ * The inner packet is segmented in software and every segment gets a copy of
+ * the outer headers.  inet_gso_segment() fixes up the outer IP headers.
+ */
+struct sk_buff *inet_tunnel_gso_segment(struct sk_buff *skb, u32 features,
+					unsigned int tnl_hlen,
+					__be16 inner_proto)
+{
+	struct sk_buff *segs, *seg;
+	__be16 protocol = skb->protocol;
+	u16 mac_len = skb->mac_len;
+	int mac_offset = skb_mac_header(skb) - skb->data;
+	unsigned int outer_hlen = tnl_hlen - mac_offset;
+
+	if (unlikely(!pskb_may_pull(skb, tnl_hlen)))
+		return ERR_PTR(-EINVAL);
+
+	__skb_pull(skb, tnl_hlen);
+	skb_reset_network_header(skb);
+	skb->protocol = inner_proto;
+	skb_shinfo(skb)->gso_type &= ~SKB_GSO_TUNNEL;
+
+	/*
+	 * Devices cannot segment the inner packet, and only generic
+	 * checksumming reaches the inner transport header.
+	 */
+	features &= ~NETIF_F_GSO_MASK;
+	if (!(features & NETIF_F_GEN_CSUM))
+		features &= ~NETIF_F_ALL_CSUM;
+
+	segs = skb_gso_segment(skb, features);
+
+	/* skb->data is back at the inner header */
+	if (!segs || IS_ERR(segs)) {
+		skb_shinfo(skb)->gso_type |= SKB_GSO_TUNNEL;
+		skb->protocol = protocol;
+		__skb_push(skb, tnl_hlen);
+		skb_reset_transport_header(skb);
+		skb_set_mac_header(skb, mac_offset);
+		skb_set_network_header(skb, mac_offset + mac_len);
+		skb->mac_len = mac_len;
+		return segs;
+	}
+
+	for (seg = segs; seg; seg = seg->next) {
+		__skb_push(seg, outer_hlen);
+		skb_copy_to_linear_data(seg, skb->data - outer_hlen,
+					outer_hlen);
+		skb_reset_mac_header(seg);
+		skb_set_network_header(seg, mac_len);
+		skb_set_transport_header(seg, outer_hlen - tnl_hlen);
+		seg->mac_len = mac_len;
+		seg->protocol = protocol;
+	}
+
+	return segs;
+}
+EXPORT_SYMBOL_GPL(inet_tunnel_gso_segment);
+
+/**
+ * inet_tunnel_gro_receive - aggregate TCP/IPv4 carried in an IP tunnel
+ * @head: list of packets held for aggregation
+ * @skb: packet with its GRO offset at the tunnel header
+ * @tnl_hdr: the tunnel header
+ * @tnl_hlen: length of the tunnel header
+ *
+ * The caller has checked that the held packets flagged as the same flow
+ * come through the same tunnel.  Only one level of encapsulation is
+ * aggregated.
+ */
+struct sk_buff **inet_tunnel_gro_receive(struct sk_buff **head,
+					 struct sk_buff *skb,
+					 const void *tnl_hdr,
+					 unsigned int tnl_hlen)
+{
+	struct sk_buff **pp;
+	int nhoff;
+	__wsum csum;
+
+	if (NAPI_GRO_CB(skb)->encapsulated) {
+		NAPI_GRO_CB(skb)->flush = 1;
+		return NULL;
+	}
+	NAPI_GRO_CB(skb)->encapsulated = 1;
+
+	skb_gro_pull(skb, tnl_hlen);
+
+	/* the inner handlers find their header through the network header */
+	nhoff = skb_network_offset(skb);
+	skb_set_network_header(skb, skb_gro_offset(skb));
+
+	/* both IP headers sum to zero, only the tunnel header is in the way */
+	csum = skb->csum;
+	if (skb->ip_summed == CHECKSUM_COMPLETE && tnl_hlen)
+		skb->csum = csum_sub(csum, csum_partial(tnl_hdr, tnl_hlen, 0));
+
+	pp = inet_gro_receive(head, skb);
+
+	if (skb->ip_summed == CHECKSUM_COMPLETE)
+		skb->csum = csum;
+	skb_set_network_header(skb, nhoff);
+
+	return pp;
+}
+EXPORT_SYMBOL_GPL(inet_tunnel_gro_receive);
+
+/**
+ * inet_tunnel_gro_complete - finish a packet aggregated in an IP tunnel
+ * @skb: the aggregated packet, with the network header at the outer header
+ * @nhoff: offset of the inner IP header from the outer one
+ */
+int inet_tunnel_gro_complete(struct sk_buff *skb, unsigned int nhoff)
+{
+	int outer = skb_network_offset(skb);
+	int err;
+
+	skb_set_network_header(skb, outer + nhoff);
+	err = inet_gro_complete(skb);
+	skb_set_network_header(skb, outer);
+
+	skb_shinfo(skb)->gso_type |= SKB_GSO_TUNNEL;
+
+	return err;
+}
+EXPORT_SYMBOL_GPL(inet_tunnel_gro_complete);
+
 int inet_ctl_sock_create(struct sock **sk, unsigned short family,
 			 unsigned short type, unsigned char protocol,
 			 struct net *net)
@@ -1535,6 +1696,8 @@ static const struct net_protocol udp_protocol = {
 	.err_handler =	udp_err,
 	.gso_send_check = udp4_ufo_send_check,
 	.gso_segment = udp4_ufo_fragment,
+	.gro_receive = udp4_gro_receive,
+	.gro_complete = udp4_gro_complete,
 	.no_policy =	1,
 	.netns_ok =	1,
 };
@@ -17,6 +17,7 @@
 #include <linux/in.h>
 #include <linux/ip.h>
 #include <linux/netdevice.h>
+#include <linux/if_tunnel.h>
 #include <linux/spinlock.h>
 #include <net/protocol.h>
 #include <net/gre.h>
@@ -110,9 +111,96 @@ static void gre_err(struct sk_buff *skb, u32 info)
 	rcu_read_unlock();
 }
 
+/*
+ * Segmentation and aggregation are only done for version 0 GRE with no
+ * options other than a key, which is the same for every packet of a
+ * tunnel.  Returns the header length, or 0 if the header is not handled.
+ */
+static unsigned int gre_offload_hlen(__be16 flags)
+{
+	if (flags & ~GRE_KEY)
+		return 0;
+
+	return (flags & GRE_KEY) ? 8 : 4;
+}
+
+static struct sk_buff *gre_gso_segment(struct sk_buff *skb, u32 features)
+{
+	const __be16 *greh;
+	unsigned int hlen;
+
+	if (unlikely(!pskb_may_pull(skb, 4)))
+		return ERR_PTR(-EINVAL);
+
+	greh = (const __be16 *)skb_transport_header(skb);
+	hlen = gre_offload_hlen(greh[0]);
+	if (!hlen)
+		return ERR_PTR(-EINVAL);
+
+	return inet_tunnel_gso_segment(skb, features, hlen, greh[1]);
+}
+
+static struct sk_buff **gre_gro_receive(struct sk_buff **head,
+					struct sk_buff *skb)
+{
+	struct sk_buff **pp = NULL;
+	struct sk_buff *p;
+	const __be16 *greh;
+	unsigned int hlen;
+	unsigned int off;
+	int flush = 1;
+
+	off = skb_gro_offset(skb);
+	greh = skb_gro_header_fast(skb, off);
+	if (skb_gro_header_hard(skb, off + 4)) {
+		greh = skb_gro_header_slow(skb, off + 4, off);
+		if (unlikely(!greh))
+			goto out;
+	}
+
+	hlen = gre_offload_hlen(greh[0]);
+	if (!hlen || greh[1] != htons(ETH_P_IP))
+		goto out;
+
+	if (skb_gro_header_hard(skb, off + hlen)) {
+		greh = skb_gro_header_slow(skb, off + hlen, off);
+		if (unlikely(!greh))
+			goto out;
+	}
+
+	/* only packets of the same tunnel can be merged */
+	for (p = *head; p; p = p->next) {
+		if (!NAPI_GRO_CB(p)->same_flow)
+			continue;
+
+		if (memcmp(greh, p->data + off, hlen))
+			NAPI_GRO_CB(p)->same_flow = 0;
+	}
+
+	flush = 0;
+	pp = inet_tunnel_gro_receive(head, skb, greh, hlen);
+
+out:
+	NAPI_GRO_CB(skb)->flush |= flush;
+
+	return pp;
+}
+
+static int gre_gro_complete(struct sk_buff *skb)
+{
+	const struct iphdr *iph = ip_hdr(skb);
+	const __be16 *greh = (const __be16 *)((u8 *)iph + iph->ihl * 4);
+
+	return inet_tunnel_gro_complete(skb, iph->ihl * 4 +
+					gre_offload_hlen(greh[0]));
+}
+
 static const struct net_protocol net_gre_protocol = {
 	.handler     = gre_rcv,
 	.err_handler = gre_err,
+	.gso_segment = gre_gso_segment,
+	.gro_receive = gre_gro_receive,
+	.gro_complete = gre_gro_complete,
 	.netns_ok    = 1,
 };
 
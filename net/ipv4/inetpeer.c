@@ -448,6 +448,10 @@ relookup:
 		p->pmtu_expires = 0;
 		p->pmtu_orig = 0;
 		memset(&p->redirect_learned, 0, sizeof(p->redirect_learned));
+		p->tfo_last_syn_loss = 0;
+		p->tfo_mss = 0;
+		p->tfo_syn_loss = 0;
+		p->tfo_cookie_len = 0;
 
 
 		/* Link the node. */
@@ -123,6 +123,8 @@ static int ipgre_tunnel_init(struct net_device *dev);
 static void ipgre_tunnel_setup(struct net_device *dev);
 static int ipgre_tunnel_bind_dev(struct net_device *dev);
 
+#define IPGRE_FEATURES (NETIF_F_SG | NETIF_F_HW_CSUM | NETIF_F_GSO_SOFTWARE)
+
 /* Fallback tunnel: no source, no destination, no key, no options */
 
 #define HASH_SIZE  16
@@ -674,6 +676,9 @@ static int ipgre_rcv(struct sk_buff *skb)
 		skb_reset_network_header(skb);
 		ipgre_ecn_decapsulate(iph, skb);
 
+		if (skb_is_gso(skb))
+			skb_shinfo(skb)->gso_type &= ~SKB_GSO_TUNNEL;
+
 		netif_rx(skb);
 
 		rcu_read_unlock();
@@ -792,7 +797,7 @@ static netdev_tx_t ipgre_tunnel_xmit(struct sk_buff *skb, struct net_device *dev
 	if (skb->protocol == htons(ETH_P_IP)) {
 		df |= (old_iph->frag_off&htons(IP_DF));
 
-		if ((old_iph->frag_off&htons(IP_DF)) &&
+		if ((old_iph->frag_off&htons(IP_DF)) && !skb_is_gso(skb) &&
 		    mtu < ntohs(old_iph->tot_len)) {
 			icmp_send(skb, ICMP_DEST_UNREACH, ICMP_FRAG_NEEDED, htonl(mtu));
 			ip_rt_put(rt);
@@ -812,7 +817,8 @@ static netdev_tx_t ipgre_tunnel_xmit(struct sk_buff *skb, struct net_device *dev
 			}
 		}
 
-		if (mtu >= IPV6_MIN_MTU && mtu < skb->len - tunnel->hlen + gre_hlen) {
+		if (mtu >= IPV6_MIN_MTU && !skb_is_gso(skb) &&
+		    mtu < skb->len - tunnel->hlen + gre_hlen) {
 			icmpv6_send(skb, ICMPV6_PKT_TOOBIG, 0, mtu);
 			ip_rt_put(rt);
 			goto tx_error;
@@ -850,6 +856,23 @@ static netdev_tx_t ipgre_tunnel_xmit(struct sk_buff *skb, struct net_device *dev
 		old_iph = ip_hdr(skb);
 	}
 
+	/* The outer headers are replicated onto every segment when the
+	 * packet is eventually segmented, so a GSO packet keeps its partial
+	 * checksum and only gets marked as tunnelled here.
+	 */
+	if (skb_is_gso(skb)) {
+		if (skb_cloned(skb) &&
+		    pskb_expand_head(skb, 0, 0, GFP_ATOMIC)) {
+			ip_rt_put(rt);
+			goto tx_error;
+		}
+		skb_shinfo(skb)->gso_type |= SKB_GSO_TUNNEL;
+	} else if (skb->ip_summed == CHECKSUM_PARTIAL &&
+		   skb_checksum_help(skb)) {
+		ip_rt_put(rt);
+		goto tx_error;
+	}
+
 	skb_reset_transport_header(skb);
 	skb_push(skb, gre_hlen);
 	skb_reset_network_header(skb);
@@ -977,6 +1000,19 @@ static int ipgre_tunnel_bind_dev(struct net_device *dev)
 
 	tunnel->hlen = addend;
 
+	/* Segments are given copies of the same outer headers, so offloads
+	 * are only offered when no per-packet checksum or sequence number
+	 * has to go into the GRE header.
+	 */
+	if (dev->type == ARPHRD_IPGRE) {
+		if (tunnel->parms.o_flags&(GRE_CSUM|GRE_SEQ)) {
+			dev->features &= ~IPGRE_FEATURES;
+		} else {
+			dev->features |= IPGRE_FEATURES;
+			netif_set_gso_max_size(dev, GSO_MAX_SIZE - addend);
+		}
+	}
+
 	return mtu;
 }
 
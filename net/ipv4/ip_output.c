@@ -809,7 +809,8 @@ static int __ip_append_data(struct sock *sk,
 	skb = skb_peek_tail(queue);
 
 	exthdrlen = !skb ? rt->dst.header_len : 0;
-	mtu = cork->fragsize;
+	/* A GSO datagram is cut to size by the segmentation code, not here */
+	mtu = cork->gso_size ? 0xFFFF : cork->fragsize;
 
 	hh_len = LL_RESERVED_SPACE(rt->dst.dev);
 
@@ -880,6 +881,13 @@ alloc_new_skb:
 			datalen = length + fraggap;
 			if (datalen > mtu - fragheaderlen)
 				datalen = maxfraglen - fragheaderlen;
+
+			/* Keep only the headers of a GSO datagram in the
+			 * linear area; the payload is put in page frags below.
+			 */
+			if (cork->gso_size && transhdrlen &&
+			    (rt->dst.dev->features & NETIF_F_SG))
+				datalen = transhdrlen;
 			fraglen = datalen + fragheaderlen;
 
 			if ((flags & MSG_MORE) &&
@@ -1072,6 +1080,7 @@ static int ip_setup_cork(struct sock *sk, struct inet_cork *cork,
 	cork->dst = &rt->dst;
 	cork->length = 0;
 	cork->tx_flags = ipc->tx_flags;
+	cork->gso_size = ipc->gso_size;
 	cork->page = NULL;
 	cork->off = 0;
 
@@ -1479,6 +1488,7 @@ void ip_send_reply(struct sock *sk, struct sk_buff *skb, __be32 daddr,
 	ipc.addr = daddr;
 	ipc.opt = NULL;
 	ipc.tx_flags = 0;
+	ipc.gso_size = 0;
 
 	if (replyopts.opt.opt.optlen) {
 		ipc.opt = &replyopts.opt;
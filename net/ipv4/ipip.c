@@ -120,6 +120,9 @@
 #define HASH_SIZE  16
 #define HASH(addr) (((__force u32)addr^((__force u32)addr>>4))&0xF)
 
+#define IPIP_FEATURES (NETIF_F_SG | NETIF_F_HW_CSUM | NETIF_F_TSO | \
+		       NETIF_F_TSO_ECN | NETIF_F_UFO | NETIF_F_GSO_UDP_L4)
+
 static int ipip_net_id __read_mostly;
 struct ipip_net {
 	struct ip_tunnel __rcu *tunnels_r_l[HASH_SIZE];
@@ -409,6 +412,9 @@ static int ipip_rcv(struct sk_buff *skb)
 
 		ipip_ecn_decapsulate(iph, skb);
 
+		if (skb_is_gso(skb))
+			skb_shinfo(skb)->gso_type &= ~SKB_GSO_TUNNEL;
+
 		netif_rx(skb);
 
 		rcu_read_unlock();
@@ -487,7 +493,7 @@ static netdev_tx_t ipip_tunnel_xmit(struct sk_buff *skb, struct net_device *dev)
 		if (skb_dst(skb))
 			skb_dst(skb)->ops->update_pmtu(skb_dst(skb), mtu);
 
-		if ((old_iph->frag_off & htons(IP_DF)) &&
+		if ((old_iph->frag_off & htons(IP_DF)) && !skb_is_gso(skb) &&
 		    mtu < ntohs(old_iph->tot_len)) {
 			icmp_send(skb, ICMP_DEST_UNREACH, ICMP_FRAG_NEEDED,
 				  htonl(mtu));
@@ -526,6 +532,19 @@ static netdev_tx_t ipip_tunnel_xmit(struct sk_buff *skb, struct net_device *dev)
 		old_iph = ip_hdr(skb);
 	}
 
+	if (skb_is_gso(skb)) {
+		if (skb_cloned(skb) &&
+		    pskb_expand_head(skb, 0, 0, GFP_ATOMIC)) {
+			ip_rt_put(rt);
+			goto tx_error;
+		}
+		skb_shinfo(skb)->gso_type |= SKB_GSO_TUNNEL;
+	} else if (skb->ip_summed == CHECKSUM_PARTIAL &&
+		   skb_checksum_help(skb)) {
+		ip_rt_put(rt);
+		goto tx_error;
+	}
+
 	skb->transport_header = skb->network_header;
 	skb_push(skb, sizeof(struct iphdr));
 	skb_reset_network_header(skb);
@@ -751,7 +770,10 @@ static void ipip_tunnel_setup(struct net_device *dev)
 	dev->addr_len		= 4;
 	dev->features		|= NETIF_F_NETNS_LOCAL;
 	dev->features		|= NETIF_F_LLTX;
+	dev->features		|= IPIP_FEATURES;
 	dev->priv_flags		&= ~IFF_XMIT_DST_RELEASE;
+
+	netif_set_gso_max_size(dev, GSO_MAX_SIZE - sizeof(struct iphdr));
 }
 
 static int ipip_tunnel_init(struct net_device *dev)
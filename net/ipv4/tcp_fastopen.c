@@ -0,0 +1,123 @@
+/*
+ * TCP Fast Open: data in the SYN for repeat connections.
+ *
+ * A server hands out a cookie, a MAC of the client's address, in the
+ * SYN-ACK to clients that ask for one. A client caches the cookie per
+ * destination in its inet_peer entry and sends it together with data in
+ * the SYN of later connections. The server accepts that data straight
+ * into a child socket when the cookie validates, saving a round trip.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/seqlock.h>
+#include <linux/slab.h>
+#include <net/inetpeer.h>
+#include <net/secure_seq.h>
+#include <net/tcp.h>
+
+int sysctl_tcp_fastopen __read_mostly;
+
+/* The cookie, MSS and loss history of a peer are read and written as a
+ * whole; a single seqlock is enough since they only change on SYN-ACKs.
+ */
+static DEFINE_SEQLOCK(fastopen_seqlock);
+
+void tcp_fastopen_cache_get(struct sock *sk, u16 *mss,
+			    struct tcp_fastopen_cookie *cookie,
+			    int *syn_loss, unsigned long *last_syn_loss)
+{
+	struct inet_peer *peer;
+	bool release_it;
+	unsigned int seq;
+
+	peer = inet_csk(sk)->icsk_af_ops->get_peer(sk, &release_it);
+	if (!peer)
+		return;
+
+	do {
+		seq = read_seqbegin(&fastopen_seqlock);
+		if (peer->tfo_mss)
+			*mss = peer->tfo_mss;
+		cookie->len = peer->tfo_cookie_len;
+		memcpy(cookie->val, peer->tfo_cookie, cookie->len);
+		*syn_loss = peer->tfo_syn_loss;
+		*last_syn_loss = *syn_loss ? peer->tfo_last_syn_loss : 0;
+	} while (read_seqretry(&fastopen_seqlock, seq));
+
+	if (release_it)
+		inet_putpeer(peer);
+}
+
+void tcp_fastopen_cache_set(struct sock *sk, u16 mss,
+			    struct tcp_fastopen_cookie *cookie, bool syn_lost)
+{
+	struct inet_peer *peer;
+	bool release_it;
+
+	peer = inet_csk(sk)->icsk_af_ops->get_peer(sk, &release_it);
+	if (!peer)
+		return;
+
+	write_seqlock_bh(&fastopen_seqlock);
+	peer->tfo_mss = mss;
+	if (syn_lost) {
+		if (peer->tfo_syn_loss < (u8)~0U)
+			peer->tfo_syn_loss++;
+		peer->tfo_last_syn_loss = jiffies;
+	} else {
+		peer->tfo_syn_loss = 0;
+	}
+	if (cookie->len > 0) {
+		memcpy(peer->tfo_cookie, cookie->val, cookie->len);
+		peer->tfo_cookie_len = cookie->len;
+	}
+	write_sequnlock_bh(&fastopen_seqlock);
+
+	if (release_it)
+		inet_putpeer(peer);
+}
+
+/* Computes the cookie for a client at @saddr talking to us at @daddr. */
+void tcp_fastopen_cookie_gen(__be32 saddr, __be32 daddr,
+			     struct tcp_fastopen_cookie *foc)
+{
+	u32 cookie[TCP_FASTOPEN_COOKIE_SIZE / sizeof(u32)];
+
+	secure_tcp_fastopen_cookie(saddr, daddr, cookie);
+	memcpy(foc->val, cookie, TCP_FASTOPEN_COOKIE_SIZE);
+	foc->len = TCP_FASTOPEN_COOKIE_SIZE;
+}
+
+/* Releases the request sock kept by a passive Fast Open child until its
+ * SYN-ACK is acknowledged, or until the child goes away. This drops the
+ * child from the listener's count of pending Fast Open sockets.
+ */
+void tcp_fastopen_remove_req(struct sock *sk)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct request_sock *req = tp->fastopen_rsk;
+	struct sock *lsk;
+
+	if (!req)
+		return;
+
+	tp->fastopen_rsk = NULL;
+	lsk = tcp_rsk(req)->listener;
+	atomic_dec(&tcp_sk(lsk)->fastopen_qlen);
+	sock_put(lsk);
+	reqsk_free(req);
+}
+EXPORT_SYMBOL(tcp_fastopen_remove_req);
+
+void tcp_free_fastopen_req(struct tcp_sock *tp)
+{
+	if (tp->fastopen_req != NULL) {
+		kfree(tp->fastopen_req);
+		tp->fastopen_req = NULL;
+	}
+}
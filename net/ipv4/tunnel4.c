@@ -145,9 +145,28 @@ static void tunnel64_err(struct sk_buff *skb, u32 info)
 }
 #endif
 
+static struct sk_buff *tunnel4_gso_segment(struct sk_buff *skb, u32 features)
+{
+	return inet_tunnel_gso_segment(skb, features, 0, htons(ETH_P_IP));
+}
+
+static struct sk_buff **tunnel4_gro_receive(struct sk_buff **head,
+					    struct sk_buff *skb)
+{
+	return inet_tunnel_gro_receive(head, skb, NULL, 0);
+}
+
+static int tunnel4_gro_complete(struct sk_buff *skb)
+{
+	return inet_tunnel_gro_complete(skb, ip_hdrlen(skb));
+}
+
 static const struct net_protocol tunnel4_protocol = {
 	.handler	=	tunnel4_rcv,
 	.err_handler	=	tunnel4_err,
+	.gso_segment	=	tunnel4_gso_segment,
+	.gro_receive	=	tunnel4_gro_receive,
+	.gro_complete	=	tunnel4_gro_complete,
 	.no_policy	=	1,
 	.netns_ok	=	1,
 };
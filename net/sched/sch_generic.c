@@ -25,6 +25,7 @@
 #include <linux/rcupdate.h>
 #include <linux/list.h>
 #include <linux/slab.h>
+#include <linux/ptr_ring.h>
 #include <net/pkt_sched.h>
 #include <net/dst.h>
 
@@ -37,8 +38,19 @@
  * - enqueue, dequeue are serialized via qdisc root lock
  * - ingress filtering is also serialized via qdisc root lock
  * - updates to tree and tree walking are only done under the rtnl mutex.
+ *
+ * TCQ_F_NOLOCK qdiscs are the exception: they do their own enqueue
+ * serialization, and dequeue is serialized by __QDISC_STATE_RUNNING only.
+ * They do not maintain q.qlen for queued packets, just for the requeued
+ * gso_skb.
  */
 
+/* Tells __qdisc_run() whether to keep going */
+static inline int qdisc_restart_qlen(struct Qdisc *q)
+{
+	return (q->flags & TCQ_F_NOLOCK) ? 1 : qdisc_qlen(q);
+}
+
 static inline int dev_requeue_skb(struct sk_buff *skb, struct Qdisc *q)
 {
 	skb_dst_force(skb);
@@ -89,7 +101,7 @@ static inline int handle_dev_cpu_collision(struct sk_buff *skb,
 		if (net_ratelimit())
 			pr_warning("Dead loop on netdevice %s, fix it urgently!\n",
 				   dev_queue->dev->name);
-		ret = qdisc_qlen(q);
+		ret = qdisc_restart_qlen(q);
 	} else {
 		/*
 		 * Another cpu is holding lock, requeue & delay xmits for
@@ -118,7 +130,8 @@ int sch_direct_xmit(struct sk_buff *skb, struct Qdisc *q,
 	int ret = NETDEV_TX_BUSY;
 
 	/* And release qdisc */
-	spin_unlock(root_lock);
+	if (root_lock)
+		spin_unlock(root_lock);
 
 	HARD_TX_LOCK(dev, txq, smp_processor_id());
 	if (!netif_tx_queue_frozen_or_stopped(txq))
@@ -126,11 +139,12 @@ int sch_direct_xmit(struct sk_buff *skb, struct Qdisc *q,
 
 	HARD_TX_UNLOCK(dev, txq);
 
-	spin_lock(root_lock);
+	if (root_lock)
+		spin_lock(root_lock);
 
 	if (dev_xmit_complete(ret)) {
 		/* Driver sent out skb successfully or skb was consumed */
-		ret = qdisc_qlen(q);
+		ret = qdisc_restart_qlen(q);
 	} else if (ret == NETDEV_TX_LOCKED) {
 		/* Driver try lock failed */
 		ret = handle_dev_cpu_collision(skb, txq, q);
@@ -150,7 +164,8 @@ int sch_direct_xmit(struct sk_buff *skb, struct Qdisc *q,
 }
 
 /*
- * NOTE: Called under qdisc_lock(q) with locally disabled BH.
+ * NOTE: Called under qdisc_lock(q) with locally disabled BH,
+ * unless the qdisc is TCQ_F_NOLOCK.
  *
  * __QDISC_STATE_RUNNING guarantees only one CPU can process
  * this qdisc at a time. qdisc_lock(q) serializes queue accesses for
@@ -180,7 +195,7 @@ static inline int qdisc_restart(struct Qdisc *q)
 	if (unlikely(!skb))
 		return 0;
 	WARN_ON_ONCE(skb_dst_is_noref(skb));
-	root_lock = qdisc_lock(q);
+	root_lock = (q->flags & TCQ_F_NOLOCK) ? NULL : qdisc_lock(q);
 	dev = qdisc_dev(q);
 	txq = netdev_get_tx_queue(dev, skb_get_queue_mapping(skb));
 
@@ -544,6 +559,145 @@ struct Qdisc_ops pfifo_fast_ops __read_mostly = {
 };
 EXPORT_SYMBOL(pfifo_fast_ops);
 
+/*
+ * Lockless variant of pfifo_fast, used by sch_mq for every hardware
+ * tx queue. Each band is a ptr_ring of tx_queue_len skbs: enqueue only
+ * takes the producer lock of one band, never the qdisc root lock or
+ * busylock, and dequeue runs under __QDISC_STATE_RUNNING alone.
+ * Drops are counted privately and folded in by qdisc_nolock_qstats().
+ *
+ * It is not registered, so it can not be created from userspace and
+ * never ends up as a leaf of a classful qdisc relying on q.qlen.
+ */
+struct pfifo_fast_nolock_priv {
+	struct ptr_ring q[PFIFO_FAST_BANDS];
+	atomic_t drops;
+};
+
+static int pfifo_fast_nolock_enqueue(struct sk_buff *skb, struct Qdisc *qdisc)
+{
+	int band = prio2band[skb->priority & TC_PRIO_MAX];
+	struct pfifo_fast_nolock_priv *priv = qdisc_priv(qdisc);
+
+	if (unlikely(ptr_ring_produce(&priv->q[band], skb))) {
+		atomic_inc(&priv->drops);
+		kfree_skb(skb);
+		return NET_XMIT_DROP;
+	}
+	return NET_XMIT_SUCCESS;
+}
+
+static struct sk_buff *pfifo_fast_nolock_dequeue(struct Qdisc *qdisc)
+{
+	struct pfifo_fast_nolock_priv *priv = qdisc_priv(qdisc);
+	struct sk_buff *skb;
+	int band;
+
+	for (band = 0; band < PFIFO_FAST_BANDS; band++) {
+		skb = __ptr_ring_consume(&priv->q[band]);
+		if (skb) {
+			qdisc_bstats_update(qdisc, skb);
+			return skb;
+		}
+	}
+	return NULL;
+}
+
+static struct sk_buff *pfifo_fast_nolock_peek(struct Qdisc *qdisc)
+{
+	struct pfifo_fast_nolock_priv *priv = qdisc_priv(qdisc);
+	struct sk_buff *skb;
+	int band;
+
+	for (band = 0; band < PFIFO_FAST_BANDS; band++) {
+		skb = __ptr_ring_peek(&priv->q[band]);
+		if (skb)
+			return skb;
+	}
+	return NULL;
+}
+
+static void pfifo_fast_nolock_reset(struct Qdisc *qdisc)
+{
+	struct pfifo_fast_nolock_priv *priv = qdisc_priv(qdisc);
+	struct sk_buff *skb;
+	int band;
+
+	for (band = 0; band < PFIFO_FAST_BANDS; band++)
+		while ((skb = __ptr_ring_consume(&priv->q[band])) != NULL)
+			kfree_skb(skb);
+}
+
+static void pfifo_fast_nolock_free_skb(void *skb)
+{
+	kfree_skb(skb);
+}
+
+static void pfifo_fast_nolock_destroy(struct Qdisc *qdisc)
+{
+	struct pfifo_fast_nolock_priv *priv = qdisc_priv(qdisc);
+	int band;
+
+	for (band = 0; band < PFIFO_FAST_BANDS; band++)
+		ptr_ring_cleanup(&priv->q[band], pfifo_fast_nolock_free_skb);
+}
+
+static int pfifo_fast_nolock_init(struct Qdisc *qdisc, struct nlattr *opt)
+{
+	struct pfifo_fast_nolock_priv *priv = qdisc_priv(qdisc);
+	unsigned int qlen = qdisc_dev(qdisc)->tx_queue_len;
+	int band, err;
+
+	for (band = 0; band < PFIFO_FAST_BANDS; band++) {
+		err = ptr_ring_init(&priv->q[band], qlen, GFP_KERNEL);
+		if (err)
+			return err;
+	}
+
+	qdisc->flags |= TCQ_F_NOLOCK;
+	return 0;
+}
+
+void qdisc_nolock_qstats(struct Qdisc *qdisc)
+{
+	struct pfifo_fast_nolock_priv *priv;
+	unsigned int qlen = qdisc->q.qlen;
+	int band;
+
+	if (qdisc->ops != &pfifo_fast_nolock_ops)
+		return;
+
+	priv = qdisc_priv(qdisc);
+	for (band = 0; band < PFIFO_FAST_BANDS; band++)
+		qlen += ptr_ring_count(&priv->q[band]);
+
+	qdisc->qstats.qlen = qlen;
+	qdisc->qstats.drops = atomic_read(&priv->drops);
+}
+EXPORT_SYMBOL(qdisc_nolock_qstats);
+
+static int pfifo_fast_nolock_dump_stats(struct Qdisc *qdisc,
+					struct gnet_dump *d)
+{
+	qdisc_nolock_qstats(qdisc);
+	return 0;
+}
+
+struct Qdisc_ops pfifo_fast_nolock_ops __read_mostly = {
+	.id		=	"pfifo_fast",
+	.priv_size	=	sizeof(struct pfifo_fast_nolock_priv),
+	.enqueue	=	pfifo_fast_nolock_enqueue,
+	.dequeue	=	pfifo_fast_nolock_dequeue,
+	.peek		=	pfifo_fast_nolock_peek,
+	.init		=	pfifo_fast_nolock_init,
+	.reset		=	pfifo_fast_nolock_reset,
+	.destroy	=	pfifo_fast_nolock_destroy,
+	.dump		=	pfifo_fast_dump,
+	.dump_stats	=	pfifo_fast_nolock_dump_stats,
+	.owner		=	THIS_MODULE,
+};
+EXPORT_SYMBOL(pfifo_fast_nolock_ops);
+
 struct Qdisc *qdisc_alloc(struct netdev_queue *dev_queue,
 			  struct Qdisc_ops *ops)
 {
@@ -781,12 +935,27 @@ static void dev_deactivate_queue(struct net_device *dev,
 			set_bit(__QDISC_STATE_DEACTIVATED, &qdisc->state);
 
 		rcu_assign_pointer(dev_queue->qdisc, qdisc_default);
-		qdisc_reset(qdisc);
+		/* lockless qdiscs are reset once no cpu runs them */
+		if (!(qdisc->flags & TCQ_F_NOLOCK))
+			qdisc_reset(qdisc);
 
 		spin_unlock_bh(qdisc_lock(qdisc));
 	}
 }
 
+static void dev_reset_nolock_queue(struct net_device *dev,
+				   struct netdev_queue *dev_queue,
+				   void *_unused)
+{
+	struct Qdisc *qdisc = dev_queue->qdisc_sleeping;
+
+	if (qdisc && (qdisc->flags & TCQ_F_NOLOCK)) {
+		spin_lock_bh(qdisc_lock(qdisc));
+		qdisc_reset(qdisc);
+		spin_unlock_bh(qdisc_lock(qdisc));
+	}
+}
+
 static bool some_qdisc_is_busy(struct net_device *dev)
 {
 	unsigned int i;
@@ -848,6 +1017,9 @@ void dev_deactivate_many(struct list_head *head)
 	list_for_each_entry(dev, head, unreg_list)
 		while (some_qdisc_is_busy(dev))
 			yield();
+
+	list_for_each_entry(dev, head, unreg_list)
+		netdev_for_each_tx_queue(dev, dev_reset_nolock_queue, NULL);
 }
 
 void dev_deactivate(struct net_device *dev)
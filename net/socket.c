@@ -95,6 +95,7 @@
 #include <net/compat.h>
 #include <net/wext.h>
 #include <net/cls_cgroup.h>
+#include <net/busy_poll.h>
 
 #include <net/sock.h>
 #include <linux/netfilter.h>
@@ -105,6 +106,11 @@
 #include <linux/sockios.h>
 #include <linux/atalk.h>
 
+#ifdef CONFIG_NET_RX_BUSY_POLL
+unsigned int sysctl_net_busy_read __read_mostly;
+unsigned int sysctl_net_busy_poll __read_mostly;
+#endif
+
 static int sock_no_open(struct inode *irrelevant, struct file *dontcare);
 static ssize_t sock_aio_read(struct kiocb *iocb, const struct iovec *iov,
 			 unsigned long nr_segs, loff_t pos);
@@ -398,7 +404,7 @@ int sock_map_fd(struct socket *sock, int flags)
 }
 EXPORT_SYMBOL(sock_map_fd);
 
-static struct socket *sock_from_file(struct file *file, int *err)
+struct socket *sock_from_file(struct file *file, int *err)
 {
 	if (file->f_op == &socket_file_ops)
 		return file->private_data;	/* set in sock_map_fd */
@@ -406,6 +412,7 @@ static struct socket *sock_from_file(struct file *file, int *err)
 	*err = -ENOTSOCK;
 	return NULL;
 }
+EXPORT_SYMBOL(sock_from_file);
 
 /**
  *	sockfd_lookup - Go from a file number to its socket slot
@@ -1074,13 +1081,24 @@ EXPORT_SYMBOL(sock_create_lite);
 /* No kernel lock held - perfect */
 static unsigned int sock_poll(struct file *file, poll_table *wait)
 {
+	unsigned int busy_flag = 0;
 	struct socket *sock;
 
 	/*
 	 *      We can't return errors to poll, so it's either yes or no.
 	 */
 	sock = file->private_data;
-	return sock->ops->poll(file, sock, wait);
+
+	if (sk_can_busy_loop(sock->sk)) {
+		/* this socket can poll_ll so tell the system call */
+		busy_flag = POLL_BUSY_LOOP;
+
+		/* once, only if requested by syscall */
+		if (wait && (wait->key & POLL_BUSY_LOOP))
+			sk_busy_loop(sock->sk, 1);
+	}
+
+	return busy_flag | sock->ops->poll(file, sock, wait);
 }
 
 static int sock_mmap(struct file *file, struct vm_area_struct *vma)
@@ -2014,6 +2032,25 @@ out:
 	return err;
 }
 
+/*
+ *	sendmsg on an already referenced file, used by aio.  Control
+ *	messages and security checks act on current, so this must run in
+ *	the context of the task that submitted the operation.
+ */
+
+int sock_file_sendmsg(struct file *file, struct msghdr __user *msg,
+		      unsigned int flags)
+{
+	int err;
+	struct msghdr msg_sys;
+	struct socket *sock = sock_from_file(file, &err);
+
+	if (!sock)
+		return err;
+	return __sys_sendmsg(sock, msg, &msg_sys, flags, NULL);
+}
+EXPORT_SYMBOL(sock_file_sendmsg);
+
 /*
  *	Linux sendmmsg interface
  */
@@ -2194,6 +2231,25 @@ out:
 	return err;
 }
 
+/*
+ *	recvmsg on an already referenced file, used by aio.  Control
+ *	messages and security checks act on current, so this must run in
+ *	the context of the task that submitted the operation.
+ */
+
+int sock_file_recvmsg(struct file *file, struct msghdr __user *msg,
+		      unsigned int flags)
+{
+	int err;
+	struct msghdr msg_sys;
+	struct socket *sock = sock_from_file(file, &err);
+
+	if (!sock)
+		return err;
+	return __sys_recvmsg(sock, msg, &msg_sys, flags, 0);
+}
+EXPORT_SYMBOL(sock_file_recvmsg);
+
 /*
  *     Linux recvmmsg interface
  */